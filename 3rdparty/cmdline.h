@@ -572,7 +572,7 @@ public:
 
     size_t max_width=0;
     for (size_t i=0; i<ordered.size(); i++){
-      max_width=max(max_width, (size_t)ordered[i]->name().length());
+      max_width=(std::max)(max_width, (size_t)ordered[i]->name().length());
     }
     for (size_t i=0; i<ordered.size(); i++){
       if (ordered[i]->short_name()){
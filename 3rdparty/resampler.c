@@ -22,6 +22,12 @@
 
 /* Bog-standard windowed SINC implementation. */
 #include "resampler.h"
+#include "../io/cpu.h"
+#include <immintrin.h>
+
+#if !defined(_MSC_VER) && !defined(__forceinline)
+#define __forceinline inline __attribute__((always_inline))
+#endif
 
 /* Rough SNR values for upsampling:
 * LOWEST: 40 dB
@@ -31,47 +37,68 @@
 * HIGHEST: 140 dB
 */
 
-#define SINC_WINDOW_KAISER
-#define SINC_WINDOW_KAISER_BETA 5.5
-#define CUTOFF 0.825
-#define PHASE_BITS 8
-#define SUBPHASE_BITS 16
-#define SINC_COEFF_LERP 1
-#define SIDELOBES 8
-#define ENABLE_AVX 0
-
-#if SINC_COEFF_LERP
+/* Coefficients are always interpolated between phases, so each table row
+ * is followed by a row of deltas. */
 #define TAPS_MULT 2
-#else
-#define TAPS_MULT 1
-#endif
-
-#define window_function(idx)  (kaiser_window_function(idx, SINC_WINDOW_KAISER_BETA))
 
-/* For the little amount of taps we're using,
-* SSE1 is faster than AVX for some reason.
-* AVX code is kept here though as by increasing number
-* of sinc taps, the AVX code is clearly faster than SSE1.
-*/
-
-#define PHASES (1 << (PHASE_BITS + SUBPHASE_BITS))
+enum sinc_window
+{
+	SINC_WINDOW_LANCZOS = 0,
+	SINC_WINDOW_KAISER
+};
 
-#define TAPS (SIDELOBES * 2)
-#define SUBPHASE_MASK ((1 << SUBPHASE_BITS) - 1)
-#define SUBPHASE_MOD (1.0f / (1 << SUBPHASE_BITS))
+static const struct sinc_quality
+{
+	double cutoff;
+	unsigned sidelobes;
+	unsigned phase_bits;
+	unsigned subphase_bits;
+	enum sinc_window window;
+	double kaiser_beta;
+} sinc_qualities[] = {
+	/* RESAMPLER_QUALITY_LOWEST */  { 0.98,  2,   12, 10, SINC_WINDOW_LANCZOS, 0.0  },
+	/* RESAMPLER_QUALITY_LOWER */   { 0.98,  4,   12, 10, SINC_WINDOW_LANCZOS, 0.0  },
+	/* RESAMPLER_QUALITY_NORMAL */  { 0.825, 8,   8,  16, SINC_WINDOW_KAISER,  5.5  },
+	/* RESAMPLER_QUALITY_HIGHER */  { 0.90,  32,  10, 14, SINC_WINDOW_KAISER,  10.5 },
+	/* RESAMPLER_QUALITY_HIGHEST */ { 0.962, 128, 10, 14, SINC_WINDOW_KAISER,  14.5 },
+};
+
+
+typedef void (*sinc_kernel_t)(const float *buffer_l, const float *buffer_r,
+	const float *phase_table, const float *delta_table, float delta,
+	unsigned taps, float *out);
+
+/* Phase tables depend only on the quality, bandwidth and padded width, so
+ * they are built once and kept for the life of the process. */
+typedef struct sinc_table
+{
+	struct sinc_table *next;
+	enum resampler_quality quality;
+	double bandwidth_mod;
+	unsigned taps;
+	float *phase_table;
+} sinc_table_t;
 
+static sinc_table_t *sinc_tables;
 
 typedef struct rarch_sinc_resampler
 {
-	float *phase_table;
+	enum resampler_engine engine; /* must stay first, see resampler_process */
+	const float *phase_table;
 	float *buffer_l;
 	float *buffer_r;
+	sinc_kernel_t kernel;
+	enum resampler_simd simd;
+	enum resampler_quality quality;
+	/* filter length, padded with zero taps to the kernel's vector width */
 	unsigned taps;
 	unsigned ptr;
 	uint32_t time;
-	/* A buffer for phase_table, buffer_l and buffer_r
-	* are created in a single calloc().
-	* Ensure that we get as good cache locality as we can hope for. */
+	uint32_t phases;
+	unsigned subphase_bits;
+	uint32_t subphase_mask;
+	float subphase_mod;
+	/* buffer_l and buffer_r share one allocation */
 	float *main_buffer;
 } rarch_sinc_resampler_t;
 
@@ -136,86 +163,246 @@ void memalign_free(void *ptr)
    free(p[-1]);
 }
 
-void resampler_sinc_process(void *re_, struct resampler_data *data)
+/* One output frame: sum over taps of history * (phase + delta * frac).
+ * Every kernel reads the same zero-padded table, so they differ only in
+ * summation order (and FMA rounding on AVX2/AVX-512). */
+static void sinc_kernel_c(const float *buffer_l, const float *buffer_r,
+	const float *phase_table, const float *delta_table, float delta,
+	unsigned taps, float *out)
 {
-    size_t out_frames = 0;
-	rarch_sinc_resampler_t *resamp = (rarch_sinc_resampler_t*)re_;
-	uint32_t ratio = PHASES / data->ratio;
-	const float *input = data->data_in;
-	float *output = data->data_out;
-	size_t frames = data->input_frames;
-	
-	while (frames)
+	unsigned i;
+	float sum_l = 0.0f;
+	float sum_r = 0.0f;
+	for (i = 0; i < taps; i++)
 	{
-		while (frames && resamp->time >= PHASES)
-		{
-			/* Push in reverse to make filter more obvious. */
-			if (!resamp->ptr)
-				resamp->ptr = resamp->taps;
-			resamp->ptr--;
+		float _sinc = phase_table[i] + delta_table[i] * delta;
+		sum_l += buffer_l[i] * _sinc;
+		sum_r += buffer_r[i] * _sinc;
+	}
+	out[0] = sum_l;
+	out[1] = sum_r;
+}
 
-			resamp->buffer_l[resamp->ptr + resamp->taps] =
-				resamp->buffer_l[resamp->ptr] = *input++;
+static void sinc_kernel_sse(const float *buffer_l, const float *buffer_r,
+	const float *phase_table, const float *delta_table, float delta_,
+	unsigned taps, float *out)
+{
+	unsigned i;
+	__m128 sum;
+	__m128 delta = _mm_set1_ps(delta_);
+	__m128 sum_l = _mm_setzero_ps();
+	__m128 sum_r = _mm_setzero_ps();
 
-			resamp->buffer_r[resamp->ptr + resamp->taps] =
-				resamp->buffer_r[resamp->ptr] = *input++;
+	for (i = 0; i < taps; i += 4)
+	{
+		__m128 buf_l = _mm_loadu_ps(buffer_l + i);
+		__m128 buf_r = _mm_loadu_ps(buffer_r + i);
+		__m128 deltas = _mm_load_ps(delta_table + i);
+		__m128 _sinc = _mm_add_ps(_mm_load_ps(phase_table + i),
+			_mm_mul_ps(deltas, delta));
+		sum_l = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, _sinc));
+		sum_r = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, _sinc));
+	}
 
-			resamp->time -= PHASES;
-			frames--;
-		}
+	/* Them annoying shuffles.
+	* sum_l = { l3, l2, l1, l0 }
+	* sum_r = { r3, r2, r1, r0 }
+	*/
 
-		while (resamp->time < PHASES)
-		{
-			unsigned i;
-			__m128 sum;
-			const float *buffer_l = resamp->buffer_l + resamp->ptr;
-			const float *buffer_r = resamp->buffer_r + resamp->ptr;
-			unsigned taps = resamp->taps;
-			unsigned phase = resamp->time >> SUBPHASE_BITS;
-			const float *phase_table = resamp->phase_table + phase * taps * TAPS_MULT;
-			const float *delta_table = phase_table + taps;
-			__m128 delta = _mm_set1_ps((float)
-				(resamp->time & SUBPHASE_MASK) * SUBPHASE_MOD);
+	sum = _mm_add_ps(_mm_shuffle_ps(sum_l, sum_r,
+		_MM_SHUFFLE(1, 0, 1, 0)),
+		_mm_shuffle_ps(sum_l, sum_r, _MM_SHUFFLE(3, 2, 3, 2)));
 
-			__m128 sum_l = _mm_setzero_ps();
-			__m128 sum_r = _mm_setzero_ps();
+	/* sum   = { r1, r0, l1, l0 } + { r3, r2, l3, l2 }
+	* sum   = { R1, R0, L1, L0 }
+	*/
 
-			for (i = 0; i < taps; i += 4)
-			{
-				__m128 buf_l = _mm_loadu_ps(buffer_l + i);
-				__m128 buf_r = _mm_loadu_ps(buffer_r + i);
-				__m128 deltas = _mm_load_ps(delta_table + i);
-				__m128 _sinc = _mm_add_ps(_mm_load_ps(phase_table + i),
-					_mm_mul_ps(deltas, delta));
-				sum_l = _mm_add_ps(sum_l, _mm_mul_ps(buf_l, _sinc));
-				sum_r = _mm_add_ps(sum_r, _mm_mul_ps(buf_r, _sinc));
-			}
+	sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), sum);
 
-			/* Them annoying shuffles.
-			* sum_l = { l3, l2, l1, l0 }
-			* sum_r = { r3, r2, r1, r0 }
-			*/
+	/* sum   = {R1, R1, L1, L1 } + { R1, R0, L1, L0 }
+	* sum   = { X,  R,  X,  L }
+	*/
 
-			sum = _mm_add_ps(_mm_shuffle_ps(sum_l, sum_r,
-				_MM_SHUFFLE(1, 0, 1, 0)),
-				_mm_shuffle_ps(sum_l, sum_r, _MM_SHUFFLE(3, 2, 3, 2)));
+	/* Store L */
+	_mm_store_ss(out + 0, sum);
 
-			/* sum   = { r1, r0, l1, l0 } + { r3, r2, l3, l2 }
-			* sum   = { R1, R0, L1, L0 }
-			*/
+	/* movehl { X, R, X, L } == { X, R, X, R } */
+	_mm_store_ss(out + 1, _mm_movehl_ps(sum, sum));
+}
 
-			sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), sum);
+/* { L, R } from two 4-wide partial sums, as in the SSE kernel */
+static __forceinline void sinc_store_pair(__m128 sum_l, __m128 sum_r, float *out)
+{
+	__m128 sum = _mm_add_ps(_mm_shuffle_ps(sum_l, sum_r,
+		_MM_SHUFFLE(1, 0, 1, 0)),
+		_mm_shuffle_ps(sum_l, sum_r, _MM_SHUFFLE(3, 2, 3, 2)));
+	sum = _mm_add_ps(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(3, 3, 1, 1)), sum);
+	_mm_store_ss(out + 0, sum);
+	_mm_store_ss(out + 1, _mm_movehl_ps(sum, sum));
+}
 
-			/* sum   = {R1, R1, L1, L1 } + { R1, R0, L1, L0 }
-			* sum   = { X,  R,  X,  L }
-			*/
+/* { L, R } from two 8-wide sums: one hadd pairs up both channels, a
+ * second folds each to { L, R } per lane, and the lanes add up. */
+CPU_TARGET("avx2,fma")
+static __forceinline void sinc_store_pair256(__m256 sum_l, __m256 sum_r, float *out)
+{
+	__m256 sum = _mm256_hadd_ps(sum_l, sum_r);
+	__m128 pair;
+	sum = _mm256_hadd_ps(sum, sum);
+	pair = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	_mm_storel_pi((__m64*)out, pair);
+}
 
-			/* Store L */
-			_mm_store_ss(output + 0, sum);
+/* The history window slides a frame at a time, so its loads can't be
+ * aligned; the tables are. Two accumulators per channel keep two FMA
+ * chains in flight, which a single chain over 16-64 taps can't. */
+CPU_TARGET("avx2,fma")
+static void sinc_kernel_avx2(const float *buffer_l, const float *buffer_r,
+	const float *phase_table, const float *delta_table, float delta_,
+	unsigned taps, float *out)
+{
+	unsigned i = 0;
+	__m256 delta = _mm256_set1_ps(delta_);
+	__m256 sum_l = _mm256_setzero_ps(), sum_l2 = _mm256_setzero_ps();
+	__m256 sum_r = _mm256_setzero_ps(), sum_r2 = _mm256_setzero_ps();
 
-			/* movehl { X, R, X, L } == { X, R, X, R } */
-			_mm_store_ss(output + 1, _mm_movehl_ps(sum, sum));
+	for (; i + 16 <= taps; i += 16)
+	{
+		__m256 sinc0 = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i), delta,
+			_mm256_load_ps(phase_table + i));
+		__m256 sinc1 = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i + 8), delta,
+			_mm256_load_ps(phase_table + i + 8));
+		sum_l = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i), sinc0, sum_l);
+		sum_r = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i), sinc0, sum_r);
+		sum_l2 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i + 8), sinc1, sum_l2);
+		sum_r2 = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i + 8), sinc1, sum_r2);
+	}
+	if (i < taps)
+	{
+		__m256 _sinc = _mm256_fmadd_ps(_mm256_load_ps(delta_table + i), delta,
+			_mm256_load_ps(phase_table + i));
+		sum_l = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_l + i), _sinc, sum_l);
+		sum_r = _mm256_fmadd_ps(_mm256_loadu_ps(buffer_r + i), _sinc, sum_r);
+	}
 
+	sinc_store_pair256(_mm256_add_ps(sum_l, sum_l2), _mm256_add_ps(sum_r, sum_r2), out);
+}
+
+CPU_TARGET("avx512f")
+static void sinc_kernel_avx512(const float *buffer_l, const float *buffer_r,
+	const float *phase_table, const float *delta_table, float delta_,
+	unsigned taps, float *out)
+{
+	unsigned i = 0;
+	__m512 delta = _mm512_set1_ps(delta_);
+	__m512 sum_l = _mm512_setzero_ps(), sum_l2 = _mm512_setzero_ps();
+	__m512 sum_r = _mm512_setzero_ps(), sum_r2 = _mm512_setzero_ps();
+	__m256 half_l, half_r, sum;
+	__m128 pair;
+
+	for (; i + 32 <= taps; i += 32)
+	{
+		__m512 sinc0 = _mm512_fmadd_ps(_mm512_load_ps(delta_table + i), delta,
+			_mm512_load_ps(phase_table + i));
+		__m512 sinc1 = _mm512_fmadd_ps(_mm512_load_ps(delta_table + i + 16), delta,
+			_mm512_load_ps(phase_table + i + 16));
+		sum_l = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_l + i), sinc0, sum_l);
+		sum_r = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_r + i), sinc0, sum_r);
+		sum_l2 = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_l + i + 16), sinc1, sum_l2);
+		sum_r2 = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_r + i + 16), sinc1, sum_r2);
+	}
+	if (i < taps)
+	{
+		__m512 _sinc = _mm512_fmadd_ps(_mm512_load_ps(delta_table + i), delta,
+			_mm512_load_ps(phase_table + i));
+		sum_l = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_l + i), _sinc, sum_l);
+		sum_r = _mm512_fmadd_ps(_mm512_loadu_ps(buffer_r + i), _sinc, sum_r);
+	}
+	sum_l = _mm512_add_ps(sum_l, sum_l2);
+	sum_r = _mm512_add_ps(sum_r, sum_r2);
+
+	half_l = _mm256_add_ps(_mm512_castps512_ps256(sum_l),
+		_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(sum_l), 1)));
+	half_r = _mm256_add_ps(_mm512_castps512_ps256(sum_r),
+		_mm256_castpd_ps(_mm512_extractf64x4_pd(_mm512_castps_pd(sum_r), 1)));
+	sum = _mm256_hadd_ps(half_l, half_r);
+	sum = _mm256_hadd_ps(sum, sum);
+	pair = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+	_mm_storel_pi((__m64*)out, pair);
+}
+
+/* Push n interleaved frames into the history, newest first, deinterleaving
+ * four frames at a time between ring wraps. */
+static __forceinline void sinc_push(rarch_sinc_resampler_t *resamp,
+	const float *input, size_t n)
+{
+	unsigned taps = resamp->taps;
+	while (n)
+	{
+		size_t run, k;
+		float *dst_l, *dst_r;
+		if (!resamp->ptr)
+			resamp->ptr = taps;
+		run = n < resamp->ptr ? n : resamp->ptr;
+		/* frame k lands at ptr - 1 - k */
+		dst_l = resamp->buffer_l + resamp->ptr;
+		dst_r = resamp->buffer_r + resamp->ptr;
+		for (k = 0; k + 4 <= run; k += 4)
+		{
+			__m128 a = _mm_loadu_ps(input + k * 2);
+			__m128 b = _mm_loadu_ps(input + k * 2 + 4);
+			__m128 l = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 r = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+			l = _mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 1, 2, 3));
+			r = _mm_shuffle_ps(r, r, _MM_SHUFFLE(0, 1, 2, 3));
+			_mm_storeu_ps(dst_l - k - 4, l);
+			_mm_storeu_ps(dst_l - k - 4 + taps, l);
+			_mm_storeu_ps(dst_r - k - 4, r);
+			_mm_storeu_ps(dst_r - k - 4 + taps, r);
+		}
+		for (; k < run; k++)
+		{
+			dst_l[-1 - (ptrdiff_t)k + taps] = dst_l[-1 - (ptrdiff_t)k] = input[k * 2];
+			dst_r[-1 - (ptrdiff_t)k + taps] = dst_r[-1 - (ptrdiff_t)k] = input[k * 2 + 1];
+		}
+		resamp->ptr -= (unsigned)run;
+		input += run * 2;
+		n -= run;
+	}
+}
+
+void resampler_sinc_process(void *re_, struct resampler_data *data)
+{
+	size_t out_frames = 0;
+	rarch_sinc_resampler_t *resamp = (rarch_sinc_resampler_t*)re_;
+	uint32_t phases = resamp->phases;
+	uint32_t ratio = phases / data->ratio;
+	const float *input = data->data_in;
+	float *output = data->data_out;
+	size_t frames = data->input_frames;
+	unsigned taps = resamp->taps;
+	sinc_kernel_t kernel = resamp->kernel;
+
+	while (frames)
+	{
+		if (resamp->time >= phases)
+		{
+			size_t n = resamp->time / phases;
+			if (n > frames)
+				n = frames;
+			sinc_push(resamp, input, n);
+			input += n * 2;
+			frames -= n;
+			resamp->time -= (uint32_t)(n * phases);
+		}
+
+		while (resamp->time < phases)
+		{
+			unsigned phase = resamp->time >> resamp->subphase_bits;
+			const float *phase_table = resamp->phase_table + phase * taps * TAPS_MULT;
+			kernel(resamp->buffer_l + resamp->ptr, resamp->buffer_r + resamp->ptr,
+				phase_table, phase_table + taps,
+				(float)(resamp->time & resamp->subphase_mask) * resamp->subphase_mod, taps, output);
 			output += 2;
 			out_frames++;
 			resamp->time += ratio;
@@ -226,11 +413,19 @@ void resampler_sinc_process(void *re_, struct resampler_data *data)
 }
 
 
-static void sinc_init_table(rarch_sinc_resampler_t *resamp, double cutoff,
-	float *phase_table, int phases, int taps, bool calculate_delta)
+static __forceinline double sinc_window(const struct sinc_quality *q, double idx)
+{
+	if (q->window == SINC_WINDOW_LANCZOS)
+		return sinc(M_PI * idx);
+	return kaiser_window_function(idx, q->kaiser_beta);
+}
+
+/* Rows are 'row' floats long; taps beyond 'taps' stay zero. */
+static void sinc_init_table(const struct sinc_quality *q, double cutoff,
+	float *phase_table, int phases, int taps, int row, bool calculate_delta)
 {
 	int i, j;
-	double    window_mod = window_function(0.0); /* Need to normalize w(0) to 1.0. */
+	double    window_mod = sinc_window(q, 0.0); /* Need to normalize w(0) to 1.0. */
 	int           stride = calculate_delta ? 2 : 1;
 	double     sidelobes = taps / 2.0;
 
@@ -245,8 +440,8 @@ static void sinc_init_table(rarch_sinc_resampler_t *resamp, double cutoff,
 			window_phase = 2.0 * window_phase - 1.0; /* [-1, 1) */
 			sinc_phase = sidelobes * window_phase;
 			val = cutoff * sinc(M_PI * sinc_phase * cutoff) *
-				window_function(window_phase) / window_mod;
-			phase_table[i * stride * taps + j] = val;
+				sinc_window(q, window_phase) / window_mod;
+			phase_table[i * stride * row + j] = val;
 		}
 	}
 
@@ -259,9 +454,9 @@ static void sinc_init_table(rarch_sinc_resampler_t *resamp, double cutoff,
 		{
 			for (j = 0; j < taps; j++)
 			{
-				float delta = phase_table[(p + 1) * stride * taps + j] -
-					phase_table[p * stride * taps + j];
-				phase_table[(p * stride + 1) * taps + j] = delta;
+				float delta = phase_table[(p + 1) * stride * row + j] -
+					phase_table[p * stride * row + j];
+				phase_table[(p * stride + 1) * row + j] = delta;
 			}
 		}
 
@@ -276,9 +471,9 @@ static void sinc_init_table(rarch_sinc_resampler_t *resamp, double cutoff,
 			sinc_phase = sidelobes * window_phase;
 
 			val = cutoff * sinc(M_PI * sinc_phase * cutoff) *
-				window_function(window_phase) / window_mod;
-			delta = (val - phase_table[phase * stride * taps + j]);
-			phase_table[(phase * stride + 1) * taps + j] = delta;
+				sinc_window(q, window_phase) / window_mod;
+			delta = (val - phase_table[phase * stride * row + j]);
+			phase_table[(phase * stride + 1) * row + j] = delta;
 		}
 	}
 }
@@ -291,46 +486,282 @@ void resampler_sinc_free(void *data)
 	free(resamp);
 }
 
-void *resampler_sinc_init(
-	double bandwidth_mod)
+bool resampler_sinc_simd_supported(enum resampler_simd simd)
+{
+	unsigned cpu = cpu_features();
+	switch (simd)
+	{
+	case RESAMPLER_SIMD_AUTO:
+	case RESAMPLER_SIMD_C:
+	case RESAMPLER_SIMD_SSE:
+		return true;
+	case RESAMPLER_SIMD_AVX2:
+		return (cpu & CPU_AVX2) && (cpu & CPU_FMA3);
+	case RESAMPLER_SIMD_AVX512:
+		return (cpu & CPU_AVX512F) != 0;
+	}
+	return false;
+}
+
+const char *resampler_sinc_simd_name(enum resampler_simd simd)
+{
+	switch (simd)
+	{
+	case RESAMPLER_SIMD_AUTO:   return "auto";
+	case RESAMPLER_SIMD_C:      return "c";
+	case RESAMPLER_SIMD_SSE:    return "sse";
+	case RESAMPLER_SIMD_AVX2:   return "avx2";
+	case RESAMPLER_SIMD_AVX512: return "avx512";
+	}
+	return "?";
+}
+
+static const float *sinc_get_table(enum resampler_quality quality,
+	double bandwidth_mod, double cutoff, unsigned filter_taps, unsigned taps)
 {
+	const struct sinc_quality *q = &sinc_qualities[quality];
+	size_t elems = ((size_t)(1 << q->phase_bits) * taps) * TAPS_MULT;
+	sinc_table_t *t;
+
+	for (t = sinc_tables; t; t = t->next)
+		if (t->quality == quality && t->bandwidth_mod == bandwidth_mod && t->taps == taps)
+			return t->phase_table;
+
+	t = (sinc_table_t*)calloc(1, sizeof(*t));
+	if (!t)
+		return NULL;
+	t->phase_table = (float*)memalign_alloc(128, sizeof(float) * elems);
+	if (!t->phase_table)
+	{
+		free(t);
+		return NULL;
+	}
+	/* zero padding taps */
+	memset(t->phase_table, 0, sizeof(float) * elems);
+	sinc_init_table(q, cutoff, t->phase_table,
+		1 << q->phase_bits, filter_taps, taps, true);
+
+	t->quality = quality;
+	t->bandwidth_mod = bandwidth_mod;
+	t->taps = taps;
+	t->next = sinc_tables;
+	sinc_tables = t;
+	return t->phase_table;
+}
+
+void *resampler_sinc_init(double bandwidth_mod)
+{
+	return resampler_sinc_init_simd(bandwidth_mod, RESAMPLER_QUALITY_NORMAL, RESAMPLER_SIMD_AUTO);
+}
+
+void *resampler_sinc_init_simd(double bandwidth_mod, enum resampler_quality quality,
+	enum resampler_simd simd)
+{
+	const struct sinc_quality *q;
 	double cutoff;
-	size_t phase_elems, elems;
-	rarch_sinc_resampler_t *re = (rarch_sinc_resampler_t*)
-		calloc(1, sizeof(*re));
+	size_t elems;
+	unsigned filter_taps, width;
+	rarch_sinc_resampler_t *re;
 
+	if (!resampler_sinc_simd_supported(simd) || (unsigned)quality > RESAMPLER_QUALITY_HIGHEST)
+		return NULL;
+	q = &sinc_qualities[quality];
+
+	re = (rarch_sinc_resampler_t*)calloc(1, sizeof(*re));
 	if (!re)
 		return NULL;
 
-	re->taps = TAPS;
-	cutoff = CUTOFF;
+	filter_taps = q->sidelobes * 2;
+	cutoff = q->cutoff;
 
 	/* Downsampling, must lower cutoff, and extend number of
 	* taps accordingly to keep same stopband attenuation. */
 	if (bandwidth_mod < 1.0)
 	{
 		cutoff *= bandwidth_mod;
-		re->taps = (unsigned)ceil(re->taps / bandwidth_mod);
+		filter_taps = (unsigned)ceil(filter_taps / bandwidth_mod);
 	}
+	else bandwidth_mod = 1.0;
+
+	filter_taps = (filter_taps + 3) & ~3;
+
+	/* The filters are 16-64 taps, too short for the wider kernels to
+	 * pull ahead: per output frame the reduction and the call cost as
+	 * much as the taps, and AVX-512 loses outright at 16. SSE stays the
+	 * default and AVX2/AVX-512 are only used when asked for. */
+	if (simd == RESAMPLER_SIMD_AUTO)
+		simd = RESAMPLER_SIMD_SSE;
+	re->engine = RESAMPLER_SINC;
+	re->quality = quality;
+	re->simd = simd;
+	switch (simd)
+	{
+	case RESAMPLER_SIMD_C:      re->kernel = sinc_kernel_c;      width = 4;  break;
+	case RESAMPLER_SIMD_AVX2:   re->kernel = sinc_kernel_avx2;   width = 8;  break;
+	case RESAMPLER_SIMD_AVX512: re->kernel = sinc_kernel_avx512; width = 16; break;
+	default:                    re->kernel = sinc_kernel_sse;    width = 4;  break;
+	}
+	re->taps = (filter_taps + width - 1) & ~(width - 1);
+	re->subphase_bits = q->subphase_bits;
+	re->subphase_mask = (1u << q->subphase_bits) - 1;
+	re->subphase_mod = 1.0f / (1 << q->subphase_bits);
+	re->phases = 1u << (q->phase_bits + q->subphase_bits);
+
+	re->phase_table = sinc_get_table(quality, bandwidth_mod, cutoff, filter_taps, re->taps);
+	if (!re->phase_table)
+		goto error;
 
-	re->taps = (re->taps + 3) & ~3;
-
-	phase_elems = ((1 << PHASE_BITS) * re->taps) * TAPS_MULT;
-	elems = phase_elems + 4 * re->taps;
-
+	elems = 4 * re->taps;
 	re->main_buffer = (float*)memalign_alloc(128, sizeof(float) * elems);
 	if (!re->main_buffer)
 		goto error;
-
-	re->phase_table = re->main_buffer;
-	re->buffer_l = re->main_buffer + phase_elems;
+	/* a silent history */
+	memset(re->main_buffer, 0, sizeof(float) * elems);
+	re->buffer_l = re->main_buffer;
 	re->buffer_r = re->buffer_l + 2 * re->taps;
-
-	sinc_init_table(re, cutoff, re->phase_table,
-		1 << PHASE_BITS, re->taps, SINC_COEFF_LERP);
 	return re;
 
 error:
 	resampler_sinc_free(re);
 	return NULL;
-}
\ No newline at end of file
+}
+
+enum resampler_simd resampler_sinc_get_simd(void *re_)
+{
+	return ((rarch_sinc_resampler_t*)re_)->simd;
+}
+
+unsigned resampler_sinc_get_taps(void *re_)
+{
+	return ((rarch_sinc_resampler_t*)re_)->taps;
+}
+
+/* Nearest, linear and cubic share one loop: it keeps the last four input
+ * frames and interpolates between the middle two, so output trails input
+ * by two frames. Cheap enough for machines the sinc filter is too heavy for. */
+typedef struct poly_resampler
+{
+	enum resampler_engine engine; /* must stay first, see resampler_process */
+	float hist[4][2];
+	double pos;
+} poly_resampler_t;
+
+static void *poly_init(enum resampler_engine engine)
+{
+	poly_resampler_t *re = (poly_resampler_t*)calloc(1, sizeof(*re));
+	if (!re)
+		return NULL;
+	re->engine = engine;
+	return re;
+}
+
+/* Catmull-Rom through h1..h2 */
+static __forceinline float poly_cubic(float h0, float h1, float h2, float h3, float t)
+{
+	float a = -0.5f * h0 + 1.5f * h1 - 1.5f * h2 + 0.5f * h3;
+	float b = h0 - 2.5f * h1 + 2.0f * h2 - 0.5f * h3;
+	float c = -0.5f * h0 + 0.5f * h2;
+	return ((a * t + b) * t + c) * t + h1;
+}
+
+static void poly_process(poly_resampler_t *re, struct resampler_data *data)
+{
+	const float *input = data->data_in;
+	float *output = data->data_out;
+	double step = 1.0 / data->ratio;
+	double pos = re->pos;
+	size_t i, out_frames = 0;
+
+	for (i = 0; i < data->input_frames; i++, input += 2)
+	{
+		memmove(re->hist[0], re->hist[1], sizeof(re->hist[0]) * 3);
+		re->hist[3][0] = input[0];
+		re->hist[3][1] = input[1];
+
+		while (pos < 1.0)
+		{
+			float t = (float)pos;
+			unsigned c;
+			for (c = 0; c < 2; c++)
+			{
+				switch (re->engine)
+				{
+				case RESAMPLER_NEAREST:
+					output[c] = re->hist[t < 0.5f ? 1 : 2][c];
+					break;
+				case RESAMPLER_LINEAR:
+					output[c] = re->hist[1][c] + (re->hist[2][c] - re->hist[1][c]) * t;
+					break;
+				default:
+					output[c] = poly_cubic(re->hist[0][c], re->hist[1][c],
+						re->hist[2][c], re->hist[3][c], t);
+					break;
+				}
+			}
+			output += 2;
+			out_frames++;
+			pos += step;
+		}
+		pos -= 1.0;
+	}
+
+	re->pos = pos;
+	data->output_frames = out_frames;
+}
+
+void *resampler_init(enum resampler_engine engine, enum resampler_quality quality,
+	double bandwidth_mod)
+{
+	switch (engine)
+	{
+	case RESAMPLER_NEAREST:
+	case RESAMPLER_LINEAR:
+	case RESAMPLER_CUBIC:
+		return poly_init(engine);
+	case RESAMPLER_SINC:
+		return resampler_sinc_init_simd(bandwidth_mod, quality, RESAMPLER_SIMD_AUTO);
+	}
+	return NULL;
+}
+
+void resampler_process(void *re, struct resampler_data *data)
+{
+	/* every engine's state starts with its engine id */
+	if (*(enum resampler_engine*)re == RESAMPLER_SINC)
+		resampler_sinc_process(re, data);
+	else
+		poly_process((poly_resampler_t*)re, data);
+}
+
+void resampler_free(void *re)
+{
+	if (re && *(enum resampler_engine*)re == RESAMPLER_SINC)
+		resampler_sinc_free(re);
+	else
+		free(re);
+}
+
+const char *resampler_engine_name(enum resampler_engine engine)
+{
+	switch (engine)
+	{
+	case RESAMPLER_NEAREST: return "nearest";
+	case RESAMPLER_LINEAR:  return "linear";
+	case RESAMPLER_CUBIC:   return "cubic";
+	case RESAMPLER_SINC:    return "sinc";
+	}
+	return "?";
+}
+
+const char *resampler_quality_name(enum resampler_quality quality)
+{
+	switch (quality)
+	{
+	case RESAMPLER_QUALITY_LOWEST:  return "lowest";
+	case RESAMPLER_QUALITY_LOWER:   return "lower";
+	case RESAMPLER_QUALITY_NORMAL:  return "normal";
+	case RESAMPLER_QUALITY_HIGHER:  return "higher";
+	case RESAMPLER_QUALITY_HIGHEST: return "highest";
+	}
+	return "?";
+}
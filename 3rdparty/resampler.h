@@ -49,7 +49,51 @@ struct resampler_data
       double ratio;
    };
 
+enum resampler_simd
+   {
+      RESAMPLER_SIMD_AUTO = 0, /* SSE; the wider kernels are opt-in */
+      RESAMPLER_SIMD_C,        /* scalar reference */
+      RESAMPLER_SIMD_SSE,
+      RESAMPLER_SIMD_AVX2,     /* AVX2 + FMA3 */
+      RESAMPLER_SIMD_AVX512
+   };
+
+enum resampler_engine
+   {
+      RESAMPLER_NEAREST = 0,
+      RESAMPLER_LINEAR,
+      RESAMPLER_CUBIC,
+      RESAMPLER_SINC
+   };
+
+/* sinc presets, from a 4 tap Lanczos up to a 256 tap Kaiser */
+enum resampler_quality
+   {
+      RESAMPLER_QUALITY_LOWEST = 0,
+      RESAMPLER_QUALITY_LOWER,
+      RESAMPLER_QUALITY_NORMAL,
+      RESAMPLER_QUALITY_HIGHER,
+      RESAMPLER_QUALITY_HIGHEST
+   };
+
+/* Any engine. quality and bandwidth_mod only matter for sinc, whose phase
+ * tables are cached per (quality, bandwidth) for the life of the process;
+ * create resamplers from one thread at a time. */
+void *resampler_init(enum resampler_engine engine, enum resampler_quality quality,
+   double bandwidth_mod);
+void resampler_process(void *re, struct resampler_data *data);
+void resampler_free(void *re);
+const char *resampler_engine_name(enum resampler_engine engine);
+const char *resampler_quality_name(enum resampler_quality quality);
+
 void *resampler_sinc_init(double bandwidth_mod);
+/* NULL if the CPU can't run the requested kernel */
+void *resampler_sinc_init_simd(double bandwidth_mod, enum resampler_quality quality,
+   enum resampler_simd simd);
+bool resampler_sinc_simd_supported(enum resampler_simd simd);
+const char *resampler_sinc_simd_name(enum resampler_simd simd);
+enum resampler_simd resampler_sinc_get_simd(void *re_);
+unsigned resampler_sinc_get_taps(void *re_);
 void resampler_sinc_process(void *re_, struct resampler_data *data);
 void resampler_sinc_free(void *re_);
 
@@ -1,24 +1,21 @@
-#include "stdafx.h"
-#include <windows.h>
+#include "io/platform.h"
 #include "CLibretro.h"
 #include "3rdparty/libretro.h"
 #include "io/gl_render.h"
-#include "gui/utf8conv.h"
 #define INI_IMPLEMENTATION
 #define INI_STRNICMP( s1, s2, cnt ) (strcmp( s1, s2) )
 #include "3rdparty/ini.h"
 #include <algorithm>
 #include <numeric>  
 #include <sys/stat.h>
-#include <Shlwapi.h>
-#include <dwmapi.h>
+#include <stdarg.h>
+#include <errno.h>
 
 #define INLINE 
 using namespace std;
-using namespace utf8util;
 
 static struct {
-    HMODULE handle;
+    plat_dylib handle;
     bool initialized;
     void(*retro_init)(void);
     void(*retro_deinit)(void);
@@ -44,7 +41,7 @@ static void core_unload() {
         g_retro.retro_deinit();
     if (g_retro.handle)
     {
-        FreeLibrary(g_retro.handle);
+        plat_dylib_close(g_retro.handle);
         g_retro.handle = NULL;
     }
 }
@@ -63,10 +60,6 @@ static void core_log(enum retro_log_level level, const char *fmt, ...) {
     fprintf(stdout, "%s", buffer2);
 }
 
-uintptr_t core_get_current_framebuffer() {
-    return g_video.fbo_id;
-}
-
 void init_coresettings(retro_variable *var) {
     CLibretro * retro = CLibretro::GetSingleton();
     FILE *fp = NULL;
@@ -91,7 +84,7 @@ void init_coresettings(retro_variable *var) {
         var++;
     }
 
-    fp = _wfopen(retro->corevar_path, L"r");
+    fp = _tfopen(retro->corevar_path, _T("r"));
     if (!fp)
     {
     create_filez:
@@ -107,7 +100,7 @@ void init_coresettings(retro_variable *var) {
         char* data = (char*)malloc(size);
         size = ini_save(ini, data, size); // Actually save the file
         ini_destroy(ini);
-        fp = _wfopen(retro->corevar_path, L"w");
+        fp = _tfopen(retro->corevar_path, _T("w"));
         fwrite(data, 1, size, fp);
         fclose(fp);
         free(data);
@@ -152,7 +145,7 @@ void init_coresettings(retro_variable *var) {
             int size = ini_save(ini, NULL, 0); // Find the size needed
             char* data = (char*)malloc(size);
             size = ini_save(ini, data, size); // Actually save the file
-            fp = _wfopen(retro->corevar_path, L"w");
+            fp = _tfopen(retro->corevar_path, _T("w"));
             fwrite(data, 1, size, fp);
             fclose(fp);
             free(data);
@@ -197,7 +190,7 @@ bool core_environment(unsigned cmd, void *data) {
         static char *sys_path = NULL;
         if (!sys_path)
         {
-            string ansi = utf8_from_utf16(retro->sys_filename);
+            string ansi = plat_to_utf8(retro->sys_filename);
             sys_path = strdup(ansi.c_str());
         }
         char **ppDir = (char**)data;
@@ -208,9 +201,14 @@ bool core_environment(unsigned cmd, void *data) {
 
     case RETRO_ENVIRONMENT_SET_INPUT_DESCRIPTORS: // 31
     {
+        if (!input_device)
+            return false;
+        // the sampler thread reads the binds that are rebuilt here
+        unsigned resume_hz = input_device->sampler ? input_device->sample_hz : 0;
+        input_device->stop_sampling();
         char variable_val2[50] = { 0 };
         Std_File_Reader_u out;
-        lstrcpy(input_device->path, retro->inputcfg_path);
+        _tcscpy(input_device->path, retro->inputcfg_path);
         if (!out.open(retro->inputcfg_path))
         {
             const char *err = input_device->load(out);
@@ -241,7 +239,8 @@ bool core_environment(unsigned cmd, void *data) {
                 keyboard.type = dinput::di_event::ev_none;
                 keyboard.key.type = dinput::di_event::key_none;
                 keyboard.key.which = NULL;
-                CString str = var->description;
+                TCHAR description[64];
+                plat_from_utf8(var->description ? var->description : "", description, 64);
                 int id = var->id;
                 int index = var->index;
                 if (var->device == RETRO_DEVICE_ANALOG || (var->device == RETRO_DEVICE_JOYPAD))
@@ -250,7 +249,7 @@ bool core_environment(unsigned cmd, void *data) {
                     id = (index == RETRO_DEVICE_INDEX_ANALOG_LEFT) ? (var->id == RETRO_DEVICE_ID_ANALOG_X ? 16 : 17) :
                     (var->id == RETRO_DEVICE_ID_ANALOG_X ? 18 : 19);
 
-                input_device->bl->add(keyboard, i, str.GetBuffer(NULL), id);
+                input_device->bl->add(keyboard, i, description, id);
                 }
                 i++; ++var;
             }
@@ -261,6 +260,8 @@ bool core_environment(unsigned cmd, void *data) {
                 out2.close();
             }
         }
+        if (resume_hz)
+            input_device->start_sampling(resume_hz);
         return true;
     }
     break;
@@ -311,11 +312,11 @@ bool core_environment(unsigned cmd, void *data) {
     case RETRO_ENVIRONMENT_SET_HW_RENDER: {
         struct retro_hw_render_callback *hw = (struct retro_hw_render_callback*)data;
         if (hw->context_type == RETRO_HW_CONTEXT_VULKAN)return false;
-        hw->get_current_framebuffer = core_get_current_framebuffer;
-        hw->get_proc_address = (retro_hw_get_proc_address_t)get_proc;
-        g_video.hw = *hw;
-        return true;
+        if (retro->headless)return false;
+        return video_set_hw_render(hw);
     }
+    case RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER:
+        return video_get_software_framebuffer((struct retro_framebuffer*)data);
     default:
         core_log(RETRO_LOG_DEBUG, "Unhandled env #%u", cmd);
         return false;
@@ -324,23 +325,61 @@ bool core_environment(unsigned cmd, void *data) {
 }
 
 static void core_video_refresh(const void *data, unsigned width, unsigned height, size_t pitch) {
+    CLibretro* lib = CLibretro::GetSingleton();
+    if (lib->suppress_video)return;
+    long long start = microseconds_now();
     video_refresh(data, width, height, pitch);
+    lib->timing.callback_us += microseconds_now() - start;
 }
 
 static void core_input_poll(void) {
+    CLibretro* lib = CLibretro::GetSingleton();
+    long long start = microseconds_now();
+    lib->timing.poll_at_us = start;
     input *input_device = input::GetSingleton();
+    // a fresh poll would hand the hidden frames newer input, and eat any
+    // press and release they span before the real timeline saw it
+    if (lib->suppress_poll)return;
+    // a movie's frame answers every query in it the same way, run-ahead's
+    // hidden frames included; recording takes it from the first poll
+    if (lib->movie_file && (!lib->movie_file->recording || lib->movie_polled))return;
+    if (!input_device)return;
+    long long event_us = input_device->polled.event_us;
     input_device->poll();
+    if (input_device->sampler)
+    {
+        lib->timing.input_age_us = start - input_device->polled.sampled_us;
+        lib->timing.input_event_age_us = input_device->polled.event_us != event_us ?
+            start - input_device->polled.event_us : 0;
+    }
+    if (lib->movie_file)
+    {
+        movie_input_set(&lib->movie_now, &input_device->table, &input_device->mouse);
+        lib->movie_polled = true;
+    }
+    lib->timing.callback_us += microseconds_now() - start;
 }
 
 static int16_t core_input_state(unsigned port, unsigned device, unsigned index, unsigned id) {
     if (port != 0)return 0;
+    CLibretro* lib = CLibretro::GetSingleton();
+    const movie_input *now = lib->movie_file ? &lib->movie_now : NULL;
     input *input_device = input::GetSingleton();
+    if (!input_device && !now)return 0;
 
     if (device == RETRO_DEVICE_MOUSE)
     {
         int16_t x = 0, y = 0;
         bool left = false, right = false;
-        input_device->readmouse(x, y, left, right);
+        if (now)
+        {
+            x = now->mouse_x;
+            y = now->mouse_y;
+            left = (now->mouse_buttons & 1) != 0;
+            right = (now->mouse_buttons & 2) != 0;
+        }
+        else
+            input_device->readmouse(x, y, left, right);
         switch (id)
         {
         case RETRO_DEVICE_ID_MOUSE_X:
@@ -355,84 +394,120 @@ static int16_t core_input_state(unsigned port, unsigned device, unsigned index,
         return 0;
     }
 
-    if (device == RETRO_DEVICE_ANALOG || device == RETRO_DEVICE_JOYPAD) {
-        if (input_device != NULL && input_device->bl != NULL) {
-            for (unsigned int i = 0; i < input_device->bl->get_count(); i++) {
-                int retro_id = 0;
-                int16_t value = 0;
-                bool isanalog = false;
-                input_device->getbutton(i, value, retro_id, isanalog);
-                if (device == RETRO_DEVICE_ANALOG)
-                {
-                    if (value <= -0x8000)value = -0x7fff;
-                    if (index == RETRO_DEVICE_INDEX_ANALOG_LEFT)
-                    {
-                        if ((id == RETRO_DEVICE_ID_ANALOG_X && retro_id == 16) || (id == RETRO_DEVICE_ID_ANALOG_Y && retro_id == 17))
-                        {
-                            return isanalog ? -value : value;
-                        }
-                    }
-                    else
-                    {
-                        if ((id == RETRO_DEVICE_ID_ANALOG_X && retro_id == 18) || (id == RETRO_DEVICE_ID_ANALOG_Y && retro_id == 19))
-                        {
-                            return isanalog ? -value : value;
-                        }
-                    }
-                }
-                else
-                {
-                    value = abs(value);
-                    if (retro_id == id)return value;
-                }
-            }
-        }
-    }
-
-
-    return 0;
+    // built from the binds when the core polled
+    int slot = input_slot(device, index, id);
+    return slot < 0 ? 0 : now ? now->table.slot[slot] : input_device->table.slot[slot];
 }
 
 void CLibretro::core_audio_sample(int16_t left, int16_t right) {
-    int16_t buf[2] = { left, right };
-    _audio.mix(buf, 1);
+    if (!audio_enabled || suppress_audio)return;
+    _audio.push_sample(left, right);
 }
 
 size_t CLibretro::core_audio_sample_batch(const int16_t *data, size_t frames) {
-    _audio.mix(data, frames);
+    if (!audio_enabled || suppress_audio)return frames;
+    // the pull worker drives audio callback cores; its time isn't the
+    // frame's, and timing belongs to the emulation thread
+    if (_audio.pull_thread && sthread_isself(_audio.pull_thread))
+    {
+        _audio.push(data, frames);
+        return frames;
+    }
+    long long start = microseconds_now();
+    _audio.push(data, frames);
+    timing.callback_us += microseconds_now() - start;
     return frames;
 }
 
 bool CLibretro::savestate(TCHAR* filename, bool save) {
-    if (isEmulating)
+    if (!isEmulating || !states)
+        return false;
+    if (threaded)
     {
-        size_t size = g_retro.retro_serialize_size();
-        if (size)
+        // Loads go through the emulation thread too, which queues a
+        // pending save ahead of a pending load, so a load never reads a
+        // file before a save asked for first has written it. A save behind
+        // a pending load would overtake it, so it waits for the next frame;
+        // the emulation thread may also still be reading the last path.
+        if (save)
         {
-            FILE *Input = _wfopen(filename, save ? L"wb" : L"rb");
-            BYTE *Memory = (BYTE *)malloc(size);
-            if (!Input)return false;
-            if (save)
-            {
-                // Get the filesize
-                g_retro.retro_serialize(Memory, size);
-                if (Memory)fwrite(Memory, 1, size, Input);
-            }
-            else
-            {
-                fseek(Input, 0, SEEK_END);
-                int Size = ftell(Input);
-                rewind(Input);
-                fread(Memory, 1, Size, Input);
-                g_retro.retro_unserialize(Memory, size);
-            }
-            free(Memory);
-            fclose(Input);
-            Input = NULL;
-            return true;
+            if (save_requested.load(std::memory_order_acquire) || load_requested.load(std::memory_order_acquire))
+                return false;
+            _tcscpy(save_path, filename);
+            save_requested.store(true, std::memory_order_release);
         }
+        else
+        {
+            if (load_requested.load(std::memory_order_acquire))
+                return false;
+            _tcscpy(load_path, filename);
+            load_requested.store(true, std::memory_order_release);
+        }
+        return true;
     }
-    return false;
+    if (!save)
+    {
+        // read ahead on the worker; applied at the start of a frame
+        state_io_load(states, filename);
+        return true;
+    }
+    return snapshot_state(filename);
+}
+
+// The part of a save that has to happen on the emulation thread: the
+// core serializes into a pooled buffer and the worker takes it from there.
+bool CLibretro::snapshot_state(const TCHAR *filename)
+{
+    long long start = microseconds_now();
+    size_t size = g_retro.retro_serialize_size();
+    if (!size)
+        return false;
+    state_job *job = state_io_job(states);
+    job->data.resize(size);
+    if (!g_retro.retro_serialize(&job->data[0], size))
+    {
+        state_io_release(states, job);
+        return false;
+    }
+    state_io_save(states, job, filename);
+    long long stall = microseconds_now() - start;
+    timing.state_stall_us += stall;
+    core_log(RETRO_LOG_INFO, "Savestate snapshot held emulation %.3f ms\n", stall / 1000.0);
+    return true;
+}
+
+void CLibretro::service_states()
+{
+    if (save_requested.load(std::memory_order_acquire))
+    {
+        snapshot_state(save_path);
+        save_requested.store(false, std::memory_order_release);
+    }
+    if (load_requested.load(std::memory_order_acquire))
+    {
+        state_io_load(states, load_path);
+        load_requested.store(false, std::memory_order_release);
+    }
+    state_job *job = state_io_take(states);
+    if (!job)
+        return;
+    long long start = microseconds_now();
+    size_t size = g_retro.retro_serialize_size();
+    // a short file is padded out rather than read past
+    if (job->data.size() < size)
+        job->data.resize(size, 0);
+    if (!size || !g_retro.retro_unserialize(&job->data[0], size))
+        core_log(RETRO_LOG_WARN, "Core rejected the savestate\n");
+    rewind_clear(&rewind_history);
+    if (movie_file)
+    {
+        core_log(RETRO_LOG_INFO, "Savestate load ends the movie\n");
+        stop_movie();
+    }
+    state_io_release(states, job);
+    long long stall = microseconds_now() - start;
+    timing.state_stall_us += stall;
+    core_log(RETRO_LOG_INFO, "Savestate load held emulation %.3f ms\n", stall / 1000.0);
 }
 
 bool CLibretro::savesram(TCHAR* filename, bool save) {
@@ -441,9 +516,9 @@ bool CLibretro::savesram(TCHAR* filename, bool save) {
         size_t size = g_retro.retro_get_memory_size(RETRO_MEMORY_SAVE_RAM);
         if (size)
         {
-            FILE *Input = _wfopen(filename, save ? L"wb" : L"rb");
+            FILE *Input = _tfopen(filename, save ? _T("wb") : _T("rb"));
             if (!Input) return(NULL);
-            BYTE *Memory = (BYTE *)g_retro.retro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
+            uint8_t *Memory = (uint8_t *)g_retro.retro_get_memory_data(RETRO_MEMORY_SAVE_RAM);
             save ? fwrite(Memory, 1, size, Input) : fread(Memory, 1, size, Input);
             fclose(Input);
             Input = NULL;
@@ -454,7 +529,16 @@ bool CLibretro::savesram(TCHAR* filename, bool save) {
 }
 
 void CLibretro::reset() {
-    if (isEmulating)g_retro.retro_reset();
+    if (isEmulating)
+    {
+        g_retro.retro_reset();
+        rewind_clear(&rewind_history);
+        if (movie_file)
+        {
+            core_log(RETRO_LOG_INFO, "Reset ends the movie\n");
+            stop_movie();
+        }
+    }
 }
 
 static void core_audio_sample(int16_t left, int16_t right) {
@@ -477,13 +561,13 @@ static size_t core_audio_sample_batch(const int16_t *data, size_t frames) {
 bool CLibretro::core_load(TCHAR *sofile, bool gamespecificoptions, TCHAR* game_filename) {
     TCHAR filez[MAX_PATH] = { 0 };
     TCHAR core_handlepath[MAX_PATH] = { 0 };
-    if (g_retro.handle)FreeLibrary(g_retro.handle);
+    if (g_retro.handle)plat_dylib_close(g_retro.handle);
 
     memset(&g_retro, 0, sizeof(g_retro));
-    g_retro.handle = LoadLibrary(sofile);
+    g_retro.handle = plat_dylib_open(sofile);
     if (!g_retro.handle)return false;
-#define die() do { FreeLibrary(g_retro.handle); return false; } while(0)
-#define libload(name) GetProcAddress(g_retro.handle, name)
+#define die() do { plat_dylib_close(g_retro.handle); g_retro.handle = NULL; return false; } while(0)
+#define libload(name) plat_dylib_sym(g_retro.handle, name)
 #define load(name) if (!(*(void**)(&g_retro.#name)=(void*)libload(#name))) die()
 #define load_sym(V,name) if (!(*(void**)(&V)=(void*)libload(#name))) die()
 #define load_retro_sym(S) load_sym(g_retro.S, S)
@@ -515,35 +599,41 @@ bool CLibretro::core_load(TCHAR *sofile, bool gamespecificoptions, TCHAR* game_f
     load_sym(set_input_state, retro_set_input_state);
     load_sym(set_audio_sample, retro_set_audio_sample);
     load_sym(set_audio_sample_batch, retro_set_audio_sample_batch);
-
-    lstrcpy(filez, game_filename);
-    PathStripPath(filez);
-    PathRemoveExtension(filez);
-    GetModuleFileNameW(g_retro.handle, core_handlepath, sizeof(core_handlepath));
-    PathRemoveExtension(core_handlepath);
-    GetCurrentDirectory(MAX_PATH, sys_filename);
-    PathAppend(sys_filename, L"system");
-    lstrcpy(sav_filename, sys_filename);
-    PathAppend(sav_filename, filez);
-    lstrcat(sav_filename, L".sav");
-    lstrcpy(inputcfg_path, L"");
-    lstrcpy(corevar_path, L"");
+#undef load_retro_sym
+#undef load_sym
+#undef load
+#undef libload
+#undef die
+
+    _tcscpy(filez, game_filename);
+    plat_path_strip(filez);
+    plat_path_remove_ext(filez);
+    if (!plat_dylib_path(g_retro.handle, core_handlepath, MAX_PATH))
+        _tcscpy(core_handlepath, sofile);
+    plat_path_remove_ext(core_handlepath);
+    plat_getcwd(sys_filename, MAX_PATH);
+    plat_path_append(sys_filename, _T("system"));
+    _tcscpy(sav_filename, sys_filename);
+    plat_path_append(sav_filename, filez);
+    _tcscat(sav_filename, _T(".sav"));
+    _tcscpy(inputcfg_path, _T(""));
+    _tcscpy(corevar_path, _T(""));
 
     if (gamespecificoptions)
     {
-        lstrcpy(inputcfg_path, core_handlepath);
-        lstrcpy(corevar_path, core_handlepath);
-        PathAppend(inputcfg_path, filez);
-        PathAppend(corevar_path, filez);
-        lstrcat(inputcfg_path, L"_input.cfg");
-        lstrcat(corevar_path, L".ini");
+        _tcscpy(inputcfg_path, core_handlepath);
+        _tcscpy(corevar_path, core_handlepath);
+        plat_path_append(inputcfg_path, filez);
+        plat_path_append(corevar_path, filez);
+        _tcscat(inputcfg_path, _T("_input.cfg"));
+        _tcscat(corevar_path, _T(".ini"));
     }
     else
     {
-        lstrcat(inputcfg_path, core_handlepath);
-        lstrcat(corevar_path, core_handlepath);
-        lstrcat(inputcfg_path, L"_input.cfg");
-        lstrcat(corevar_path, L".ini");
+        _tcscat(inputcfg_path, core_handlepath);
+        _tcscat(corevar_path, core_handlepath);
+        _tcscat(inputcfg_path, _T("_input.cfg"));
+        _tcscat(corevar_path, _T(".ini"));
     }
     //set libretro func pointers
     set_environment(core_environment);
@@ -561,7 +651,7 @@ static void noop() {
 }
 
 CLibretro* CLibretro::m_Instance = 0;
-CLibretro* CLibretro::CreateInstance(HWND hwnd) {
+CLibretro* CLibretro::CreateInstance(void *hwnd) {
     if (0 == m_Instance)
     {
         m_Instance = new CLibretro();
@@ -581,41 +671,97 @@ bool CLibretro::running() {
 
 CLibretro::CLibretro() {
     threaded = false;
+    headless = false;
+    headless_audio = false;
+    convert_pixels = false;
+    threaded_present = false;
+    disable_pbo = false;
+    disable_elision = false;
+    frame_delay = 0;
+    runahead_frames = 0;
+    runahead_failed = false;
+    suppress_video = false;
+    suppress_audio = false;
+    suppress_poll = false;
+    rewind_budget = 0;
+    rewind_interval = 1;
+    rewinding = false;
+    rewind_failed = false;
+    rewind_countdown = 0;
+    memset(&rewind_history, 0, sizeof(rewind_history));
+    states = NULL;
+    save_requested = false;
+    load_requested = false;
+    movie_file = NULL;
+    movie_frame = 0;
+    memset(&movie_now, 0, sizeof(movie_now));
+    movie_polled = false;
+    movie_next_key = 0;
+    movie_checked = movie_desyncs = 0;
+    pace_setting = PACE_AUTO;
+    pacing = PACE_AUTO;
+    paused = false;
+    audio_enabled = false;
     isEmulating = false;
+    thread_handle = NULL;
+    emulator_hwnd = NULL;
+    timing = { 0 };
 }
 
-static DWORD WINAPI libretro_thread(void* Param) {
+static void libretro_thread(void* Param) {
     CLibretro* This = (CLibretro*)Param;
-    return This->ThreadStart();
+    This->ThreadStart();
 }
 
-DWORD CLibretro::ThreadStart(void) {
-    init_common();
+void CLibretro::ThreadStart(void) {
+    if (!init_common())
+        return;
     // Do stuff
     while (isEmulating)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClearColor(0, 0, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        g_retro.retro_run();
+        if (paused)
+        {
+            plat_sleep_us(10000);
+            continue;
+        }
+        if (pacing == PACE_TIMER)
+            timing.pace_late_us = pacer_wait(&pacer);
+        frame_delay_wait();
+        video_begin_frame();
+        timing.callback_us = 0;
+        long long start = microseconds_now();
+        core_run();
+        timing.run_us = microseconds_now() - start;
+        frame_delay_update();
+        if (audio_enabled)_audio.flush();
         double currentTime = double(milliseconds_now() / 1000);
         nbFrames++;
         if (currentTime - lastTime >= 0.5) { // If last prinf() was more than 1 sec ago
                            // printf and reset timer
+#ifdef _WIN32
             TCHAR buffer[100] = { 0 };
             int len = swprintf(buffer, 100, L"einweggert: %2f ms/frame\n, %d FPS", 1000.0 / double(nbFrames), nbFrames);
-            SetWindowText(emulator_hwnd, buffer);
+            if (runahead_frames && !runahead_failed && len > 0)
+                swprintf(buffer + len, 100 - len, L", run-ahead %.3f ms", (timing.runahead_save_us +
+                    timing.runahead_hidden_us + timing.runahead_load_us) / 1000.0);
+            if (emulator_hwnd)SetWindowText((HWND)emulator_hwnd, buffer);
+#endif
             nbFrames = 0;
             lastTime += 1.0;
         }
     }
-    _audio.destroy();
+    if (audio_enabled)_audio.destroy();
+    audio_enabled = false;
     video_deinit();
+    rewind_free(&rewind_history);
+    // saves still queued are written out first
+    state_io_free(states);
+    states = NULL;
+    stop_movie();
     g_retro.retro_unload_game();
     if (info.data)
         free((void*)info.data);
     g_retro.retro_deinit();
-    return 0;
 }
 
 CLibretro::~CLibretro(void) {
@@ -623,34 +769,32 @@ CLibretro::~CLibretro(void) {
     kill();
 }
 
-long GetFileSize(const TCHAR *fileName)
-{
-    BOOL                        fOk;
-    WIN32_FILE_ATTRIBUTE_DATA   fileInfo;
-    if (NULL == fileName)
-        return -1;
-    fOk = GetFileAttributesEx(fileName, GetFileExInfoStandard, (void*)&fileInfo);
-    if (!fOk)
-        return -1;
-    assert(0 == fileInfo.nFileSizeHigh);
-    return (long)fileInfo.nFileSizeLow;
-}
-
 bool CLibretro::init_common() {
-    double refreshr = 0;
-    DEVMODE lpDevMode;
     struct retro_system_info system = { 0 };
     retro_system_av_info av = { 0 };
     variables.clear();
-    memset(&lpDevMode, 0, sizeof(DEVMODE));
     variables_changed = false;
 
     g_video = { 0 };
+    g_present_stats.present_total_us.store(0);
+    g_present_stats.swap_total_us.store(0);
+    g_present_stats.present_latency_total_us.store(0);
+    g_present_stats.presented.store(0);
+    g_present_stats.present_done_us.store(0);
     g_video.hw.version_major = 4;
     g_video.hw.version_minor = 5;
     g_video.hw.context_type = RETRO_HW_CONTEXT_NONE;
     g_video.hw.context_reset = NULL;
     g_video.hw.context_destroy = NULL;
+    g_video.convert = convert_pixels;
+    g_video.threaded_present = threaded_present;
+    g_video.disable_pbo = disable_pbo;
+    g_video.disable_elision = disable_elision;
+    // vblank only holds the loop back in video (and audio) sync
+    g_video.disable_vsync = pace_setting == PACE_TIMER || pace_setting == PACE_FREE;
+    // libretro's default until the core asks for something else
+    video_set_pixel_format(RETRO_PIXEL_FORMAT_0RGB1555);
+    audio_callback = { 0 };
 
     if (!core_load(core_path, gamespec, rom_path))
     {
@@ -658,16 +802,16 @@ bool CLibretro::init_common() {
         return false;
     }
 
-    string ansi = utf8_from_utf16(rom_path);
+    string ansi = plat_to_utf8(rom_path);
     const char* rompath = ansi.c_str();
     info = { rompath, 0 };
     info.path = rompath;
     info.data = NULL;
-    info.size = GetFileSize(rom_path);
+    info.size = plat_file_size(rom_path);
     info.meta = "";
     g_retro.retro_get_system_info(&system);
     if (!system.need_fullpath) {
-        FILE *inputfile = _wfopen(rom_path, L"rb");
+        FILE *inputfile = _tfopen(rom_path, _T("rb"));
         if (!inputfile)
         {
         fail:
@@ -689,21 +833,42 @@ bool CLibretro::init_common() {
    // g_retro.retro_set_controller_port_device(0, RETRO_DEVICE_JOYPAD);
 
     ::video_configure(&av.geometry, emulator_hwnd);
-    if (EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &lpDevMode) == 0) {
-        refreshr = 60.0; // default value if cannot retrieve from user settings.
-    }
-    else refreshr = lpDevMode.dmDisplayFrequency;
-    _audio.init(refreshr, av);
-    threaded = false;
-    if (audio_callback.set_state) {
+    // with a device, cores that set an audio callback are driven by demand
+    // from the audio thread; otherwise once per frame as before
+    _audio.pull_callback = audio_callback.callback;
+    _audio.pull_set_state = audio_callback.set_state;
+    audio_enabled = (!headless || headless_audio) && _audio.init(plat_refresh_rate(), av);
+    if (!audio_enabled && audio_callback.set_state) {
         audio_callback.set_state(true);
     }
+    pacing = pace_setting;
+    if (pacing == PACE_AUTO)
+        pacing = audio_enabled ? PACE_AUDIO : headless ? PACE_FREE : PACE_VIDEO;
+    // the render thread takes the swap, so nothing would block on vblank
+    // here, and present_done_us is its clock, not ours
+    if (pacing == PACE_VIDEO && g_video.threaded_present && g_video.hw.context_type == RETRO_HW_CONTEXT_NONE)
+        pacing = PACE_TIMER;
+    _audio.nonblocking = pacing != PACE_AUDIO;
+    pacer_init(&pacer, av.timing.fps);
+    paused = false;
+    g_video.null_vsync = headless && pacing == PACE_VIDEO;
+    refresh_period_us = 1000000.0 / plat_refresh_rate();
+    frame_delay_us = frame_delay == FRAME_DELAY_AUTO ? 0 :
+        min((long long)frame_delay * 1000, (long long)refresh_period_us - 1000);
+    last_present_us = 0;
+    delay_count = 0;
+    timing.vblank_misses = 0;
+    runahead_failed = false;
+    rewind_free(&rewind_history);
+    rewind_failed = false;
+    save_requested = false;
+    load_requested = false;
+    states = state_io_new();
+    rewind_countdown = 0;
     lastTime = (double)milliseconds_now() / 1000;
     nbFrames = 0;
     isEmulating = true;
-    frame_limit_last_time = 0;
     runloop_frame_time_last = 0;
-    frame_limit_minimum_time = (retro_time_t)roundf(1000000.0f / av.timing.fps * 1.0f);
     return true;
 }
 
@@ -715,13 +880,13 @@ bool CLibretro::loadfile(TCHAR* filename, TCHAR* core_filename, bool gamespecifi
         isEmulating = false;
     }
     gamespec = gamespecificoptions;
-    lstrcpy(rom_path, filename);
-    lstrcpy(core_path, core_filename);
+    _tcscpy(rom_path, filename);
+    _tcscpy(core_path, core_filename);
     threaded = mthreaded;
     if (threaded)
     {
-        thread_handle = CreateThread(NULL, 0, &libretro_thread, (void*)this, 0, &thread_id);
-        return true;
+        thread_handle = sthread_create(libretro_thread, (void*)this);
+        return thread_handle != NULL;
     }
     else
     {
@@ -740,7 +905,7 @@ bool CLibretro::loadfile(TCHAR* filename, TCHAR* core_filename, bool gamespecifi
 void CLibretro::run()
 {
 
-    if (!threaded)
+    if (!threaded && !paused)
     {
         if (runloop_frame_time.callback) {
             retro_time_t current = milliseconds_now();
@@ -753,23 +918,43 @@ void CLibretro::run()
         }
         else runloop_frame_time_last = microseconds_now();
 
-        if (audio_callback.callback) {
+        if (audio_callback.callback && !audio_enabled) {
             audio_callback.callback();
         }
 
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glClearColor(0, 0, 0, 1);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
+        if (pacing == PACE_TIMER)
+            timing.pace_late_us = pacer_wait(&pacer);
+        frame_delay_wait();
+        video_begin_frame();
 
-        g_retro.retro_run();
+        timing.callback_us = 0;
+        long long start = microseconds_now();
+        core_run();
+        timing.run_us = microseconds_now() - start;
+        frame_delay_update();
+        if (audio_enabled)_audio.flush();
 
         double currentTime = (double)milliseconds_now() / 1000;
-        if (currentTime - lastTime >= 0.5) { // If last prinf() was more than 1 sec ago
+        if (emulator_hwnd && currentTime - lastTime >= 0.5) { // If last prinf() was more than 1 sec ago
                            // printf and reset timer
+#ifdef _WIN32
             TCHAR buffer[200] = { 0 };
-            int len = swprintf(buffer, 200, L"einweggert: %2f ms/frame\n, min %d VPS", 1000.0 / double(nbFrames), nbFrames);
-            SetWindowText(emulator_hwnd, buffer);
+            int len;
+            unsigned presented = g_present_stats.presented.load(std::memory_order_relaxed);
+            if (presented)
+                len = swprintf(buffer, 200, L"einweggert: %2f ms/frame\n, min %d VPS, handoff %.3f ms, present %.3f ms (swap %.3f), %u dropped",
+                    1000.0 / double(nbFrames), nbFrames, g_video.handoffs ? g_video.handoff_total_us / 1000.0 / g_video.handoffs : 0.0,
+                    g_present_stats.present_total_us.load(std::memory_order_relaxed) / 1000.0 / presented,
+                    g_present_stats.swap_total_us.load(std::memory_order_relaxed) / 1000.0 / presented,
+                    g_video.frames_dropped);
+            else
+                len = swprintf(buffer, 200, L"einweggert: %2f ms/frame\n, min %d VPS, upload %.3f ms", 1000.0 / double(nbFrames), nbFrames,
+                    g_video.uploads ? g_video.upload_total_us / 1000.0 / g_video.uploads : 0.0);
+            if (runahead_frames && !runahead_failed && len > 0)
+                swprintf(buffer + len, 200 - len, L", run-ahead %.3f ms", (timing.runahead_save_us +
+                    timing.runahead_hidden_us + timing.runahead_load_us) / 1000.0);
+            SetWindowText((HWND)emulator_hwnd, buffer);
+#endif
             nbFrames = 0;
             lastTime += 1.0;
         }
@@ -777,7 +962,351 @@ void CLibretro::run()
     }
 }
 
-bool CLibretro::init(HWND hwnd)
+void CLibretro::pause(bool pause)
+{
+    if (!isEmulating || paused == pause)
+        return;
+    paused = pause;
+    if (audio_enabled)
+    {
+        if (pause)
+            _audio.stop();
+        else
+            _audio.start();
+    }
+    if (!pause)
+    {
+        pacer_reset(&pacer);
+        last_present_us = 0;
+    }
+}
+
+// One frame of emulation as the user sees it: a step back while rewinding,
+// otherwise a frame, run ahead if asked, then a capture for rewind.
+void CLibretro::core_run()
+{
+    timing.rewind_capture_us = 0;
+    timing.rewind_step_us = 0;
+    timing.state_stall_us = 0;
+    if (states)
+        service_states();
+    if (movie_file)
+        movie_begin_frame();
+    // a movie only goes forwards
+    if (rewinding && rewind_budget && !rewind_failed && !movie_file)
+    {
+        rewind_step();
+        return;
+    }
+    if (runahead_frames && !runahead_failed)
+        run_ahead();
+    else
+        g_retro.retro_run();
+    if (movie_file)
+        movie_end_frame();
+    if (rewind_budget && !rewind_failed && (!rewind_countdown || !--rewind_countdown))
+        rewind_capture();
+}
+
+// Rewind keeps a capture every rewind_interval frames as a delta from the
+// one before (see io/rewind.h); the history is sized the first time the
+// core serializes and again if its state grows.
+void CLibretro::rewind_capture()
+{
+    long long start = microseconds_now();
+    rewind_countdown = max(rewind_interval, 1u);
+    size_t size = g_retro.retro_serialize_size();
+    if (rewind_state.size() < size)
+        rewind_state.resize(size);
+    if (rewind_history.state_size != size)
+    {
+        rewind_free(&rewind_history);
+        if (!size || !rewind_init(&rewind_history, size, rewind_budget))
+        {
+            core_log(RETRO_LOG_WARN, "Core can't serialize, rewind disabled\n");
+            rewind_failed = true;
+            return;
+        }
+    }
+    if (!g_retro.retro_serialize(&rewind_state[0], size))
+    {
+        core_log(RETRO_LOG_WARN, "Core can't serialize, rewind disabled\n");
+        rewind_failed = true;
+        return;
+    }
+    rewind_push(&rewind_history, &rewind_state[0]);
+    timing.rewind_capture_us = microseconds_now() - start;
+}
+
+// Loads the previous capture and runs it for one frame, without sound, to
+// show it. At the start of history it holds the frame on screen.
+bool CLibretro::rewind_step()
+{
+    long long start = microseconds_now();
+    const uint8_t *state = rewind_pop(&rewind_history);
+    if (!state)
+        return false;
+    g_retro.retro_unserialize(state, rewind_history.state_size);
+    suppress_audio = true;
+    g_retro.retro_run();
+    suppress_audio = false;
+    // capture again only a full interval after letting go
+    rewind_countdown = max(rewind_interval, 1u);
+    timing.rewind_step_us = microseconds_now() - start;
+    return true;
+}
+
+// Run-ahead: the frame that moves the game on runs with its video
+// suppressed, then its state is saved to a buffer kept for the session,
+// runahead_frames more frames run on the same input (they don't poll)
+// with their audio suppressed and only the last one shown, and the state
+// is loaded back.
+// What is on screen is then that many frames ahead of the core's state,
+// which hides as many frames of the game's own input lag.
+void CLibretro::run_ahead()
+{
+    suppress_video = true;
+    g_retro.retro_run();
+    suppress_video = false;
+
+    long long start = microseconds_now();
+    size_t size = g_retro.retro_serialize_size();
+    if (runahead_state.size() < size)
+        runahead_state.resize(size);
+    if (!size || !g_retro.retro_serialize(&runahead_state[0], size))
+    {
+        core_log(RETRO_LOG_WARN, "Core can't serialize, run-ahead disabled\n");
+        runahead_failed = true;
+        return;
+    }
+    long long saved = microseconds_now();
+    suppress_audio = true;
+    suppress_poll = true;
+    for (unsigned i = 0; i < runahead_frames; i++)
+    {
+        suppress_video = i + 1 < runahead_frames;
+        g_retro.retro_run();
+    }
+    suppress_video = false;
+    suppress_audio = false;
+    suppress_poll = false;
+    long long hidden = microseconds_now();
+    if (!g_retro.retro_unserialize(&runahead_state[0], size))
+    {
+        core_log(RETRO_LOG_WARN, "Core can't unserialize, run-ahead disabled\n");
+        runahead_failed = true;
+    }
+    long long loaded = microseconds_now();
+    timing.runahead_save_us = saved - start;
+    timing.runahead_hidden_us = hidden - saved;
+    timing.runahead_load_us = loaded - hidden;
+}
+
+// Movies: while there is one, core_input_state answers a frame's queries
+// from movie_now. Recording fills it from the devices at the frame's first
+// poll and adds it to the movie as the frame ends; playing fills it from
+// the movie as the frame starts and compares the core's state with each
+// keyframe it passes, so a replay that drifts is caught within a keyframe
+// interval. Both run between frames on the emulation thread.
+static bool movie_serialize(std::vector<uint8_t> &state)
+{
+    size_t size = g_retro.retro_serialize_size();
+    state.resize(size);
+    return size && g_retro.retro_serialize(&state[0], size);
+}
+
+bool CLibretro::record_movie(const TCHAR *path, unsigned keyframe_interval)
+{
+    stop_movie();
+    if (!isEmulating)
+        return false;
+    movie_file = movie_create(path, keyframe_interval);
+    if (!movie_file)
+        return false;
+    movie_frame = 0;
+    // until the first poll the core sees what the devices last read
+    memset(&movie_now, 0, sizeof(movie_now));
+    input *input_device = input::GetSingleton();
+    if (input_device)
+        movie_input_set(&movie_now, &input_device->table, &input_device->mouse);
+    // the movie starts from this state
+    movie_begin_frame();
+    return movie_file != NULL;
+}
+
+bool CLibretro::play_movie(const TCHAR *path)
+{
+    stop_movie();
+    if (!isEmulating)
+        return false;
+    movie_file = movie_open(path);
+    if (!movie_file)
+        return false;
+    movie_checked = movie_desyncs = 0;
+    if (!seek_movie(0))
+    {
+        stop_movie();
+        return false;
+    }
+    return true;
+}
+
+bool CLibretro::seek_movie(unsigned frame)
+{
+    if (!movie_file || movie_file->recording)
+        return false;
+    const movie_keyframe *k = movie_keyframe_at(movie_file, frame);
+    if (!k || !movie_read_keyframe(movie_file, k, movie_state))
+        return false;
+    size_t size = g_retro.retro_serialize_size();
+    if (movie_state.size() < size)
+        movie_state.resize(size, 0);
+    if (!size || !g_retro.retro_unserialize(&movie_state[0], size))
+    {
+        core_log(RETRO_LOG_WARN, "Core rejected the movie keyframe\n");
+        return false;
+    }
+    rewind_clear(&rewind_history);
+    movie_frame = k->frame;
+    movie_next_key = (unsigned)(k - &movie_file->keyframes[0]) + 1;
+    // the rest of the way unseen and unheard, as fast as the core goes
+    suppress_video = true;
+    suppress_audio = true;
+    while (movie_file && movie_frame < frame)
+    {
+        movie_begin_frame();
+        if (!movie_file)
+            break;
+        g_retro.retro_run();
+        movie_end_frame();
+    }
+    suppress_video = false;
+    suppress_audio = false;
+    return movie_file && movie_frame == frame;
+}
+
+void CLibretro::stop_movie()
+{
+    if (!movie_file)
+        return;
+    bool recording = movie_file->recording;
+    unsigned frames = movie_file->frames;
+    if (!movie_close(movie_file))
+        core_log(RETRO_LOG_WARN, "Couldn't write the movie\n");
+    else if (recording)
+        core_log(RETRO_LOG_INFO, "Movie recorded, %u frames\n", frames);
+    movie_file = NULL;
+}
+
+void CLibretro::movie_begin_frame()
+{
+    if (movie_file->recording)
+    {
+        movie_polled = false;
+        if (!movie_wants_keyframe(movie_file))
+            return;
+        long long start = microseconds_now();
+        if (!movie_serialize(movie_state) || !movie_add_keyframe(movie_file, &movie_state[0], movie_state.size()))
+        {
+            core_log(RETRO_LOG_WARN, "Couldn't take a movie keyframe, recording stopped\n");
+            stop_movie();
+            return;
+        }
+        timing.state_stall_us += microseconds_now() - start;
+        return;
+    }
+    const movie_input *in = movie_input_at(movie_file, movie_frame);
+    if (!in)
+    {
+        core_log(RETRO_LOG_INFO, "Movie ended after %u frames\n", movie_frame);
+        stop_movie();
+        return;
+    }
+    movie_now = *in;
+    if (movie_next_key < movie_file->keyframes.size() && movie_file->keyframes[movie_next_key].frame == movie_frame)
+    {
+        const movie_keyframe *k = &movie_file->keyframes[movie_next_key++];
+        long long start = microseconds_now();
+        if (movie_read_keyframe(movie_file, k, movie_key) && movie_serialize(movie_state))
+        {
+            movie_checked++;
+            if (movie_key != movie_state)
+            {
+                movie_desyncs++;
+                core_log(RETRO_LOG_WARN, "Movie desynced by frame %u\n", movie_frame);
+            }
+        }
+        timing.state_stall_us += microseconds_now() - start;
+    }
+}
+
+void CLibretro::movie_end_frame()
+{
+    if (movie_file->recording)
+        movie_add_input(movie_file, &movie_now);
+    movie_frame++;
+}
+
+// Frame delay: with vsync a frame is shown at the vblank after retro_run
+// however early it ran, so running later, after a wait following the
+// last present, polls input closer to that vblank. Auto mode keeps the
+// 95th percentile of recent core time plus a margin for upload and
+// present inside the refresh period, and backs off a millisecond on any
+// missed vblank.
+#define FRAME_DELAY_MARGIN_US 2000
+
+bool frame_delay_parse(const char *str, int *ms)
+{
+    if (!strcmp(str, "auto"))
+    {
+        *ms = FRAME_DELAY_AUTO;
+        return true;
+    }
+    char *end;
+    errno = 0;
+    long value = strtol(str, &end, 10);
+    if (end == str || *end || errno || value < 0 || value > (long)(1000.0 / plat_refresh_rate()))
+        return false;
+    *ms = (int)value;
+    return true;
+}
+
+void CLibretro::frame_delay_wait()
+{
+    long long present = g_present_stats.present_done_us.load(std::memory_order_acquire);
+    if (pacing != PACE_VIDEO || !frame_delay_us || !present)
+        return;
+    pacer_wait_until(&pacer, present + frame_delay_us);
+}
+
+void CLibretro::frame_delay_update()
+{
+    if (pacing != PACE_VIDEO)
+        return;
+    long long present = g_present_stats.present_done_us.load(std::memory_order_acquire);
+    if (timing.poll_at_us && present > timing.poll_at_us)
+        timing.input_latency_us = present - timing.poll_at_us;
+    bool missed = last_present_us && present - last_present_us > refresh_period_us * 1.5;
+    last_present_us = present;
+    if (missed)
+        timing.vblank_misses++;
+    if (frame_delay != FRAME_DELAY_AUTO)
+        return;
+    if (missed)
+        frame_delay_us = max(0LL, frame_delay_us - 1000);
+    // the callbacks include the wait for vblank, so leave them out
+    delay_window[delay_count++ % FRAME_DELAY_WINDOW] = timing.run_us - timing.callback_us;
+    if (delay_count % FRAME_DELAY_WINDOW)
+        return;
+    long long sorted[FRAME_DELAY_WINDOW];
+    memcpy(sorted, delay_window, sizeof(sorted));
+    long long *p95 = sorted + FRAME_DELAY_WINDOW * 95 / 100;
+    nth_element(sorted, p95, sorted + FRAME_DELAY_WINDOW);
+    long long budget = (long long)refresh_period_us - *p95 - FRAME_DELAY_MARGIN_US;
+    frame_delay_us = max(0LL, min(budget, (long long)refresh_period_us - 1000));
+}
+
+bool CLibretro::init(void *hwnd)
 {
     isEmulating = false;
     emulator_hwnd = hwnd;
@@ -789,20 +1318,28 @@ void CLibretro::kill()
 
     if (threaded)
     {
-        WaitForSingleObject(thread_handle, INFINITE);
-        CloseHandle(thread_handle);
+        // the thread owns teardown; ask it to leave its loop and wait
+        isEmulating = false;
+        if (thread_handle)sthread_join(thread_handle);
+        thread_handle = NULL;
     }
     else
     {
         if (isEmulating)
         {
             isEmulating = false;
+            // stops the audio callback worker before the core goes away
+            if (audio_enabled)_audio.destroy();
+            audio_enabled = false;
             g_retro.retro_unload_game();
             g_retro.retro_deinit();
             if (info.data)
                 free((void*)info.data);
-            _audio.destroy();
             video_deinit();
+            rewind_free(&rewind_history);
+            state_io_free(states);
+            states = NULL;
+            stop_movie();
 
         }
 
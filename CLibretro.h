@@ -1,12 +1,20 @@
 #ifndef CEMULATOR_H
 #define CEMULATOR_H
+#ifdef _WIN32
 #include <initguid.h>
+#endif
 #include <list>
-#include <thread>
-#include <chrono>
-#include <mutex>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <atomic>
+#include "io/platform.h"
 #include "io/input.h"
 #include "io/audio.h"
+#include "io/frame_pacer.h"
+#include "io/rewind.h"
+#include "io/state_io.h"
+#include "io/movie.h"
 
 namespace std
 {
@@ -15,13 +23,21 @@ namespace std
   typedef wostringstream tostringstream;
 }
 
+// frame_delay value that tunes itself from recent retro_run times
+#define FRAME_DELAY_AUTO (-1)
+#define FRAME_DELAY_WINDOW 120
+
+// a frame delay from the command line: "auto", or whole ms from 0 up to
+// the display's refresh period; false on anything else
+bool frame_delay_parse(const char *str, int *ms);
+
 class CLibretro
 {
   static	CLibretro* m_Instance;
 public:
    CLibretro();
    ~CLibretro();
-   static CLibretro* CreateInstance(HWND hwnd);
+   static CLibretro* CreateInstance(void *hwnd);
    static	CLibretro* GetSingleton();
 
   struct core_vars
@@ -42,29 +58,105 @@ public:
   std::vector<core_vars> variables;
   struct retro_game_info info;
   bool variables_changed;
-  HANDLE thread_handle;
-  DWORD thread_id;
-  HWND emulator_hwnd;
-  DWORD rate;
+  sthread_t *thread_handle;
+  void *emulator_hwnd;
   double lastTime;
   int nbFrames;
   bool threaded;
-  BOOL isEmulating;
-  retro_usec_t  frame_limit_last_time;
+  bool headless;
+  bool headless_audio; // keep the audio device when headless
+  bool audio_enabled;
+  bool convert_pixels; // upload every pixel format as XRGB8888
+  bool threaded_present; // upload and present on a render thread
+  bool disable_pbo;      // upload straight from the core's buffer
+  bool disable_elision;  // upload frames even when they are unchanged
+  pace_mode pace_setting; // what the user asked for
+  pace_mode pacing;       // what this session runs with
+  frame_pacer pacer;
+  bool paused;
+  int frame_delay;          // ms from a present to the next retro_run (video sync)
+  long long frame_delay_us; // in effect
+  double refresh_period_us;
+  long long last_present_us;
+  long long delay_window[FRAME_DELAY_WINDOW]; // recent retro_run core time
+  unsigned delay_count;
+  unsigned runahead_frames; // frames shown ahead of the game's state
+  bool runahead_failed;     // the core can't serialize; run normally
+  std::vector<uint8_t> runahead_state;
+  bool suppress_video;
+  bool suppress_audio;
+  bool suppress_poll;  // run-ahead's hidden frames keep the real frame's input
+  size_t rewind_budget;     // bytes of history to keep, 0 for no rewind
+  unsigned rewind_interval; // frames between captures
+  bool rewinding;           // held by the user: step back instead of running
+  bool rewind_failed;
+  unsigned rewind_countdown;
+  std::vector<uint8_t> rewind_state;
+  rewind_buffer rewind_history;
+  state_io *states;     // savestate file worker
+  std::atomic<bool> save_requested;  // by another thread; snapshotted at the next frame
+  TCHAR save_path[MAX_PATH];         // owned by the emulation thread while requested
+  std::atomic<bool> load_requested;  // the same for loads, queued after a pending save
+  TCHAR load_path[MAX_PATH];
+  movie *movie_file;        // being recorded or played, or NULL
+  unsigned movie_frame;     // the frame about to run
+  movie_input movie_now;    // what core_input_state answers while there's a movie
+  bool movie_polled;        // movie_now was taken from the devices this frame
+  unsigned movie_next_key;  // the keyframe playback checks against next
+  unsigned movie_checked, movie_desyncs;
+  std::vector<uint8_t> movie_state;
+  std::vector<uint8_t> movie_key; // a keyframe read back, to check against
+  bool isEmulating;
   retro_usec_t  runloop_frame_time_last;
-  retro_time_t frame_limit_minimum_time;
-  
 
-  DWORD ThreadStart();
+  struct frame_timing
+  {
+    long long run_us;      // duration of the last retro_run()
+    long long callback_us; // frontend callback time spent inside it
+    long long pace_late_us; // how far past its deadline the frame started
+    long long poll_at_us;   // when the core last polled input
+    long long input_latency_us; // that poll to the present that showed it
+    long long input_age_us;       // how old the sampled input was at that poll
+    long long input_event_age_us; // how old the change it first saw was, if it saw one
+    unsigned vblank_misses; // presents that came a vblank late
+    long long runahead_save_us;   // retro_serialize
+    long long runahead_hidden_us; // the frames run ahead
+    long long runahead_load_us;   // retro_unserialize
+    long long rewind_capture_us;  // serialize and delta code, when it ran
+    long long rewind_step_us;     // a step back, when rewinding
+    long long state_stall_us;     // savestate serialize/unserialize, when one ran
+  };
+  frame_timing timing;
+
+  void ThreadStart();
   bool running();
   bool loadfile(TCHAR* filename, TCHAR* core_filename, bool gamespecificoptions, bool mthreaded = false);
   void render();
   void run();
   void reset();
+  // stops emulation and audio without unloading; the loop idles meanwhile
+  void pause(bool pause);
+  void frame_delay_wait();
+  void core_run();
+  void run_ahead();
+  void rewind_capture();
+  bool rewind_step();
+  void frame_delay_update();
   bool init_common();
   bool core_load(TCHAR *sofile, bool specifics, TCHAR* filename);
-  bool init(HWND hwnd);
+  bool init(void *hwnd);
+  // queues a savestate load, or a save, with the file work on a worker
   bool savestate(TCHAR* filename, bool save = false);
+  bool snapshot_state(const TCHAR *filename);
+  void service_states();
+  // input movies (see io/movie.h), recorded or played from the next frame;
+  // a seek loads the nearest keyframe and runs on to the frame unseen
+  bool record_movie(const TCHAR *path, unsigned keyframe_interval);
+  bool play_movie(const TCHAR *path);
+  bool seek_movie(unsigned frame);
+  void stop_movie();
+  void movie_begin_frame();
+  void movie_end_frame();
   bool savesram(TCHAR* filename, bool save = false);
   void kill();
   void core_audio_sample(int16_t left, int16_t right);
@@ -99,6 +99,7 @@ public:
         MESSAGE_HANDLER(WM_CREATE, OnCreate)
         MESSAGE_HANDLER(WM_DESTROY, OnDestroy)
         MESSAGE_HANDLER(WM_SIZE, OnSize)
+        MESSAGE_HANDLER(WM_ACTIVATEAPP, OnActivateApp)
         MESSAGE_HANDLER(WM_SETCURSOR,OnSetCursor)
         COMMAND_ID_HANDLER(ID_OPTIONS, OnOptions)
         COMMAND_ID_HANDLER_EX(IDC_EXIT, OnFileExit)
@@ -123,6 +124,29 @@ public:
     input*    input_device;
     HACCEL    m_haccelerator;
     std::vector<libretro_core> cores;
+    bool pause_unfocused;
+    bool minimized;
+    bool focused;
+
+    // minimised always pauses; losing focus only when asked to
+    void UpdatePause()
+    {
+        emulator->pause(minimized || (pause_unfocused && !focused));
+    }
+
+    LRESULT OnActivateApp(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled)
+    {
+        focused = wParam != FALSE;
+        UpdatePause();
+        bHandled = FALSE;
+        return 0;
+    }
+
+    // the message loop sleeps in WaitMessage instead of calling DoFrame
+    bool Idle()
+    {
+        return !emulator->isEmulating || emulator->paused || emulator->threaded;
+    }
 
     LRESULT OnLoadState(WORD /*wNotifyCode*/, WORD /*wID*/, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
     {
@@ -177,6 +201,10 @@ public:
 
     BOOL PreTranslateMessage(MSG* pMsg)
     {
+        // rewind runs for as long as Backspace is held
+        if ((pMsg->message == WM_KEYDOWN || pMsg->message == WM_KEYUP) && pMsg->wParam == VK_BACK &&
+            emulator->rewind_budget)
+            emulator->rewinding = pMsg->message == WM_KEYDOWN;
         if (m_haccelerator != NULL)
         {
             if (::TranslateAccelerator(m_hWnd, m_haccelerator, pMsg))
@@ -188,6 +216,8 @@ public:
 
     LRESULT OnSize(UINT uMsg, WPARAM wParam, LPARAM lParam, BOOL& bHandled)
     {
+        minimized = wParam == SIZE_MINIMIZED;
+        UpdatePause();
         if (!emulator->isEmulating)
         {
             PAINTSTRUCT ps;
@@ -248,6 +278,9 @@ public:
         bHandled = FALSE;
         input_device = input::CreateInstance(GetModuleHandle(NULL), m_hWnd);
         emulator = CLibretro::CreateInstance(m_hWnd);
+        pause_unfocused = false;
+        minimized = false;
+        focused = true;
         m_haccelerator = AtlLoadAccelerators(IDR_ACCELERATOR1);
         pLoop->AddMessageFilter(this);
         RegisterDropTarget();
@@ -429,6 +462,13 @@ public:
                 TranslateMessage(&m_msg);
                 DispatchMessage(&m_msg);
             }
+            else if (gamewnd.Idle())
+            {
+                // nothing to run on this thread: sleep until a message
+                if (!gamewnd.emulator->isEmulating)
+                    gamewnd.DoFrame();
+                WaitMessage();
+            }
             else
             {
                 gamewnd.DoFrame();
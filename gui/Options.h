@@ -14,8 +14,10 @@ public:
    bool					 notify_d;
    bool                     have_event;
    dinput::di_event         last_event;
+   dinput::di_event_ring    ring;
    std::vector< HTREEITEM > tree_items;
    guid_container         * guids;
+   unsigned                 resume_hz; // the sampler's rate, while it is held off the binds
    // returned to list view control
    enum { IDD = IDD_INPUT };
 
@@ -37,9 +39,17 @@ public:
          delete di;
          di = 0;
       }
+      resume_sampling();
       return 0;
    }
 
+   void resume_sampling()
+   {
+      if (resume_hz)
+         input->start_sampling(resume_hz);
+      resume_hz = 0;
+   }
+
 
    LRESULT OnOK(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCtl*/, BOOL& /*bHandled*/)
    {
@@ -62,6 +72,7 @@ public:
          delete di;
          di = 0;
       }
+      resume_sampling();
       bHandled = true;
       return 0;
    }
@@ -73,7 +84,7 @@ public:
 
    LRESULT NotifyHandler(int idCtrl, LPNMHDR pnmh, BOOL&/*bHandled*/) {
       //	KillTimer(0x1337);
-      while (!process_events(di->read()))Sleep(10);
+      while (!process_events(read_events()))Sleep(10);
       std::tostringstream event_text;
       format_event(last_event, event_text);
       int n = ListView_GetSelectionMark(assign);
@@ -110,6 +121,9 @@ public:
    {
       input = input::GetSingleton();
       CLibretro* lib = CLibretro::GetSingleton();
+      // the sampler thread reads the binds this dialog edits in place
+      resume_hz = input->sampler ? input->sample_hz : 0;
+      input->stop_sampling();
       bl = input->bl;
       guids = input->guids;
       di = create_dinput();
@@ -166,7 +180,7 @@ public:
       if (wParam == 0x1337)
       {
 
-         if (process_events(di->read()))
+         if (process_events(read_events()))
          {
             std::tostringstream event_text;
             format_event(last_event, event_text);
@@ -252,6 +266,17 @@ private:
       }
    }
 
+   // the dialog edits the list as it goes, so it takes its own copy
+   std::vector< dinput::di_event > read_events()
+   {
+      std::vector< dinput::di_event > events;
+      dinput::di_event e;
+      di->read(ring);
+      while (ring.pop(e))
+         events.push_back(e);
+      return events;
+   }
+
    bool process_events(std::vector< dinput::di_event > events)
    {
       std::vector< dinput::di_event >::iterator it;
@@ -158,6 +158,23 @@ int Run(LPTSTR cmdline = NULL, int nCmdShow = SW_SHOWDEFAULT)
 			a.add<string>("rom_name", 'r', "rom filename", true, "");
 			a.add("pergame", 'g', "per-game configuration");
 			a.add("threads", 't', "use multithreaded core execution");
+			a.add("present-thread", 'p', "upload and present on a render thread");
+			a.add("convert", 0, "convert frames to XRGB8888 before upload");
+			a.add("no-pbo", 0, "upload straight from the core's buffer, without pixel buffer objects");
+			a.add("no-elision", 0, "upload every frame, even when it is unchanged");
+			a.add("dsp-thread", 0, "convert and resample audio on a worker thread");
+			a.add<string>("resampler", 0, "resampler engine", false, "sinc",
+				cmdline::oneof<string>("nearest", "linear", "cubic", "sinc"));
+			a.add<string>("quality", 0, "sinc resampler quality", false, "normal",
+				cmdline::oneof<string>("lowest", "lower", "normal", "higher", "highest"));
+			a.add<string>("pace", 0, "frame pacing: auto, audio, video, timer or free", false, "auto");
+			a.add("pause-unfocused", 0, "pause while the window is in the background");
+			a.add<string>("frame-delay", 0, "ms to wait after a present before running (video pacing), or auto", false, "0");
+			a.add<int>("run-ahead", 0, "frames to run ahead of the core to hide its input lag", false, 0, cmdline::range(0, 8));
+			a.add<int>("rewind", 0, "MB of savestate history to keep; hold Backspace to rewind", false, 0, cmdline::range(0, 2047));
+			a.add<int>("rewind-interval", 0, "frames between rewind captures", false, 1, cmdline::range(0, 3600));
+			a.add<int>("input-rate", 0, "read input this many times a second on its own thread (1000 or more), 0 to read it once a frame", false, 0,
+				cmdline::range(0, 8000));
 			a.parse_check(argc, cmdargptr);
 			printf("\nPress any key to continue....\n");
 			_Module.RemoveMessageLoop();
@@ -183,12 +200,58 @@ int Run(LPTSTR cmdline = NULL, int nCmdShow = SW_SHOWDEFAULT)
 	a.add<string>("rom_name", 'r', "rom filename", true, "");
 	a.add("pergame", 'g', "per-game configuration");
 	a.add("threads", 't', "use multithreaded core execution");
+	a.add("present-thread", 'p', "upload and present on a render thread");
+	a.add("convert", 0, "convert frames to XRGB8888 before upload");
+	a.add("no-pbo", 0, "upload straight from the core's buffer, without pixel buffer objects");
+	a.add("no-elision", 0, "upload every frame, even when it is unchanged");
+	a.add("dsp-thread", 0, "convert and resample audio on a worker thread");
+	a.add<string>("resampler", 0, "resampler engine", false, "sinc",
+		cmdline::oneof<string>("nearest", "linear", "cubic", "sinc"));
+	a.add<string>("quality", 0, "sinc resampler quality", false, "normal",
+		cmdline::oneof<string>("lowest", "lower", "normal", "higher", "highest"));
+	a.add<string>("pace", 0, "frame pacing: auto, audio, video, timer or free", false, "auto");
+	a.add("pause-unfocused", 0, "pause while the window is in the background");
+	a.add<string>("frame-delay", 0, "ms to wait after a present before running (video pacing), or auto", false, "0");
+	a.add<int>("run-ahead", 0, "frames to run ahead of the core to hide its input lag", false, 0, cmdline::range(0, 8));
+	a.add<int>("rewind", 0, "MB of savestate history to keep; hold Backspace to rewind", false, 0, cmdline::range(0, 2047));
+	a.add<int>("rewind-interval", 0, "frames between rewind captures", false, 1, cmdline::range(0, 3600));
+	a.add<int>("input-rate", 0, "read input this many times a second on its own thread (1000 or more), 0 to read it once a frame", false, 0,
+		cmdline::range(0, 8000));
 	a.parse_check(argc, cmdargptr);
 
 	wstring rom = s2ws(a.get<string>("rom_name"));
 	wstring core = s2ws(a.get<string>("core_name"));
 	bool percore = a.exist("pergame");
 	bool thread = a.exist("threads");
+	CLibretro::GetSingleton()->threaded_present = a.exist("present-thread");
+	CLibretro::GetSingleton()->convert_pixels = a.exist("convert");
+	CLibretro::GetSingleton()->disable_pbo = a.exist("no-pbo");
+	CLibretro::GetSingleton()->disable_elision = a.exist("no-elision");
+	CLibretro::GetSingleton()->_audio.threaded_dsp = a.exist("dsp-thread");
+	for (int e = RESAMPLER_NEAREST; e <= RESAMPLER_SINC; e++)
+		if (a.get<string>("resampler") == resampler_engine_name((resampler_engine)e))
+			CLibretro::GetSingleton()->_audio.resampler = (resampler_engine)e;
+	for (int q = RESAMPLER_QUALITY_LOWEST; q <= RESAMPLER_QUALITY_HIGHEST; q++)
+		if (a.get<string>("quality") == resampler_quality_name((resampler_quality)q))
+			CLibretro::GetSingleton()->_audio.quality = (resampler_quality)q;
+	if (!pace_parse_mode(a.get<string>("pace").c_str(), &CLibretro::GetSingleton()->pace_setting))
+		printf("Unknown pacing '%s', using auto.\n", a.get<string>("pace").c_str());
+	dlgMain.pause_unfocused = a.exist("pause-unfocused");
+	if (!frame_delay_parse(a.get<string>("frame-delay").c_str(), &CLibretro::GetSingleton()->frame_delay))
+		printf("Frame delay '%s' is not auto or 0 to %d ms, using 0.\n", a.get<string>("frame-delay").c_str(),
+			(int)(1000.0 / plat_refresh_rate()));
+	CLibretro::GetSingleton()->runahead_frames = a.get<int>("run-ahead");
+	CLibretro::GetSingleton()->rewind_budget = (size_t)a.get<int>("rewind") << 20;
+	CLibretro::GetSingleton()->rewind_interval = a.get<int>("rewind-interval");
+	// below 1 kHz the thread's snapshot is staler than a poll at the frame
+	int input_rate = a.get<int>("input-rate");
+	if (input_rate && input_rate < 1000)
+	{
+		printf("Input rate %d Hz is not 0 or 1000 to 8000, reading input once a frame.\n", input_rate);
+		input_rate = 0;
+	}
+	if (input::GetSingleton() && !input::GetSingleton()->start_sampling(input_rate))
+		printf("Couldn't start the input thread, reading input once a frame.\n");
 	dlgMain.ShowWindow(nCmdShow);
 	dlgMain.start((TCHAR*)rom.c_str(), (TCHAR*)core.c_str(), percore,thread);
 	int nRet = theLoop.Run(dlgMain);
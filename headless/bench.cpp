@@ -0,0 +1,1339 @@
+// bench.cpp : Microbenchmarks for frontend hot paths that don't need a core.
+//
+#include "bench.h"
+#include "../io/platform.h"
+#include "../io/ring.h"
+#include "../io/triple_buffer.h"
+#include "../io/frame_pacer.h"
+#include "../io/audio.h"
+#include "../io/cpu.h"
+#include "../io/pixconv.h"
+#include "../io/rewind.h"
+#include "../io/state_io.h"
+#include "../io/movie.h"
+#include "../io/dinput_script.h"
+#include "../io/input.h"
+#include "../io/input_sampler.h"
+#include "../3rdparty/libretro.h"
+#include "../3rdparty/resampler.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+using namespace std;
+
+// ring: one thread plays the emulator, writing 800 frame chunks through the
+// same write/wait loop as Audio::mix, while another plays the device
+// callback and pulls 256 frames every 200us. Every read is timed. The old
+// scheme (the same ring under slock/scond) runs alongside for comparison.
+
+#define RING_FRAMES      1024
+#define CHUNK_FRAMES     800
+#define CALLBACK_FRAMES  256
+#define CALLBACK_PERIOD  200
+#define RING_RUN_US      2000000
+#define SLOW_CALLBACK_US 50
+
+struct ring_bench
+{
+    audio_ring *ring;
+    bool locked;
+    slock_t *lock;
+    scond_t *cond;
+    std::atomic<bool> done;
+    vector<long long> read_us;
+    unsigned errors;
+    unsigned underruns;
+    size_t frames;
+};
+
+static void ring_bench_consumer(void *data)
+{
+    ring_bench *b = (ring_bench*)data;
+    float out[CALLBACK_FRAMES * 2];
+    float expect = 0;
+    long long next = microseconds_now();
+    while (!b->done.load())
+    {
+        while (microseconds_now() < next);
+        next += CALLBACK_PERIOD;
+
+        long long start = microseconds_now();
+        size_t got;
+        if (b->locked)
+        {
+            slock_lock(b->lock);
+            got = ring_read(b->ring, out, CALLBACK_FRAMES);
+            scond_signal(b->cond);
+            slock_unlock(b->lock);
+        }
+        else got = ring_read(b->ring, out, CALLBACK_FRAMES);
+        b->read_us.push_back(microseconds_now() - start);
+
+        if (got < CALLBACK_FRAMES)
+            b->underruns++;
+        // left channel carries a running frame counter
+        for (size_t i = 0; i < got; i++, expect++)
+            if (out[i * 2] != expect)
+            {
+                b->errors++;
+                expect = out[i * 2];
+            }
+        b->frames += got;
+    }
+}
+
+static void ring_bench_produce(ring_bench *b, const float *chunk, size_t frames)
+{
+    size_t written = 0;
+    while (written < frames)
+    {
+        if (b->locked)
+        {
+            slock_lock(b->lock);
+            size_t amt = ring_write(b->ring, chunk + written * 2, frames - written);
+            if (!amt)
+                scond_wait_timeout(b->cond, b->lock, 100000);
+            slock_unlock(b->lock);
+            written += amt;
+        }
+        else
+        {
+            size_t amt = ring_write(b->ring, chunk + written * 2, frames - written);
+            written += amt;
+            if (!amt && !ring_wait_writable(b->ring, frames - written, 100000))
+                break;
+        }
+    }
+}
+
+static bool ring_bench_run(bool locked)
+{
+    ring_bench b;
+    b.ring = ring_new(RING_FRAMES, 2 * sizeof(float));
+    b.locked = locked;
+    b.lock = slock_new();
+    b.cond = scond_new();
+    b.done = false;
+    b.read_us.reserve(RING_RUN_US / CALLBACK_PERIOD + 1024);
+    b.errors = b.underruns = 0;
+    b.frames = 0;
+
+    vector<float> chunk(CHUNK_FRAMES * 2);
+    float counter = 0;
+    sthread_t *consumer = sthread_create(ring_bench_consumer, &b);
+    long long end = microseconds_now() + RING_RUN_US;
+    // float holds exact integers up to 2^24, plenty for one run
+    while (microseconds_now() < end)
+    {
+        for (size_t i = 0; i < CHUNK_FRAMES; i++, counter++)
+        {
+            chunk[i * 2] = counter;
+            chunk[i * 2 + 1] = -counter;
+        }
+        ring_bench_produce(&b, &chunk[0], CHUNK_FRAMES);
+    }
+    b.done = true;
+    sthread_join(consumer);
+
+    vector<long long> &t = b.read_us;
+    sort(t.begin(), t.end());
+    size_t slow = t.end() - upper_bound(t.begin(), t.end(), (long long)SLOW_CALLBACK_US);
+    long long total = 0;
+    for (size_t i = 0; i < t.size(); i++)
+        total += t[i];
+    printf("%-9s callbacks %u, frames %u, read mean %.3f us, p99 %lld us, max %lld us, >%dus %u, underruns %u, errors %u\n",
+        locked ? "locked:" : "lockfree:", (unsigned)t.size(), (unsigned)b.frames,
+        t.size() ? (double)total / t.size() : 0.0, t.size() ? t[t.size() * 99 / 100] : 0,
+        t.size() ? t.back() : 0, SLOW_CALLBACK_US, (unsigned)slow, b.underruns, b.errors);
+
+    ring_free(b.ring);
+    slock_free(b.lock);
+    scond_free(b.cond);
+    return b.errors == 0;
+}
+
+static int bench_ring()
+{
+    bool ok = ring_bench_run(false);
+    ok = ring_bench_run(true) && ok;
+    return ok ? 0 : 1;
+}
+
+// present: the threaded present pipeline with stand-in stages. The
+// emulation stage spins on the CPU like retro_run; the present stage
+// sleeps like a SwapBuffers waiting for vblank. Run back to back, a frame
+// costs both; through the triple buffer the present overlaps the next
+// frame's emulation. Each frame carries its number in every byte so the
+// render side can spot a torn or out of order one.
+
+#define PRESENT_FRAMES   300
+#define PRESENT_EMU_US   4000
+#define PRESENT_SWAP_US  3000
+#define PRESENT_BYTES    (320 * 240 * 2)
+
+struct present_bench
+{
+    triple_buffer *tb;
+    std::atomic<bool> done;
+    unsigned presented;
+    unsigned errors;
+    long long present_us;
+    long long latency_us;
+};
+
+static void present_bench_spin(long long us)
+{
+    long long end = microseconds_now() + us;
+    while (microseconds_now() < end);
+}
+
+static void present_bench_render(void *data)
+{
+    present_bench *b = (present_bench*)data;
+    uint32_t last = 0;
+    while (!b->done.load() || triple_buffer_pending(b->tb))
+    {
+        if (!triple_buffer_wait(b->tb, 100000))
+            continue;
+        frame_slot *f = triple_buffer_take(b->tb);
+        if (!f)
+            continue;
+        long long start = microseconds_now();
+        b->latency_us += start - f->published_us;
+        uint32_t seq;
+        memcpy(&seq, f->data, 4);
+        if (seq <= last)
+            b->errors++;
+        for (size_t i = 4; i < PRESENT_BYTES; i++)
+            if (f->data[i] != (uint8_t)seq)
+            {
+                b->errors++;
+                break;
+            }
+        last = seq;
+        plat_sleep_us(PRESENT_SWAP_US);
+        b->present_us += microseconds_now() - start;
+        b->presented++;
+    }
+}
+
+static int bench_present()
+{
+    long long start = microseconds_now();
+    for (unsigned i = 0; i < PRESENT_FRAMES; i++)
+    {
+        present_bench_spin(PRESENT_EMU_US);
+        plat_sleep_us(PRESENT_SWAP_US);
+    }
+    long long serial = microseconds_now() - start;
+    printf("serial:    %.3f ms/frame (emulate %.3f + present %.3f)\n", serial / 1000.0 / PRESENT_FRAMES,
+        PRESENT_EMU_US / 1000.0, PRESENT_SWAP_US / 1000.0);
+
+    present_bench b;
+    b.tb = triple_buffer_new();
+    b.done = false;
+    b.presented = b.errors = 0;
+    b.present_us = b.latency_us = 0;
+    sthread_t *render = sthread_create(present_bench_render, &b);
+    long long emulate = 0, handoff = 0;
+    start = microseconds_now();
+    for (uint32_t seq = 1; seq <= PRESENT_FRAMES; seq++)
+    {
+        long long t = microseconds_now();
+        present_bench_spin(PRESENT_EMU_US);
+        long long h = microseconds_now();
+        frame_slot *s = triple_buffer_back(b.tb, PRESENT_BYTES);
+        memset(s->data, (uint8_t)seq, PRESENT_BYTES);
+        memcpy(s->data, &seq, 4);
+        triple_buffer_publish(b.tb);
+        emulate += h - t;
+        handoff += microseconds_now() - h;
+    }
+    long long threaded = microseconds_now() - start;
+    b.done = true;
+    triple_buffer_wake(b.tb);
+    sthread_join(render);
+    long long finished = microseconds_now() - start;
+    unsigned dropped = b.tb->dropped.load();
+    triple_buffer_free(b.tb);
+    // Dropped frames are never presented, so measure against the present
+    // time actually spent: what of it still showed past the emulation
+    // thread's own work, up to the last present, wasn't hidden.
+    long long exposed = max(0LL, finished - emulate - handoff);
+    long long hidden = max(0LL, b.present_us - exposed);
+
+    printf("threaded:  %.3f ms/frame (emulate %.3f, handoff %.3f | present %.3f, latency %.3f)\n",
+        threaded / 1000.0 / PRESENT_FRAMES, emulate / 1000.0 / PRESENT_FRAMES, handoff / 1000.0 / PRESENT_FRAMES,
+        b.presented ? b.present_us / 1000.0 / b.presented : 0.0, b.presented ? b.latency_us / 1000.0 / b.presented : 0.0);
+    printf("overlap:   %.0f%% of the present hidden, over %u presented frames, %u errors\n",
+        b.present_us ? hidden * 100.0 / b.present_us : 0.0, b.presented, b.errors);
+    printf("dropped:   %u of %u frames replaced before the render thread took them\n", dropped, PRESENT_FRAMES);
+    return b.errors ? 1 : 0;
+}
+
+// pacing: how far past each 60 fps deadline the run loop gets going,
+// first sleeping the whole wait, then with frame_pacer's sleep-then-spin.
+// A quarter of the period is spent "emulating" so the waits vary.
+
+#define PACING_FPS    60.0
+#define PACING_FRAMES 300
+#define PACING_WORK_US 4000
+
+static void pacing_bench_report(const char *name, vector<long long> &late)
+{
+    sort(late.begin(), late.end());
+    long long total = 0;
+    for (size_t i = 0; i < late.size(); i++)
+        total += late[i];
+    size_t over = late.end() - upper_bound(late.begin(), late.end(), 100LL);
+    printf("%-7s late mean %7.1f us, p50 %5lld, p90 %5lld, p99 %5lld, max %5lld, >100us %u of %u\n",
+        name, (double)total / late.size(), late[late.size() / 2], late[late.size() * 9 / 10],
+        late[late.size() * 99 / 100], late.back(), (unsigned)over, (unsigned)late.size());
+}
+
+static int bench_pacing()
+{
+    vector<long long> late;
+    late.reserve(PACING_FRAMES);
+    double period = 1000000.0 / PACING_FPS;
+    double deadline = (double)microseconds_now();
+    for (unsigned i = 0; i < PACING_FRAMES; i++)
+    {
+        present_bench_spin(PACING_WORK_US);
+        deadline += period;
+        long long now = microseconds_now();
+        plat_sleep_us((long long)deadline - now);
+        late.push_back(max(0LL, microseconds_now() - (long long)deadline));
+    }
+    pacing_bench_report("sleep:", late);
+
+    late.clear();
+    frame_pacer pacer;
+    pacer_init(&pacer, PACING_FPS);
+    for (unsigned i = 0; i < PACING_FRAMES; i++)
+    {
+        present_bench_spin(PACING_WORK_US);
+        late.push_back(pacer_wait(&pacer));
+    }
+    pacing_bench_report("hybrid:", late);
+    printf("hybrid spin margin settled at %.0f us, %u deadlines missed\n", pacer.oversleep, pacer.missed);
+    return 0;
+}
+
+// resampler: every sinc kernel the CPU runs is checked against the scalar
+// reference on the same noise, then timed at the filter widths the audio
+// path uses (1.0) and the wider ones heavy downsampling asks for. The s16
+// conversion kernels must match mini_al bit for bit.
+
+#define RESAMPLER_FRAMES   8192
+#define RESAMPLER_RUN_US   500000
+#define RESAMPLER_MAX_ERR  1e-5f
+
+static const enum resampler_simd resampler_kernels[] = {
+    RESAMPLER_SIMD_C, RESAMPLER_SIMD_SSE, RESAMPLER_SIMD_AVX2, RESAMPLER_SIMD_AVX512
+};
+
+static size_t resampler_bench_run(void *re, const float *in, float *out, double ratio)
+{
+    struct resampler_data data = { 0 };
+    data.data_in = in;
+    data.data_out = out;
+    data.input_frames = RESAMPLER_FRAMES;
+    data.ratio = ratio;
+    resampler_sinc_process(re, &data);
+    return data.output_frames;
+}
+
+static bool resampler_bench_accuracy(const float *in)
+{
+    static const double ratios[] = { 1.5, 0.91875, 0.5, 0.25 };
+    bool ok = true;
+    vector<float> ref(RESAMPLER_FRAMES * 2 * 2 + 64), out(ref.size());
+    for (size_t k = 1; k < sizeof(resampler_kernels) / sizeof(*resampler_kernels); k++)
+    {
+        enum resampler_simd simd = resampler_kernels[k];
+        if (!resampler_sinc_simd_supported(simd))
+        {
+            printf("%-7s not supported by this CPU\n", resampler_sinc_simd_name(simd));
+            continue;
+        }
+        float worst = 0;
+        for (size_t r = 0; r < sizeof(ratios) / sizeof(*ratios); r++)
+        {
+            void *a = resampler_sinc_init_simd(ratios[r] < 1.0 ? ratios[r] : 1.0, RESAMPLER_QUALITY_NORMAL, RESAMPLER_SIMD_C);
+            void *b = resampler_sinc_init_simd(ratios[r] < 1.0 ? ratios[r] : 1.0, RESAMPLER_QUALITY_NORMAL, simd);
+            // twice, so the second pass starts from a primed history
+            for (int pass = 0; pass < 2; pass++)
+            {
+                size_t na = resampler_bench_run(a, in, &ref[0], ratios[r]);
+                size_t nb = resampler_bench_run(b, in, &out[0], ratios[r]);
+                if (na != nb)
+                {
+                    printf("%-7s ratio %g: %u frames, reference %u\n", resampler_sinc_simd_name(simd),
+                        ratios[r], (unsigned)nb, (unsigned)na);
+                    ok = false;
+                    break;
+                }
+                for (size_t i = 0; i < na * 2; i++)
+                    worst = (std::max)(worst, fabsf(ref[i] - out[i]));
+            }
+            resampler_sinc_free(a);
+            resampler_sinc_free(b);
+        }
+        printf("%-7s max error vs c %g\n", resampler_sinc_simd_name(simd), worst);
+        ok = ok && worst < RESAMPLER_MAX_ERR;
+    }
+    return ok;
+}
+
+static void resampler_bench_speed(const float *in)
+{
+    static const double bandwidths[] = { 1.0, 0.5, 0.25 };
+    vector<float> out(RESAMPLER_FRAMES * 2 * 2 + 64);
+    for (size_t w = 0; w < sizeof(bandwidths) / sizeof(*bandwidths); w++)
+        for (size_t k = 0; k < sizeof(resampler_kernels) / sizeof(*resampler_kernels); k++)
+        {
+            if (!resampler_sinc_simd_supported(resampler_kernels[k]))
+                continue;
+            void *re = resampler_sinc_init_simd(bandwidths[w], RESAMPLER_QUALITY_NORMAL, resampler_kernels[k]);
+            // 44.1k -> 48k for the audio path width, matching downsample otherwise
+            double ratio = bandwidths[w] < 1.0 ? bandwidths[w] : 48000.0 / 44100.0;
+            size_t frames = 0;
+            long long start = microseconds_now(), now;
+            do
+            {
+                resampler_bench_run(re, in, &out[0], ratio);
+                frames += RESAMPLER_FRAMES;
+            } while ((now = microseconds_now()) - start < RESAMPLER_RUN_US);
+            printf("bandwidth %.2f %-7s taps %3u: %7.2f Mframes/s in\n", bandwidths[w],
+                resampler_sinc_simd_name(resampler_kernels[k]), resampler_sinc_get_taps(re),
+                (double)frames / (now - start));
+            resampler_sinc_free(re);
+        }
+}
+
+static bool resampler_bench_convert()
+{
+    vector<int16_t> in(65536 + 7);
+    for (size_t i = 0; i < in.size(); i++)
+        in[i] = (int16_t)(i - 32768);
+    vector<float> ref(in.size()), sse(in.size()), avx(in.size());
+    mal_pcm_s16_to_f32(&ref[0], &in[0], in.size(), mal_dither_mode_none);
+    audio_s16_to_f32_sse2(&sse[0], &in[0], in.size());
+    bool ok = !memcmp(&ref[0], &sse[0], ref.size() * sizeof(float));
+    printf("s16->f32 sse2 %s\n", ok ? "exact" : "MISMATCH");
+    if (cpu_features() & CPU_AVX2)
+    {
+        audio_s16_to_f32_avx2(&avx[0], &in[0], in.size());
+        bool same = !memcmp(&ref[0], &avx[0], ref.size() * sizeof(float));
+        printf("s16->f32 avx2 %s\n", same ? "exact" : "MISMATCH");
+        ok = ok && same;
+    }
+    return ok;
+}
+
+// every engine and sinc preset at 44.1k -> 48k, plus what the table cache
+// saves when the same resampler is created again on content reload
+static void resampler_bench_engines(const float *in)
+{
+    vector<float> out(RESAMPLER_FRAMES * 2 * 2 + 64);
+    for (int e = RESAMPLER_NEAREST; e <= RESAMPLER_SINC; e++)
+        for (int q = RESAMPLER_QUALITY_LOWEST; q <= RESAMPLER_QUALITY_HIGHEST; q++)
+        {
+            if (e != RESAMPLER_SINC && q != RESAMPLER_QUALITY_LOWEST)
+                break;
+            long long start = microseconds_now();
+            void *re = resampler_init((resampler_engine)e, (resampler_quality)q, 48000.0 / 44100.0);
+            long long first = microseconds_now() - start;
+            resampler_free(re);
+            start = microseconds_now();
+            re = resampler_init((resampler_engine)e, (resampler_quality)q, 48000.0 / 44100.0);
+            long long again = microseconds_now() - start;
+
+            size_t frames = 0;
+            long long now;
+            start = microseconds_now();
+            do
+            {
+                struct resampler_data data = { 0 };
+                data.data_in = in;
+                data.data_out = &out[0];
+                data.input_frames = RESAMPLER_FRAMES;
+                data.ratio = 48000.0 / 44100.0;
+                resampler_process(re, &data);
+                frames += RESAMPLER_FRAMES;
+            } while ((now = microseconds_now()) - start < RESAMPLER_RUN_US);
+            printf("%-7s %-7s: %8.2f Mframes/s in, init %lld us, cached %lld us\n",
+                resampler_engine_name((resampler_engine)e),
+                e == RESAMPLER_SINC ? resampler_quality_name((resampler_quality)q) : "",
+                (double)frames / (now - start), first, again);
+            resampler_free(re);
+        }
+}
+
+static int bench_resampler()
+{
+    vector<float> in(RESAMPLER_FRAMES * 2);
+    unsigned seed = 1;
+    for (size_t i = 0; i < in.size(); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        in[i] = (float)((seed >> 8) & 0xffff) / 32768.0f - 1.0f;
+    }
+    void *re = resampler_sinc_init(1.0);
+    printf("auto kernel: %s\n", resampler_sinc_simd_name(resampler_sinc_get_simd(re)));
+    resampler_sinc_free(re);
+    bool ok = resampler_bench_accuracy(&in[0]);
+    ok = resampler_bench_convert() && ok;
+    resampler_bench_speed(&in[0]);
+    resampler_bench_engines(&in[0]);
+    return ok ? 0 : 1;
+}
+
+// pixconv: every SIMD kernel against the scalar one on every 16 bit
+// value, at odd widths and padded pitches so the tails and per-row
+// offsets are covered, then throughput on a 640x480 frame.
+
+#define PIXCONV_W      640
+#define PIXCONV_H      480
+#define PIXCONV_RUN_US 500000
+
+static const char *pixconv_format_names[] = { "0rgb1555", "xrgb8888", "rgb565" };
+
+static bool pixconv_bench_exact(unsigned format, enum pixconv_simd simd, const vector<uint8_t> &src)
+{
+    size_t bpp = format == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2;
+    static const unsigned widths[] = { 1, 7, 15, 17, 33, 257, 320 };
+    bool ok = true;
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+        unsigned width = widths[w];
+        size_t pitch = width * bpp + 6 * bpp;
+        unsigned height = (unsigned)(src.size() / pitch);
+        vector<uint32_t> ref(width * height), out(width * height + 1, 0xdeadbeef);
+        for (unsigned y = 0; y < height; y++)
+        {
+            pixconv_row(format, PIXCONV_SIMD_C)(&ref[y * width], &src[y * pitch], width);
+            pixconv_row(format, simd)(&out[y * width], &src[y * pitch], width);
+        }
+        ok = ok && !memcmp(&ref[0], &out[0], ref.size() * 4) && out[ref.size()] == 0xdeadbeef;
+    }
+    return ok;
+}
+
+static int bench_pixconv()
+{
+    // all 65536 16 bit pixels, or as many random 32 bit ones, plus slack
+    vector<uint8_t> src(65536 * 4 + 4096);
+    unsigned seed = 1;
+    for (size_t i = 0; i < src.size() / 2; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        uint16_t v = i < 65536 ? (uint16_t)i : (uint16_t)(seed >> 16);
+        memcpy(&src[i * 2], &v, 2);
+    }
+    uint32_t lo, hi;
+    uint16_t black = 0, white = 0xffff;
+    pixconv_row(RETRO_PIXEL_FORMAT_RGB565, PIXCONV_SIMD_C)(&lo, &black, 1);
+    pixconv_row(RETRO_PIXEL_FORMAT_RGB565, PIXCONV_SIMD_C)(&hi, &white, 1);
+    bool ok = lo == 0xff000000u && hi == 0xffffffffu;
+    printf("rgb565 range  %s\n", ok ? "0..255" : "WRONG");
+
+    unsigned features = cpu_features();
+    printf("auto kernel: %s\n", pixconv_simd_name(pixconv_best_simd()));
+    for (unsigned f = RETRO_PIXEL_FORMAT_0RGB1555; f <= RETRO_PIXEL_FORMAT_RGB565; f++)
+        for (int s = PIXCONV_SIMD_SSE2; s <= PIXCONV_SIMD_AVX2; s++)
+        {
+            if (s == PIXCONV_SIMD_AVX2 && !(features & CPU_AVX2))
+                continue;
+            bool same = pixconv_bench_exact(f, (enum pixconv_simd)s, src);
+            printf("%-8s %-4s %s\n", pixconv_format_names[f],
+                pixconv_simd_name((enum pixconv_simd)s), same ? "exact" : "MISMATCH");
+            ok = ok && same;
+        }
+
+    vector<uint32_t> frame(PIXCONV_W * PIXCONV_H);
+    for (unsigned f = RETRO_PIXEL_FORMAT_0RGB1555; f <= RETRO_PIXEL_FORMAT_RGB565; f++)
+        for (int s = PIXCONV_SIMD_C; s <= PIXCONV_SIMD_AVX2; s++)
+        {
+            if (s == PIXCONV_SIMD_AVX2 && !(features & CPU_AVX2))
+                continue;
+            pixconv_row_fn row = pixconv_row(f, (enum pixconv_simd)s);
+            size_t pitch = PIXCONV_W * (f == RETRO_PIXEL_FORMAT_XRGB8888 ? 4 : 2);
+            unsigned frames = 0;
+            long long now, start = microseconds_now();
+            do
+            {
+                for (unsigned y = 0; y < PIXCONV_H; y++)
+                    row(&frame[y * PIXCONV_W], &src[(y * pitch) % (65536 * 2)], PIXCONV_W);
+                frames++;
+            } while ((now = microseconds_now()) - start < PIXCONV_RUN_US);
+            printf("%-8s %-4s: %8.1f Mpixels/s, %.3f ms per %ux%u frame\n", pixconv_format_names[f],
+                pixconv_simd_name((enum pixconv_simd)s), (double)frames * PIXCONV_W * PIXCONV_H / (now - start),
+                (now - start) / 1000.0 / frames, PIXCONV_W, PIXCONV_H);
+        }
+    return ok ? 0 : 1;
+}
+
+// rewind: a 1 MB state where each capture rewrites a few scattered spans
+// and a counter, pushed into an 8 MB history. Every step back is checked
+// against a full copy kept of the recent states, and the history must
+// reach back past the budget's worth of full states.
+
+#define REWIND_STATE  (1 << 20)
+#define REWIND_BUDGET (8 << 20)
+#define REWIND_PUSHES 5000
+#define REWIND_KEPT   256
+
+static int bench_rewind()
+{
+    rewind_buffer rb;
+    if (!rewind_init(&rb, REWIND_STATE, REWIND_BUDGET))
+        return 1;
+    vector<uint8_t> state(REWIND_STATE);
+    vector<vector<uint8_t> > kept(REWIND_KEPT);
+    unsigned seed = 1;
+    for (size_t i = 0; i < state.size(); i++)
+        state[i] = (uint8_t)(i * 7 / 4096);
+    long long push_total = 0, push_max = 0;
+    for (unsigned n = 0; n < REWIND_PUSHES; n++)
+    {
+        for (unsigned span = 0; span < 16; span++)
+        {
+            seed = seed * 1103515245 + 12345;
+            size_t at = (seed >> 8) % (REWIND_STATE - 256);
+            for (size_t i = 0; i < 256; i++)
+                state[at + i] = (uint8_t)(seed + i);
+        }
+        memcpy(&state[64], &n, sizeof(n));
+        kept[n % REWIND_KEPT] = state;
+        long long start = microseconds_now();
+        rewind_push(&rb, &state[0]);
+        long long took = microseconds_now() - start;
+        push_total += took;
+        push_max = max(push_max, took);
+    }
+    printf("push:  %.3f ms mean, %.3f ms max, %.0f MB/s\n", push_total / 1000.0 / REWIND_PUSHES,
+        push_max / 1000.0, (double)REWIND_STATE * REWIND_PUSHES / push_total);
+    printf("held:  %u states in %.2f MB, %.1fx compression\n", rb.count, rb.used / 1048576.0,
+        (double)rb.raw_bytes / rb.coded_bytes);
+
+    bool ok = rb.count > REWIND_BUDGET / REWIND_STATE;
+    unsigned steps = 0;
+    long long pop_max = 0;
+    const uint8_t *back;
+    for (;;)
+    {
+        long long start = microseconds_now();
+        back = rewind_pop(&rb);
+        pop_max = max(pop_max, microseconds_now() - start);
+        if (!back)
+            break;
+        steps++;
+        if (steps < REWIND_KEPT)
+            ok = ok && !memcmp(back, &kept[(REWIND_PUSHES - 1 - steps) % REWIND_KEPT][0], REWIND_STATE);
+    }
+    printf("steps: %u back, %.3f ms max, %s\n", steps, pop_max / 1000.0, ok ? "exact" : "MISMATCH");
+    rewind_free(&rb);
+    return ok ? 0 : 1;
+}
+
+// states: the savestate file format. A mostly zero state with scattered
+// spans of noise, like a console's RAM, goes through each codec and must
+// come back exact. Files without the header must come back as they are,
+// as older builds wrote them, and a header whose size doesn't match the
+// data must be refused.
+
+#define STATES_SIZE   (1 << 20)
+#define STATES_ROUNDS 20
+
+static const char *state_codec_names[] = { "raw", "zero runs", "zlib" };
+
+static bool states_bench_codec(state_codec codec, const vector<uint8_t> &state)
+{
+    vector<uint8_t> file, back;
+    long long encode_us = 0, decode_us = 0;
+    bool ok = true;
+    for (unsigned n = 0; n < STATES_ROUNDS && ok; n++)
+    {
+        long long start = microseconds_now();
+        if (!state_encode(file, &state[0], state.size(), codec))
+        {
+            // zlib is left out of builds without HAVE_ZLIB_H
+            if (codec == STATE_CODEC_ZLIB)
+            {
+                printf("%-10s not in this build\n", state_codec_names[codec]);
+                return true;
+            }
+            ok = false;
+            break;
+        }
+        long long mid = microseconds_now();
+        ok = state_decode(back, &file[0], file.size()) && back == state;
+        encode_us += mid - start;
+        decode_us += microseconds_now() - mid;
+    }
+    double mb = (double)STATES_SIZE * STATES_ROUNDS;
+    printf("%-10s %.2fx, encode %.0f MB/s, decode %.0f MB/s, %s\n", state_codec_names[codec],
+        (double)state.size() / file.size(), mb / max(encode_us, 1LL), mb / max(decode_us, 1LL), ok ? "exact" : "MISMATCH");
+    return ok;
+}
+
+static int bench_states()
+{
+    vector<uint8_t> state(STATES_SIZE, 0);
+    unsigned seed = 1;
+    for (unsigned span = 0; span < 256; span++)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t at = (seed >> 8) % (STATES_SIZE - 512);
+        for (size_t i = 0; i < 512; i++)
+            state[at + i] = (uint8_t)((seed >> 16) + i * 3);
+    }
+    bool ok = true;
+    for (int c = STATE_CODEC_RAW; c <= STATE_CODEC_ZLIB; c++)
+        ok = states_bench_codec((state_codec)c, state) && ok;
+
+    // headerless files, long and shorter than a header, are raw states
+    vector<uint8_t> back;
+    bool raw = state_decode(back, &state[0], state.size()) && back == state;
+    const uint8_t tiny[5] = { 'E', 'W', 'S', 'T', 1 };
+    raw = raw && state_decode(back, tiny, sizeof(tiny)) && back == vector<uint8_t>(tiny, tiny + sizeof(tiny));
+    // a raw file cut short no longer matches the size in its header
+    vector<uint8_t> file;
+    bool refused = state_encode(file, &state[0], state.size(), STATE_CODEC_RAW) &&
+        !state_decode(back, &file[0], file.size() - 1);
+    printf("headerless: %s, truncated: %s\n", raw ? "read raw" : "MISREAD", refused ? "refused" : "ACCEPTED");
+    return ok && raw && refused ? 0 : 1;
+}
+
+// movie: ten minutes of input that changes every few dozen frames is
+// recorded with a keyframe every ten seconds, written out and opened
+// again. Every frame's input and every keyframe must come back, each
+// frame must find the keyframe at or before it, and a file cut short
+// must be refused.
+
+#define MOVIE_FRAMES   36000
+#define MOVIE_INTERVAL 600
+#define MOVIE_STATE    (64 << 10)
+#define MOVIE_PATH     _T("bench_movie.ewm")
+
+static void movie_bench_state(vector<uint8_t> &state, unsigned frame)
+{
+    state.assign(MOVIE_STATE, 0);
+    memcpy(&state[0], &frame, sizeof(frame));
+    for (size_t i = frame % 4096; i < MOVIE_STATE; i += 4096)
+        state[i] = (uint8_t)(frame + i);
+}
+
+static bool movie_bench_truncated(unsigned long long size)
+{
+    FILE *in = _tfopen(MOVIE_PATH, _T("rb"));
+    FILE *out = _tfopen(MOVIE_PATH _T(".cut"), _T("wb"));
+    bool ok = in && out;
+    for (unsigned long long i = 0; ok && i + 1 < size; i++)
+        ok = fputc(fgetc(in), out) != EOF;
+    if (in)fclose(in);
+    if (out)fclose(out);
+    movie *m = ok ? movie_open(MOVIE_PATH _T(".cut")) : NULL;
+    movie_close(m);
+    _tremove(MOVIE_PATH _T(".cut"));
+    return ok && !m;
+}
+
+static int bench_movie()
+{
+    vector<movie_input> inputs(MOVIE_FRAMES);
+    vector<uint8_t> state, back;
+    movie_input in;
+    memset(&in, 0, sizeof(in));
+    unsigned seed = 1;
+    long long start = microseconds_now();
+    movie *m = movie_create(MOVIE_PATH, MOVIE_INTERVAL);
+    if (!m)
+    {
+        printf("Couldn't create the movie.\n");
+        return 1;
+    }
+    bool ok = true;
+    for (unsigned f = 0; f < MOVIE_FRAMES && ok; f++)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (!((seed >> 16) % 37))
+        {
+            in.table.slot[(seed >> 8) % INPUT_SLOTS] ^= 1;
+            in.mouse_buttons = (seed >> 4) & 3;
+        }
+        if (movie_wants_keyframe(m))
+        {
+            movie_bench_state(state, f);
+            ok = movie_add_keyframe(m, &state[0], state.size());
+        }
+        movie_add_input(m, &in);
+        inputs[f] = in;
+    }
+    size_t runs = m->runs.size();
+    ok = movie_close(m) && ok;
+    long long record_us = microseconds_now() - start;
+    long size = plat_file_size(MOVIE_PATH);
+
+    start = microseconds_now();
+    m = ok ? movie_open(MOVIE_PATH) : NULL;
+    long long open_us = microseconds_now() - start;
+    unsigned keyframes = 0, wrong = 0;
+    long long seek_us = 0;
+    if (m)
+    {
+        ok = m->frames == MOVIE_FRAMES && m->keyframes.size() == (MOVIE_FRAMES + MOVIE_INTERVAL - 1) / MOVIE_INTERVAL &&
+            !movie_input_at(m, MOVIE_FRAMES);
+        keyframes = (unsigned)m->keyframes.size();
+        for (unsigned f = 0; f < MOVIE_FRAMES; f++)
+        {
+            const movie_input *at = movie_input_at(m, f);
+            const movie_keyframe *k = movie_keyframe_at(m, f);
+            if (!at || memcmp(at, &inputs[f], sizeof(movie_input)) || !k || k->frame != f - f % MOVIE_INTERVAL)
+                wrong++;
+        }
+        for (unsigned i = 0; i < keyframes; i++)
+        {
+            long long t = microseconds_now();
+            bool read = movie_read_keyframe(m, &m->keyframes[i], back);
+            seek_us += microseconds_now() - t;
+            movie_bench_state(state, m->keyframes[i].frame);
+            if (!read || back != state)
+                wrong++;
+        }
+        movie_close(m);
+    }
+    ok = ok && m && !wrong;
+    bool refused = size > 0 && movie_bench_truncated((unsigned long long)size);
+    _tremove(MOVIE_PATH);
+    printf("record: %u frames in %u runs, %u keyframes, %.1f KB, %.3f ms\n", MOVIE_FRAMES, (unsigned)runs, keyframes,
+        size / 1024.0, record_us / 1000.0);
+    printf("open:   %.3f ms, keyframe read %.3f ms mean\n", open_us / 1000.0, keyframes ? seek_us / 1000.0 / keyframes : 0.0);
+    printf("replay: %s, %u wrong; truncated: %s\n", ok ? "exact" : "MISMATCH", wrong, refused ? "refused" : "ACCEPTED");
+    return ok && refused ? 0 : 1;
+}
+
+// script: a short input script using each kind of control and action, with
+// comments and blank lines, must play back the events it describes on the
+// frames it gives. Scripts with a bad line must be refused, naming the
+// line. Then a long generated script is loaded and played for timing.
+
+#define SCRIPT_PATH  _T("bench_script.txt")
+#define SCRIPT_LINES 100000
+
+struct script_bench_event
+{
+    unsigned frame;
+    dinput::di_event::event_type type;
+    unsigned serial, which; // serial 0xfffffff is the script's own pad
+    bool down;
+};
+
+static const char *script_bench_text =
+    "# title screen\n"
+    "60 start tap\n"
+    "\n"
+    "120 a down\n"
+    "180 a up   # let go\n"
+    "200 key:28 tap 3\n"
+    "240 joy:1:5 down\n";
+
+static const script_bench_event script_bench_expected[] = {
+    { 60, dinput::di_event::ev_joy, 0xfffffff, 3, true },
+    { 61, dinput::di_event::ev_joy, 0xfffffff, 3, false },
+    { 120, dinput::di_event::ev_joy, 0xfffffff, 8, true },
+    { 180, dinput::di_event::ev_joy, 0xfffffff, 8, false },
+    { 200, dinput::di_event::ev_key, 0, 28, true },
+    { 203, dinput::di_event::ev_key, 0, 28, false },
+    { 240, dinput::di_event::ev_joy, 1, 5, true },
+};
+
+// each is refused at its third line
+static const char *script_bench_bad[] = {
+    "1 a down\n# fine so far\n2 a hold\n",
+    "1 a down\n\n2 turbo down\n",
+    "1 a down\n2 a up\n3 a tap 0\n",
+    "1 a down\n2 a up\n3 a\n",
+    "1 a down\n2 a up\nl0 start tap\n",
+    "1 a down\n\t\nstart tap\n",
+};
+
+static bool script_bench_write(const char *text)
+{
+    FILE *fp = _tfopen(SCRIPT_PATH, _T("w"));
+    if (!fp)
+        return false;
+    bool ok = fputs(text, fp) >= 0;
+    return !fclose(fp) && ok;
+}
+
+static bool script_bench_matches(const dinput::di_event &e, unsigned frame, const script_bench_event &x)
+{
+    if (frame != x.frame || e.type != x.type)
+        return false;
+    if (e.type == dinput::di_event::ev_key)
+        return e.key.which == x.which && (e.key.type == dinput::di_event::key_down) == x.down;
+    return e.joy.type == dinput::di_event::joy_button && e.joy.serial == x.serial && e.joy.which == x.which &&
+        (e.joy.button == dinput::di_event::button_down) == x.down;
+}
+
+static int bench_script()
+{
+    const unsigned expected = sizeof(script_bench_expected) / sizeof(script_bench_expected[0]);
+    dinput_script *script = create_dinput_script();
+    dinput::di_event_ring events;
+    dinput::di_event e;
+    bool ok = script_bench_write(script_bench_text) && !script->load(SCRIPT_PATH) && script->get_count() == expected;
+    unsigned played = 0;
+    for (unsigned frame = 0; ok && frame < 300; frame++)
+    {
+        script->set_frame(frame);
+        script->read(events);
+        while (ok && events.pop(e))
+            ok = played < expected && script_bench_matches(e, frame, script_bench_expected[played++]);
+    }
+    ok = ok && played == expected && script->get_played() == expected;
+    printf("script: %u of %u events played, %s\n", played, expected, ok ? "exact" : "MISMATCH");
+
+    unsigned refused = 0;
+    const unsigned bad = sizeof(script_bench_bad) / sizeof(script_bench_bad[0]);
+    for (unsigned i = 0; i < bad; i++)
+    {
+        const char *err = script_bench_write(script_bench_bad[i]) ? script->load(SCRIPT_PATH) : NULL;
+        if (err && strstr(err, "line 3:"))
+            refused++;
+        else
+            printf("bad script %u: %s\n", i, err ? err : "ACCEPTED");
+    }
+    printf("errors: %u of %u bad scripts refused at the right line\n", refused, bad);
+
+    // a tap every frame on a button that cycles through the pad
+    static const char *buttons[] = { "b", "y", "up", "down", "left", "right", "a", "x", "l", "r" };
+    FILE *fp = _tfopen(SCRIPT_PATH, _T("w"));
+    bool wrote = fp != NULL;
+    for (unsigned i = 0; wrote && i < SCRIPT_LINES; i++)
+        wrote = fprintf(fp, "%u %s tap\n", i * 2, buttons[i % 10]) > 0;
+    if (fp)wrote = !fclose(fp) && wrote;
+    long long start = microseconds_now();
+    bool loaded = wrote && !script->load(SCRIPT_PATH) && script->get_count() == SCRIPT_LINES * 2;
+    long long load_us = microseconds_now() - start;
+    start = microseconds_now();
+    for (unsigned frame = 0; loaded && frame <= SCRIPT_LINES * 2; frame++)
+    {
+        script->set_frame(frame);
+        script->read(events);
+        events.clear();
+    }
+    long long play_us = microseconds_now() - start;
+    loaded = loaded && script->get_played() == SCRIPT_LINES * 2;
+    printf("load:   %u lines, %.3f ms; play %.1f ns/frame, %s\n", SCRIPT_LINES, load_us / 1000.0,
+        play_us * 1000.0 / (SCRIPT_LINES * 2), loaded ? "all played" : "MISSED EVENTS");
+    _tremove(SCRIPT_PATH);
+    delete script;
+    return ok && refused == bad && loaded ? 0 : 1;
+}
+
+// input: a pad mapped the usual way, 16 buttons on keys and both sticks
+// on axes with a bind per direction, 24 binds in all. Each frame some
+// keys and axes move, then the core's 16 button and 4 axis queries are
+// answered by the old scan over every bind and from the table. The
+// answers must agree. Each way is timed over all the frames, less a pass
+// that only applies the events; the table's time includes rebuilding it.
+
+#define INPUT_FRAMES 200000
+
+static int16_t input_bench_scan(bind_list *bl, unsigned device, unsigned index, unsigned id)
+{
+    for (unsigned i = 0; i < bl->get_count(); i++)
+    {
+        int retro_id = 0;
+        int16_t value = 0;
+        bool isanalog = false;
+        bl->getbutton(i, value, retro_id, isanalog);
+        if (device == RETRO_DEVICE_ANALOG)
+        {
+            if (value <= -0x8000)value = -0x7fff;
+            if (index == RETRO_DEVICE_INDEX_ANALOG_LEFT)
+            {
+                if ((id == RETRO_DEVICE_ID_ANALOG_X && retro_id == 16) || (id == RETRO_DEVICE_ID_ANALOG_Y && retro_id == 17))
+                    return isanalog ? -value : value;
+            }
+            else if ((id == RETRO_DEVICE_ID_ANALOG_X && retro_id == 18) || (id == RETRO_DEVICE_ID_ANALOG_Y && retro_id == 19))
+                return isanalog ? -value : value;
+        }
+        else
+        {
+            value = abs(value);
+            if (retro_id == (int)id)return value;
+        }
+    }
+    return 0;
+}
+
+static void input_bench_events(dinput::di_event_ring &events, unsigned frame)
+{
+    dinput::di_event e = {};
+    e.type = dinput::di_event::ev_key;
+    e.key.which = 0x10 + frame % 16;
+    e.key.type = (frame / 16) & 1 ? dinput::di_event::key_up : dinput::di_event::key_down;
+    events.push(e);
+    e = dinput::di_event();
+    e.type = dinput::di_event::ev_joy;
+    e.joy.type = dinput::di_event::joy_axis;
+    e.joy.which = frame % 4;
+    e.joy.axis = (dinput::di_event::axis_motion)(frame / 4 % 3);
+    e.joy.value = (frame * 2654435761u) >> 16;
+    events.push(e);
+}
+
+static int bench_input()
+{
+    guid_container *guids = create_guid_container();
+    bind_list *bl = create_bind_list(guids);
+    TCHAR name[64] = _T("bench");
+    dinput::di_event e = {};
+    for (unsigned id = 0; id < 16; id++)
+    {
+        e = dinput::di_event();
+        e.type = dinput::di_event::ev_key;
+        e.key.which = 0x10 + id;
+        bl->add(e, bl->get_count(), name, id);
+    }
+    for (unsigned axis = 0; axis < 4; axis++)
+        for (unsigned dir = dinput::di_event::axis_negative; dir <= dinput::di_event::axis_positive; dir++)
+        {
+            e = dinput::di_event();
+            e.type = dinput::di_event::ev_joy;
+            e.joy.type = dinput::di_event::joy_axis;
+            e.joy.which = axis;
+            e.joy.axis = (dinput::di_event::axis_motion)dir;
+            bl->add(e, bl->get_count(), name, 16 + axis);
+        }
+    printf("binds: %u, %u bytes of state each (%u with the config)\n", bl->get_count(),
+        (unsigned)sizeof(bind_list::bind_state), (unsigned)(sizeof(bind_list::bind) + sizeof(bind_list::bind_state)));
+
+    struct query { unsigned device, index, id; };
+    vector<query> queries;
+    for (unsigned id = 0; id < 16; id++)
+        queries.push_back({ RETRO_DEVICE_JOYPAD, 0, id });
+    for (unsigned index = RETRO_DEVICE_INDEX_ANALOG_LEFT; index <= RETRO_DEVICE_INDEX_ANALOG_RIGHT; index++)
+        for (unsigned id = RETRO_DEVICE_ID_ANALOG_X; id <= RETRO_DEVICE_ID_ANALOG_Y; id++)
+            queries.push_back({ RETRO_DEVICE_ANALOG, index, id });
+
+    dinput::di_event_ring events;
+    input_table table;
+    bool ok = true;
+    unsigned pressed = 0;
+    for (unsigned frame = 0; frame < INPUT_FRAMES; frame++)
+    {
+        input_bench_events(events, frame);
+        bl->process(events);
+        input_table_build(&table, bl);
+        for (size_t q = 0; q < queries.size(); q++)
+        {
+            int slot = input_slot(queries[q].device, queries[q].index, queries[q].id);
+            int16_t want = input_bench_scan(bl, queries[q].device, queries[q].index, queries[q].id);
+            ok = ok && slot >= 0 && table.slot[slot] == want;
+            pressed += want != 0;
+        }
+    }
+    printf("queries: %u per frame, %u nonzero answers, %s\n", (unsigned)queries.size(), pressed,
+        ok ? "same from both" : "MISMATCH");
+
+    // 0: events only, 1: scan, 2: table
+    long long pass_us[3];
+    volatile int sink = 0;
+    for (int pass = 0; pass < 3; pass++)
+    {
+        long long start = microseconds_now();
+        for (unsigned frame = 0; frame < INPUT_FRAMES; frame++)
+        {
+            input_bench_events(events, frame);
+            bl->process(events);
+            int sum = 0;
+            if (pass == 1)
+                for (size_t q = 0; q < queries.size(); q++)
+                    sum += input_bench_scan(bl, queries[q].device, queries[q].index, queries[q].id);
+            else if (pass == 2)
+            {
+                input_table_build(&table, bl);
+                for (size_t q = 0; q < queries.size(); q++)
+                {
+                    int slot = input_slot(queries[q].device, queries[q].index, queries[q].id);
+                    sum += slot < 0 ? 0 : table.slot[slot];
+                }
+            }
+            sink += sum;
+        }
+        pass_us[pass] = microseconds_now() - start;
+    }
+    printf("scan:  %.1f ns/frame\n", (pass_us[1] - pass_us[0]) * 1000.0 / INPUT_FRAMES);
+    printf("table: %.1f ns/frame including the rebuild\n", (pass_us[2] - pass_us[0]) * 1000.0 / INPUT_FRAMES);
+    delete bl;
+    delete guids;
+    return ok ? 0 : 1;
+}
+
+// events: pads of 16 buttons and 4 axes (a bind per direction, 24 binds
+// a pad) fed 8 random button and axis events a frame through the event
+// ring, with 1 and then 10 pads bound. Dispatch cost per event should
+// stay flat as binds are added. The binds a few known events land on are
+// checked first.
+
+#define EVENTS_FRAMES    100000
+#define EVENTS_PER_FRAME 8
+
+static bind_list *events_bench_binds(guid_container *guids, unsigned pads)
+{
+    bind_list *bl = create_bind_list(guids);
+    TCHAR name[64] = _T("bench");
+    for (unsigned pad = 0; pad < pads; pad++)
+    {
+        dinput::di_event e = dinput::di_event();
+        e.type = dinput::di_event::ev_joy;
+        e.joy.serial = pad;
+        e.joy.type = dinput::di_event::joy_button;
+        for (unsigned button = 0; button < 16; button++)
+        {
+            e.joy.which = button;
+            bl->add(e, bl->get_count(), name, button);
+        }
+        e.joy.type = dinput::di_event::joy_axis;
+        for (unsigned axis = 0; axis < 4; axis++)
+            for (unsigned dir = dinput::di_event::axis_negative; dir <= dinput::di_event::axis_positive; dir++)
+            {
+                e.joy.which = axis;
+                e.joy.axis = (dinput::di_event::axis_motion)dir;
+                bl->add(e, bl->get_count(), name, 16 + axis);
+            }
+    }
+    return bl;
+}
+
+static bool events_bench_pressed(bind_list *bl, unsigned which)
+{
+    int16_t value;
+    int retro_id;
+    bool analog;
+    return bl->getbutton(which, value, retro_id, analog);
+}
+
+static bool events_bench_check(guid_container *guids)
+{
+    bind_list *bl = events_bench_binds(guids, 2);
+    dinput::di_event_ring ring;
+    dinput::di_event e = dinput::di_event();
+    e.type = dinput::di_event::ev_joy;
+    e.joy.serial = 1;
+    e.joy.type = dinput::di_event::joy_button;
+    e.joy.which = 3;
+    e.joy.button = dinput::di_event::button_down;
+    ring.push(e);
+    e.joy.type = dinput::di_event::joy_axis;
+    e.joy.which = 2;
+    e.joy.axis = dinput::di_event::axis_positive;
+    e.joy.value = 0xf000;
+    ring.push(e);
+    bl->process(ring);
+    // pad 1 starts at bind 24; its axis 2 binds are 16 + 2 * 2 on
+    bool ok = ring.size() == 0 && events_bench_pressed(bl, 24 + 3) && !events_bench_pressed(bl, 3) &&
+        events_bench_pressed(bl, 24 + 21) && !events_bench_pressed(bl, 24 + 20) && !events_bench_pressed(bl, 21);
+    e.joy.axis = dinput::di_event::axis_negative;
+    ring.push(e);
+    e.joy.type = dinput::di_event::joy_button;
+    e.joy.which = 3;
+    e.joy.button = dinput::di_event::button_up;
+    ring.push(e);
+    bl->process(ring);
+    ok = ok && !events_bench_pressed(bl, 24 + 3) && events_bench_pressed(bl, 24 + 20) && !events_bench_pressed(bl, 24 + 21);
+    delete bl;
+    return ok;
+}
+
+static int bench_events()
+{
+    guid_container *guids = create_guid_container();
+    bool ok = events_bench_check(guids);
+    printf("dispatch: %s\n", ok ? "right binds" : "WRONG");
+    dinput::di_event_ring ring;
+    for (unsigned pads = 1; pads <= 10; pads *= 10)
+    {
+        bind_list *bl = events_bench_binds(guids, pads);
+        unsigned seed = 1;
+        long long start = microseconds_now();
+        for (unsigned frame = 0; frame < EVENTS_FRAMES; frame++)
+        {
+            for (unsigned i = 0; i < EVENTS_PER_FRAME; i++)
+            {
+                seed = seed * 1103515245 + 12345;
+                dinput::di_event e = dinput::di_event();
+                e.type = dinput::di_event::ev_joy;
+                e.joy.serial = (seed >> 8) % pads;
+                e.joy.which = (seed >> 17) % 16;
+                if ((seed >> 16) & 1)
+                {
+                    e.joy.type = dinput::di_event::joy_button;
+                    e.joy.button = (dinput::di_event::button_motion)((seed >> 21) & 1);
+                }
+                else
+                {
+                    e.joy.type = dinput::di_event::joy_axis;
+                    e.joy.which %= 4;
+                    e.joy.axis = (dinput::di_event::axis_motion)((seed >> 21) % 3);
+                    e.joy.value = seed >> 16;
+                }
+                ring.push(e);
+            }
+            bl->process(ring);
+        }
+        long long took = microseconds_now() - start;
+        printf("%3u binds: %.1f ns/event\n", bl->get_count(), took * 1000.0 / EVENTS_FRAMES / EVENTS_PER_FRAME);
+        delete bl;
+    }
+    ok = ok && !ring.dropped;
+    delete guids;
+    return ok ? 0 : 1;
+}
+
+// sampler: first the sequence lock alone, a writer publishing snapshots
+// back to back against a reader copying them, every field of a snapshot
+// carrying the same number so a torn copy shows. Then the input sampler
+// itself at 1 kHz (with no devices), polled like a 60 fps core would:
+// the age of what each poll sees should stay under a millisecond, where
+// reading once a frame leaves a press up to 16.7 ms old.
+
+#define SAMPLER_READS   2000000
+#define SAMPLER_POLLS   60
+#define SAMPLER_HZ      1000
+
+struct sampler_bench
+{
+    input_seqlock sl;
+    std::atomic<bool> done;
+    unsigned published;
+};
+
+static void sampler_bench_fill(input_snapshot *s, unsigned n)
+{
+    for (unsigned i = 0; i < INPUT_SLOTS; i++)
+    {
+        s->table.slot[i] = (int16_t)n;
+        s->changed_us[i] = n;
+    }
+    s->sampled_us = s->event_us = n;
+    s->mouse_x = s->mouse_y = (int32_t)n;
+    s->samples = n;
+}
+
+static bool sampler_bench_whole(const input_snapshot *s)
+{
+    unsigned n = s->samples;
+    for (unsigned i = 0; i < INPUT_SLOTS; i++)
+        if (s->table.slot[i] != (int16_t)n || s->changed_us[i] != n)
+            return false;
+    return s->sampled_us == n && s->event_us == n && s->mouse_x == (int32_t)n && s->mouse_y == (int32_t)n;
+}
+
+static void sampler_bench_writer(void *data)
+{
+    sampler_bench *b = (sampler_bench*)data;
+    input_snapshot s;
+    memset(&s, 0, sizeof(s));
+    while (!b->done.load())
+    {
+        sampler_bench_fill(&s, ++b->published);
+        seqlock_write(&b->sl, &s);
+    }
+}
+
+static int bench_sampler()
+{
+    sampler_bench b;
+    seqlock_init(&b.sl);
+    b.done = false;
+    b.published = 0;
+    sthread_t *writer = sthread_create(sampler_bench_writer, &b);
+    unsigned errors = 0, last = 0;
+    unsigned long long torn = 0;
+    input_snapshot s;
+    long long start = microseconds_now();
+    for (unsigned i = 0; i < SAMPLER_READS; i++)
+    {
+        torn += seqlock_read(&b.sl, &s);
+        if (!sampler_bench_whole(&s) || s.samples < last)
+            errors++;
+        last = s.samples;
+    }
+    long long took = microseconds_now() - start;
+    b.done = true;
+    sthread_join(writer);
+    printf("seqlock:  %.1f ns/read, %u published, %llu torn copies retried, %u bad\n",
+        took * 1000.0 / SAMPLER_READS, b.published, torn, errors);
+
+    input in;
+    input_sampler *sampler = input_sampler_new(&in, SAMPLER_HZ);
+    if (!sampler)
+    {
+        printf("sampler:  couldn't start\n");
+        return 1;
+    }
+    vector<long long> age;
+    long long period = 1000000 / 60;
+    long long next = microseconds_now();
+    start = next;
+    for (unsigned i = 0; i < SAMPLER_POLLS; i++)
+    {
+        next += period;
+        plat_sleep_us(next - microseconds_now());
+        long long now = microseconds_now();
+        input_sampler_take(sampler, &s);
+        age.push_back(now - s.sampled_us);
+    }
+    took = microseconds_now() - start;
+    unsigned overruns = sampler->overruns.load();
+    input_sampler_free(sampler);
+    in.close();
+    sort(age.begin(), age.end());
+    long long total = 0;
+    for (size_t i = 0; i < age.size(); i++)
+        total += age[i];
+    printf("sampler:  %.0f reads/s asked %u, %u overruns; poll sees input %.3f ms old (max %.3f), once a frame up to %.3f\n",
+        s.samples * 1000000.0 / took, SAMPLER_HZ, overruns, total / 1000.0 / age.size(), age.back() / 1000.0,
+        period / 1000.0);
+    return errors ? 1 : 0;
+}
+
+int run_bench(const char *name)
+{
+    if (!strcmp(name, "ring"))
+        return bench_ring();
+    if (!strcmp(name, "resampler"))
+        return bench_resampler();
+    if (!strcmp(name, "pixconv"))
+        return bench_pixconv();
+    if (!strcmp(name, "present"))
+        return bench_present();
+    if (!strcmp(name, "pacing"))
+        return bench_pacing();
+    if (!strcmp(name, "rewind"))
+        return bench_rewind();
+    if (!strcmp(name, "states"))
+        return bench_states();
+    if (!strcmp(name, "movie"))
+        return bench_movie();
+    if (!strcmp(name, "script"))
+        return bench_script();
+    if (!strcmp(name, "input"))
+        return bench_input();
+    if (!strcmp(name, "events"))
+        return bench_events();
+    if (!strcmp(name, "sampler"))
+        return bench_sampler();
+    printf("Unknown benchmark '%s' (ring, resampler, pixconv, present, pacing, rewind, states, movie, script, input, events, sampler)\n", name);
+    return 1;
+}
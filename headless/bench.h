@@ -0,0 +1,8 @@
+#ifndef _bench_h_
+#define _bench_h_
+
+// Microbenchmarks for frontend hot paths, run with einweggerat_headless -b name.
+// Returns a process exit code; non-zero when a self-check fails.
+int run_bench(const char *name);
+
+#endif
@@ -0,0 +1,327 @@
+// headless.cpp : Runs a libretro core as fast as possible without a window,
+// audio device or GL context and reports its throughput.
+//
+#include "../CLibretro.h"
+#include "../io/gl_render.h"
+#include "../io/input.h"
+#include "../io/dinput_script.h"
+#include "bench.h"
+#include "../3rdparty/cmdline.h"
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+using namespace std;
+
+int main(int argc, char *argv[])
+{
+    cmdline::parser a;
+    a.add<string>("core_name", 'c', "core filename", false, "");
+    a.add<string>("rom_name", 'r', "rom filename", false, "");
+    a.add<int>("frames", 'f', "number of frames to run", false, 3600);
+    a.add<double>("seconds", 's', "run for this many seconds of wall time instead", false, 0);
+    a.add("pergame", 'g', "per-game configuration");
+    a.add("audio", 'a', "keep audio output on; audio sync then paces the run");
+    a.add<int>("latency", 'l', "audio buffer in frames (with -a)", false, 1024, cmdline::range(64, 1 << 16));
+    a.add<double>("drc-delta", 0, "dynamic rate control max delta (with -a)", false, 0.005);
+    a.add<double>("drc-ki", 0, "dynamic rate control integral gain (with -a)", false, 0.0);
+    a.add<string>("audio-backend", 0, "comma separated mini_al backends to try (with -a)", false, "");
+    a.add("null-sink", 0, "skip the device; consume audio on the wall clock (with -a)");
+    a.add<string>("wav", 0, "also write the output stream to this WAV (with -a)", false, "");
+    a.add("dsp-thread", 0, "convert and resample on a worker thread (with -a)");
+    a.add<string>("resampler", 0, "resampler engine (with -a)", false, "sinc",
+        cmdline::oneof<string>("nearest", "linear", "cubic", "sinc"));
+    a.add<string>("quality", 0, "sinc resampler quality (with -a)", false, "normal",
+        cmdline::oneof<string>("lowest", "lower", "normal", "higher", "highest"));
+    a.add("convert", 0, "convert frames to XRGB8888 before upload");
+    a.add("no-elision", 0, "upload every frame, even when it is unchanged");
+    a.add<string>("pace", 0, "frame pacing (auto, audio, video, timer, free)", false, "auto");
+    a.add<string>("frame-delay", 0, "ms to wait after a present before running (video pacing), or auto", false, "0");
+    a.add<int>("run-ahead", 0, "frames to run ahead of the core to hide its input lag", false, 0, cmdline::range(0, 8));
+    a.add<int>("rewind", 0, "MB of savestate history to keep for rewinding", false, 0, cmdline::range(0, 2047));
+    a.add<int>("rewind-interval", 0, "frames between rewind captures", false, 1, cmdline::range(0, 3600));
+    a.add<int>("rewind-frames", 0, "hold rewind for this many frames at the end of the run", false, 0, cmdline::range(0, 1 << 24));
+    a.add<string>("load-state", 0, "savestate to load as the run starts", false, "");
+    a.add<string>("save-state", 0, "savestate to write when the run ends", false, "");
+    a.add<string>("record-movie", 0, "record the run's input to this movie", false, "");
+    a.add<string>("play-movie", 0, "replay a movie; the run ends with it", false, "");
+    a.add<int>("movie-seek", 0, "start the replay at this frame", false, 0, cmdline::range(0, 1 << 30));
+    a.add<int>("keyframe-interval", 0, "frames between movie keyframes", false, 600, cmdline::range(0, 1 << 16));
+    a.add<string>("input-script", 'i', "play input from this script, frame by frame (see io/dinput_script.h)", false, "");
+    a.add<string>("bench", 'b', "run a frontend microbenchmark instead (ring, resampler, pixconv, present, pacing, rewind, states, movie, script, input, events, sampler)", false, "");
+    a.parse_check(argc, argv);
+
+    if (!a.get<string>("bench").empty())
+        return run_bench(a.get<string>("bench").c_str());
+    if (a.get<string>("core_name").empty() || a.get<string>("rom_name").empty())
+    {
+        printf("%s", a.usage().c_str());
+        return 1;
+    }
+
+    TCHAR rom[MAX_PATH], core[MAX_PATH];
+    plat_from_utf8(a.get<string>("rom_name").c_str(), rom, MAX_PATH);
+    plat_from_utf8(a.get<string>("core_name").c_str(), core, MAX_PATH);
+    int frames = a.get<int>("frames");
+    long long duration = (long long)(a.get<double>("seconds") * 1000000.0);
+
+    CLibretro *emulator = CLibretro::CreateInstance(NULL);
+    emulator->headless = true;
+    emulator->headless_audio = a.exist("audio");
+    emulator->convert_pixels = a.exist("convert");
+    emulator->disable_elision = a.exist("no-elision");
+    if (!pace_parse_mode(a.get<string>("pace").c_str(), &emulator->pace_setting))
+    {
+        printf("Unknown pacing '%s'.\n", a.get<string>("pace").c_str());
+        return 1;
+    }
+    if (!frame_delay_parse(a.get<string>("frame-delay").c_str(), &emulator->frame_delay))
+    {
+        printf("Frame delay '%s' is not auto or 0 to %d ms.\n", a.get<string>("frame-delay").c_str(), (int)(1000.0 / plat_refresh_rate()));
+        return 1;
+    }
+    emulator->runahead_frames = a.get<int>("run-ahead");
+    emulator->rewind_budget = (size_t)a.get<int>("rewind") << 20;
+    emulator->rewind_interval = a.get<int>("rewind-interval");
+    int rewind_frames = a.get<int>("rewind-frames");
+    emulator->_audio.latency_frames = a.get<int>("latency");
+    // a larger swing would be heard as pitch
+    double drc_delta = a.get<double>("drc-delta");
+    emulator->_audio.drc_max_delta = drc_delta < 0.0 ? 0.0 : drc_delta > 0.2 ? 0.2 : drc_delta;
+    emulator->_audio.drc_ki = a.get<double>("drc-ki");
+    emulator->_audio.threaded_dsp = a.exist("dsp-thread");
+    emulator->_audio.null_clock = a.exist("null-sink");
+    plat_from_utf8(a.get<string>("wav").c_str(), emulator->_audio.wav_path, MAX_PATH);
+    if (!audio_parse_backends(a.get<string>("audio-backend").c_str(), &emulator->_audio.backends))
+    {
+        printf("Unknown audio backend in '%s'.\n", a.get<string>("audio-backend").c_str());
+        return 1;
+    }
+    for (int e = RESAMPLER_NEAREST; e <= RESAMPLER_SINC; e++)
+        if (a.get<string>("resampler") == resampler_engine_name((resampler_engine)e))
+            emulator->_audio.resampler = (resampler_engine)e;
+    for (int q = RESAMPLER_QUALITY_LOWEST; q <= RESAMPLER_QUALITY_HIGHEST; q++)
+        if (a.get<string>("quality") == resampler_quality_name((resampler_quality)q))
+            emulator->_audio.quality = (resampler_quality)q;
+    input *script = NULL;
+    if (!a.get<string>("input-script").empty())
+    {
+        TCHAR script_path[MAX_PATH];
+        plat_from_utf8(a.get<string>("input-script").c_str(), script_path, MAX_PATH);
+        script = input::CreateInstance(NULL, NULL);
+        const char *err = script->open_script(script_path);
+        if (err)
+        {
+            printf("%s.\n", err);
+            return 1;
+        }
+    }
+    if (!emulator->loadfile(rom, core, a.exist("pergame")))
+    {
+        printf("Failed to load core/content.\n");
+        return 1;
+    }
+    if (script)
+        script->bind_script();
+
+    TCHAR state_path[MAX_PATH];
+    if (!a.get<string>("load-state").empty())
+    {
+        plat_from_utf8(a.get<string>("load-state").c_str(), state_path, MAX_PATH);
+        if (!emulator->states || !emulator->savestate(state_path))
+        {
+            printf("Couldn't queue the savestate load.\n");
+            return 1;
+        }
+        // the first frame picks it up
+        state_io_flush(emulator->states);
+    }
+
+    TCHAR movie_path[MAX_PATH];
+    bool playing = !a.get<string>("play-movie").empty();
+    if (playing)
+    {
+        plat_from_utf8(a.get<string>("play-movie").c_str(), movie_path, MAX_PATH);
+        long long seek_start = microseconds_now();
+        if (!emulator->play_movie(movie_path))
+        {
+            printf("Couldn't play the movie.\n");
+            return 1;
+        }
+        unsigned seek = a.get<int>("movie-seek");
+        if (seek && !emulator->seek_movie(seek))
+        {
+            printf("Couldn't seek the movie to frame %u.\n", seek);
+            return 1;
+        }
+        printf("movie seek:        frame %u in %.3f ms\n", emulator->movie_frame, (microseconds_now() - seek_start) / 1000.0);
+    }
+    else if (!a.get<string>("record-movie").empty())
+    {
+        plat_from_utf8(a.get<string>("record-movie").c_str(), movie_path, MAX_PATH);
+        if (!emulator->record_movie(movie_path, a.get<int>("keyframe-interval")))
+        {
+            printf("Couldn't record a movie.\n");
+            return 1;
+        }
+    }
+
+    // keep the sample storage out of the timed loop
+    vector<long long> run_times, late_times, input_latency, rewind_steps;
+    run_times.reserve(duration ? (1 << 20) : frames);
+    late_times.reserve(duration ? (1 << 20) : frames);
+    input_latency.reserve(duration ? (1 << 20) : frames);
+    long long run_total = 0;
+    long long callback_total = 0;
+    long long save_total = 0, hidden_total = 0, load_total = 0;
+    long long capture_total = 0;
+    long long state_stall = 0;
+    long long start = microseconds_now();
+    long long now = start;
+    while (duration ? (now - start) < duration : (int)run_times.size() < frames)
+    {
+        if (playing && (!emulator->movie_file || emulator->movie_frame >= emulator->movie_file->frames))
+            break;
+        // rewinding is held for the tail of a counted run
+        emulator->rewinding = !duration && (int)run_times.size() >= frames - rewind_frames;
+        if (script)
+            script->set_frame((unsigned)run_times.size());
+        emulator->run();
+        if (emulator->rewinding && emulator->timing.rewind_step_us)
+            rewind_steps.push_back(emulator->timing.rewind_step_us);
+        capture_total += emulator->timing.rewind_capture_us;
+        state_stall += emulator->timing.state_stall_us;
+        run_times.push_back(emulator->timing.run_us);
+        run_total += emulator->timing.run_us;
+        callback_total += emulator->timing.callback_us;
+        save_total += emulator->timing.runahead_save_us;
+        hidden_total += emulator->timing.runahead_hidden_us;
+        load_total += emulator->timing.runahead_load_us;
+        late_times.push_back(emulator->timing.pace_late_us);
+        input_latency.push_back(emulator->timing.input_latency_us);
+        now = microseconds_now();
+    }
+    long long wall = now - start;
+    movie *mv = emulator->movie_file;
+    bool recording = mv && mv->recording;
+    unsigned movie_frames = emulator->movie_frame, keyframes = mv ? (unsigned)mv->keyframes.size() : 0;
+    emulator->stop_movie();
+    if (!a.get<string>("save-state").empty())
+    {
+        plat_from_utf8(a.get<string>("save-state").c_str(), state_path, MAX_PATH);
+        emulator->timing.state_stall_us = 0;
+        if (!emulator->savestate(state_path, true))
+            printf("Core can't make a savestate.\n");
+        state_stall += emulator->timing.state_stall_us;
+    }
+    state_io_stats sstats = {};
+    if (emulator->states)
+    {
+        state_io_flush(emulator->states);
+        sstats = state_io_get_stats(emulator->states);
+    }
+    bool audio = emulator->audio_enabled;
+    audio_stats astats = {};
+    if (audio)astats = emulator->_audio.get_stats();
+    bool passthrough = audio && emulator->_audio.passthrough;
+    pace_mode pacing = emulator->pacing;
+    unsigned missed = emulator->pacer.missed;
+    long long frame_delay = emulator->frame_delay_us;
+    unsigned vblank_misses = emulator->timing.vblank_misses;
+    unsigned runahead = emulator->runahead_failed ? 0 : emulator->runahead_frames;
+    bool rewind = emulator->rewind_budget && !emulator->rewind_failed;
+    rewind_buffer &history = emulator->rewind_history;
+    size_t rewind_used = history.used, rewind_budget = history.capacity;
+    unsigned rewind_held = history.count;
+    double rewind_ratio = history.coded_bytes ? (double)history.raw_bytes / history.coded_bytes : 0.0;
+    unsigned video_frames = g_video.frames, zero_copy = g_video.zero_copy_frames;
+    unsigned uploads = g_video.uploads;
+    unsigned dupes = g_video.dupe_frames, identical = g_video.identical_frames;
+    unsigned long long uploaded = g_video.bytes_uploaded;
+    long long upload_total = g_video.upload_total_us;
+    emulator->kill();
+
+    size_t count = run_times.size();
+    if (!count || !wall)
+    {
+        printf("No frames were run.\n");
+        return 1;
+    }
+    sort(run_times.begin(), run_times.end());
+    size_t p99 = (count * 99) / 100;
+    if (p99 >= count) p99 = count - 1;
+    // time outside retro_run plus time inside our callbacks
+    long long overhead = (wall - run_total) + callback_total;
+
+    printf("frames:            %u\n", (unsigned)count);
+    printf("wall time:         %.3f s\n", wall / 1000000.0);
+    printf("frames/sec:        %.2f\n", count * 1000000.0 / wall);
+    printf("retro_run mean:    %.3f ms\n", run_total / 1000.0 / count);
+    printf("retro_run p99:     %.3f ms\n", run_times[p99] / 1000.0);
+    printf("frontend overhead: %.3f ms/frame (%.1f%%)\n", overhead / 1000.0 / count, overhead * 100.0 / wall);
+    printf("pacing:            %s\n", pace_mode_name(pacing));
+    if (pacing == PACE_TIMER)
+    {
+        sort(late_times.begin(), late_times.end());
+        printf("deadline error:    p50 %lld us, p99 %lld us, max %lld us, %u missed\n",
+            late_times[count / 2], late_times[p99], late_times.back(), missed);
+    }
+    if (pacing == PACE_VIDEO)
+    {
+        // the first frames run before the delay has been tuned
+        size_t skip = min(count / 2, (size_t)FRAME_DELAY_WINDOW);
+        long long latency = 0;
+        for (size_t i = skip; i < count; i++)
+            latency += input_latency[i];
+        printf("frame delay:       %.1f ms, %u vblanks missed\n", frame_delay / 1000.0, vblank_misses);
+        printf("poll to present:   %.3f ms mean\n", latency / 1000.0 / (count - skip));
+    }
+    if (runahead)
+        printf("run-ahead:         %u frames, save %.3f ms, hidden %.3f ms, load %.3f ms per frame\n",
+            runahead, save_total / 1000.0 / count, hidden_total / 1000.0 / count, load_total / 1000.0 / count);
+    if (rewind)
+    {
+        printf("rewind:            %u states in %.2f of %.2f MB, %.1fx compression, capture %.3f ms/frame\n",
+            rewind_held, rewind_used / 1048576.0, rewind_budget / 1048576.0, rewind_ratio,
+            capture_total / 1000.0 / count);
+        if (!rewind_steps.empty())
+        {
+            sort(rewind_steps.begin(), rewind_steps.end());
+            printf("rewind steps:      %u, p50 %.3f ms, max %.3f ms\n", (unsigned)rewind_steps.size(),
+                rewind_steps[rewind_steps.size() / 2] / 1000.0, rewind_steps.back() / 1000.0);
+        }
+    }
+    if (sstats.saves || sstats.loads || sstats.failures)
+    {
+        printf("savestates:        %u saved, %u loaded, %u failed, %.1f KB as %.1f KB on disk\n",
+            sstats.saves, sstats.loads, sstats.failures, sstats.raw_bytes / 1024.0, sstats.file_bytes / 1024.0);
+        printf("savestate stall:   %.3f ms on the emulation thread, %.3f ms on the worker\n",
+            state_stall / 1000.0, sstats.worker_us / 1000.0);
+    }
+    if (recording)
+        printf("movie recorded:    %u frames, %u keyframes, %.1f KB\n", movie_frames, keyframes,
+            plat_file_size(movie_path) / 1024.0);
+    if (playing)
+        printf("movie played:      to frame %u, %u keyframes checked, %u desynced\n", movie_frames,
+            emulator->movie_checked, emulator->movie_desyncs);
+    if (script)
+        printf("input script:      %u of %u events played\n", script->script->get_played(), script->script->get_count());
+    if (uploads)
+        printf("frame upload:      %.3f ms/frame\n", upload_total / 1000.0 / uploads);
+    printf("video frames:      %u (%u dupes, %u unchanged), %.1f MB uploaded\n",
+        video_frames + dupes, dupes, identical, uploaded / 1048576.0);
+    if (zero_copy)
+        printf("zero-copy frames:  %u of %u\n", zero_copy, video_frames);
+    if (audio)
+    {
+        printf("audio fill:        %.2f (min %.2f, max %.2f)\n", astats.fill, astats.fill_min, astats.fill_max);
+        printf("audio ratio:       %.5f%s\n", astats.ratio, passthrough ? " (passthrough)" : "");
+        printf("audio underruns:   %u\n", astats.underruns);
+        printf("audio blocked:     %.3f ms/frame\n", astats.blocked_us / 1000.0 / count);
+        if (astats.wav_dropped)
+            printf("wav dropped:       %u frames\n", (unsigned)astats.wav_dropped);
+        if (astats.queue_blocked_us)
+            printf("dsp queue blocked: %.3f ms/frame\n", astats.queue_blocked_us / 1000.0 / count);
+    }
+    return 0;
+}
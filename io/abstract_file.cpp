@@ -27,9 +27,7 @@ CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE. */
 	#define RAISE_ERROR( str ) return str
 #endif
 
-typedef blargg_err_t error_t;
-
-error_t Data_Writer::write( const void*, long ) { return 0; }
+blargg_err_t Data_Writer::write( const void*, long ) { return 0; }
 
 void Data_Writer::satisfy_lame_linker_() { }
 
@@ -42,7 +40,7 @@ Std_File_Writer::~Std_File_Writer() {
 	close();
 }
 
-error_t Std_File_Writer::open( const char* path )
+blargg_err_t Std_File_Writer::open( const char* path )
 {
 	close();
 	file_ = fopen( path, "wb" );
@@ -55,7 +53,7 @@ error_t Std_File_Writer::open( const char* path )
 	return 0;
 }
 
-error_t Std_File_Writer::write( const void* p, long s )
+blargg_err_t Std_File_Writer::write( const void* p, long s )
 {
 	long result = (long) fwrite( p, 1, s, file_ );
 	if ( result != s )
@@ -95,7 +93,7 @@ Mem_Writer::~Mem_Writer()
 		free( data_ );
 }
 
-error_t Mem_Writer::write( const void* p, long s )
+blargg_err_t Mem_Writer::write( const void* p, long s )
 {
 	long remain = allocated - size_;
 	if ( s > remain )
@@ -128,7 +126,7 @@ error_t Mem_Writer::write( const void* p, long s )
 
 // Null_Writer
 
-error_t Null_Writer::write( const void*, long )
+blargg_err_t Null_Writer::write( const void*, long )
 {
 	return 0;
 }
@@ -232,7 +230,7 @@ blargg_err_t Std_File_Reader_u::open(const TCHAR path[])
 #endif
 }
 
-error_t Std_File_Writer_u::open(const TCHAR* path)
+blargg_err_t Std_File_Writer_u::open(const TCHAR* path)
 {
 	reset(_tfopen(path, _T("wb")));
 	if (!file())
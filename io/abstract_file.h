@@ -7,7 +7,7 @@
 #undef BLARGG_CONFIG_H
 
 #include "Data_Reader.h"
-#include <tchar.h>
+#include "platform.h"
 #include <stdio.h>
 
 // Supports writing
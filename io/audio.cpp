@@ -1,193 +1,623 @@
 #define MAL_IMPLEMENTATION
-#include <windows.h>
 #include "audio.h"
+#include "cpu.h"
+#include <immintrin.h>
+#ifdef _WIN32
 #include <initguid.h>
 #include <Mmdeviceapi.h>
+#endif
 using namespace std;
 
 #define FRAME_COUNT (1024)
+// frames handed to the resampler at once; input_float holds one chunk
+#define MIX_CHUNK (FRAME_COUNT * 2)
+// a frame's worth of audio for any sane core; more is mixed early
+#define STAGING_FRAMES (FRAME_COUNT * 4)
 
-fifo_buffer_t *fifo_new(size_t size)
+static mal_uint32 audio_callback(mal_device* pDevice, mal_uint32 frameCount, void* pSamples)
+{
+    //convert from samples to the actual number of bytes.
+    int count_bytes = frameCount * pDevice->channels * mal_get_bytes_per_sample(mal_format_f32);
+    int ret = ((Audio*)pDevice->pUserData)->fill_buffer((uint8_t*)pSamples, count_bytes) / mal_get_bytes_per_sample(mal_format_f32);
+    return ret / pDevice->channels;
+    //...and back to samples
+}
+
+void audio_s16_to_f32_sse2(float* out, const int16_t* in, size_t samples)
 {
-    uint8_t    *buffer = NULL;
-    fifo_buffer_t *buf = (fifo_buffer_t*)calloc(1, sizeof(*buf));
-    if (!buf)
-        return NULL;
-    buffer = (uint8_t*)calloc(1, size + 1);
-    if (!buffer)
+    const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8)
     {
-        free(buf);
-        return NULL;
+        __m128i s = _mm_loadu_si128((const __m128i*)(in + i));
+        // sign-extend by moving each sample to the top half and shifting back
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16);
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(out + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
     }
-    buf->buffer = buffer;
-    buf->size = size + 1;
-    return buf;
+    for (; i < samples; i++)
+        out[i] = (float)in[i] * (1.0f / 32768.0f);
 }
 
-void fifo_write(fifo_buffer_t *buffer, const void *in_buf, size_t size)
+CPU_TARGET("avx2")
+void audio_s16_to_f32_avx2(float* out, const int16_t* in, size_t samples)
 {
-    size_t first_write = size;
-    size_t rest_write = 0;
-    if (buffer->end + size > buffer->size)
+    const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16)
     {
-        first_write = buffer->size - buffer->end;
-        rest_write = size - first_write;
+        __m256i s = _mm256_loadu_si256((const __m256i*)(in + i));
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(s));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(s, 1));
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+        _mm256_storeu_ps(out + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
     }
-    memcpy(buffer->buffer + buffer->end, in_buf, first_write);
-    memcpy(buffer->buffer, (const uint8_t*)in_buf + first_write, rest_write);
-    buffer->end = (buffer->end + size) % buffer->size;
+    for (; i < samples; i++)
+        out[i] = (float)in[i] * (1.0f / 32768.0f);
 }
 
+void audio_s16_to_f32(float* out, const int16_t* in, size_t samples)
+{
+    static void(*convert)(float*, const int16_t*, size_t) = NULL;
+    if (!convert)
+        convert = (cpu_features() & CPU_AVX2) ? audio_s16_to_f32_avx2 : audio_s16_to_f32_sse2;
+    convert(out, in, samples);
+}
 
-void fifo_read(fifo_buffer_t *buffer, void *in_buf, size_t size)
+static void audio_dsp_thread(void* data)
 {
-    size_t first_read = size;
-    size_t rest_read = 0;
-    if (buffer->first + size > buffer->size)
-    {
-        first_read = buffer->size - buffer->first;
-        rest_read = size - first_read;
-    }
-    memcpy(in_buf, (const uint8_t*)buffer->buffer + buffer->first, first_read);
-    memcpy((uint8_t*)in_buf + first_read, buffer->buffer, rest_read);
-    buffer->first = (buffer->first + size) % buffer->size;
+    ((Audio*)data)->dsp_loop();
 }
 
-static mal_uint32 audio_callback(mal_device* pDevice, mal_uint32 frameCount, void* pSamples)
+static void audio_pull_thread(void* data)
 {
-    //convert from samples to the actual number of bytes.
-    int count_bytes = frameCount * pDevice->channels * mal_get_bytes_per_sample(mal_format_f32);
-    int ret = ((Audio*)pDevice->pUserData)->fill_buffer((uint8_t*)pSamples, count_bytes) / mal_get_bytes_per_sample(mal_format_f32);
-    return ret / pDevice->channels;
-    //...and back to samples
+    ((Audio*)data)->pull_loop();
 }
 
-static retro_time_t frame_limit_minimum_time = 0.0;
-static retro_time_t frame_limit_last_time = 0.0;
+static void audio_clock_thread(void* data)
+{
+    ((Audio*)data)->clock_loop();
+}
 
-static double PerfFrequencyInverse = 0.;
-static void InitPerfFrequencyInverse()
+static const struct
 {
-    LARGE_INTEGER freq = {};
-    if (!::QueryPerformanceFrequency(&freq) || freq.QuadPart == 0)
-        return;
-    PerfFrequencyInverse = 1000000. / (double)freq.QuadPart;
+    const char* name;
+    mal_backend backend;
+} audio_backends[] = {
+    { "wasapi", mal_backend_wasapi },
+    { "dsound", mal_backend_dsound },
+    { "winmm", mal_backend_winmm },
+    { "alsa", mal_backend_alsa },
+    { "pulseaudio", mal_backend_pulseaudio },
+    { "jack", mal_backend_jack },
+    { "coreaudio", mal_backend_coreaudio },
+    { "sndio", mal_backend_sndio },
+    { "audio4", mal_backend_audio4 },
+    { "oss", mal_backend_oss },
+    { "opensl", mal_backend_opensl },
+    { "openal", mal_backend_openal },
+    { "sdl", mal_backend_sdl },
+    { "null", mal_backend_null },
+};
+
+// mini_al's own null backend isn't in the defaults; when nothing opens,
+// the clocked null sink takes over
+static const mal_backend default_backends[] = {
+#if defined(_WIN32)
+    mal_backend_wasapi,
+    mal_backend_dsound,
+    mal_backend_winmm,
+#elif defined(__APPLE__)
+    mal_backend_coreaudio,
+#else
+    mal_backend_pulseaudio,
+    mal_backend_alsa,
+    mal_backend_jack,
+    mal_backend_oss,
+#endif
+};
+
+bool audio_parse_backends(const char* list, std::vector<mal_backend>* out)
+{
+    out->clear();
+    while (*list)
+    {
+        size_t len = strcspn(list, ",");
+        size_t i;
+        for (i = 0; i < sizeof(audio_backends) / sizeof(audio_backends[0]); i++)
+            if (strlen(audio_backends[i].name) == len && !strncmp(audio_backends[i].name, list, len))
+                break;
+        if (i == sizeof(audio_backends) / sizeof(audio_backends[0]))
+            return false;
+        out->push_back(audio_backends[i].backend);
+        list += len;
+        if (*list == ',')
+            list++;
+    }
+    return true;
 }
 
-long long milliseconds_now() {
-    return microseconds_now() / 1000;
+const char* audio_backend_name(mal_backend backend)
+{
+    for (size_t i = 0; i < sizeof(audio_backends) / sizeof(audio_backends[0]); i++)
+        if (audio_backends[i].backend == backend)
+            return audio_backends[i].name;
+    return "?";
 }
 
-long long microseconds_now() {
-    LARGE_INTEGER timeStamp = {};
-    if (!::QueryPerformanceCounter(&timeStamp))
-        return 0;
-    if (PerfFrequencyInverse == 0.)
-        InitPerfFrequencyInverse();
-    return (uint64_t)(PerfFrequencyInverse * timeStamp.QuadPart);
+Audio::Audio()
+{
+    latency_frames = FRAME_COUNT;
+    drc_max_delta = 0.005;
+    drc_ki = 0.0;
+    resampler = RESAMPLER_SINC;
+    quality = RESAMPLER_QUALITY_NORMAL;
+    passthrough = false;
+    resample = NULL;
+    threaded_dsp = false;
+    nonblocking = false;
+    dsp_ring = NULL;
+    dsp_buffer = NULL;
+    dsp_thread = NULL;
+    dsp_running = false;
+    pull_callback = NULL;
+    pull_set_state = NULL;
+    pull_target = 0.5;
+    pull_thread = NULL;
+    pull_wake = NULL;
+    pull_staging = NULL;
+    pull_staged = 0;
+    stats_lock = NULL;
+    pull_running = false;
+    started = false;
+    pull_signalled = false;
+    drc_integral = 0.0;
+    null_clock = false;
+    null_rate = 48000;
+    wav_path[0] = 0;
+    use_device = false;
+    clock_thread = NULL;
+    clock_running = false;
+    wav = NULL;
+    reset_stats();
 }
 
 bool Audio::init(double refreshra, retro_system_av_info av)
 {
-    condz = scond_new();
-    lockz = slock_new();
     system_rate = av.timing.sample_rate;
     system_fps = av.timing.fps;
     if (fabs(1.0f - system_fps / refreshra) <= 0.05)
         system_rate *= (refreshra / system_fps);
-    mal_context_config contextConfig = mal_context_config_init(NULL);
-    mal_backend backends[] = {
-        mal_backend_wasapi,
-        mal_backend_dsound,
-        mal_backend_winmm,
-        mal_backend_null    // Lowest priority.
-    };
-
-    if (mal_context_init(backends, sizeof(backends) / sizeof(backends[0]), &contextConfig, &context) != MAL_SUCCESS)
+    use_device = false;
+    if (!null_clock)
     {
-        printf("Failed to initialize context.");
+        mal_context_config contextConfig = mal_context_config_init(NULL);
+        std::vector<mal_backend> list = backends;
+        if (list.empty())
+            list.assign(default_backends, default_backends + sizeof(default_backends) / sizeof(default_backends[0]));
+        if (mal_context_init(&list[0], (mal_uint32)list.size(), &contextConfig, &context) == MAL_SUCCESS)
+        {
+            mal_device_config config = mal_device_config_init_playback(mal_format_f32, 2, 0, audio_callback);
+            config.bufferSizeInFrames = latency_frames;
+            if (mal_device_init(&context, mal_device_type_playback, NULL, &config, this, &device) == MAL_SUCCESS)
+                use_device = true;
+            else
+                mal_context_uninit(&context);
+        }
+        if (!use_device)
+            printf("No audio device, using the null sink.\n");
+    }
+    client_rate = use_device ? device.sampleRate : null_rate;
+    resamp_original = (client_rate / system_rate);
+    // matching rates skip the resampler; audio sync alone paces the core
+    passthrough = (double)client_rate == system_rate;
+    resample = passthrough ? NULL : resampler_init(resampler, quality, resamp_original);
+    // mix() resamples whenever it isn't passthrough, so a failed init fails here
+    _ring = passthrough || resample ? ring_new(use_device ? device.bufferSizeInFrames : latency_frames, 2 * sizeof(float)) : NULL;
+    if (!_ring)
+    {
+        resampler_free(resample);
+        resample = NULL;
+        if (use_device)
+            mal_context_uninit(&context);
         return false;
-    };
-
-    mal_device_config config = mal_device_config_init_playback(mal_format_f32, 2, 0, audio_callback);
-    config.bufferSizeInFrames = (FRAME_COUNT);
-    if (mal_device_init(&context, mal_device_type_playback, NULL, &config, this, &device) != MAL_SUCCESS) {
-        mal_context_uninit(&context);
+    }
+    wav = wav_path[0] ? wav_sink_open(wav_path, client_rate, 2) : NULL;
+    if (wav_path[0] && !wav)
+        printf("Couldn't start the WAV writer, not capturing.\n");
+    // largest chunk input_float takes, at the highest ratio DRC can pick;
+    // mix() never lets adjust below 1 - maxdelta
+    output_frames = (size_t)(MIX_CHUNK * resamp_original / (1.0 - drc_max_delta)) + 16;
+    output_float = new float[output_frames * 2];
+    input_float = new float[MIX_CHUNK * 2];
+    staging = new int16_t[STAGING_FRAMES * 2];
+    staged = 0;
+    drc_integral = 0.0;
+    reset_stats();
+    stats_lock = slock_new();
+    if (threaded_dsp)
+    {
+        // sized like the device buffer, so audio sync still holds the core
+        // back once the worker is itself waiting on the device
+        dsp_ring = ring_new(latency_frames, 2 * sizeof(int16_t));
+        dsp_buffer = new int16_t[MIX_CHUNK * 2];
+        dsp_running = true;
+        dsp_thread = dsp_ring ? sthread_create(audio_dsp_thread, this) : NULL;
+        if (!dsp_thread)
+        {
+            // flush() mixes on the emulation thread instead
+            dsp_running = false;
+            ring_free(dsp_ring);
+            dsp_ring = NULL;
+            delete[] dsp_buffer;
+            dsp_buffer = NULL;
+        }
+    }
+    if (pull_callback)
+    {
+        pull_low = (size_t)(_ring->capacity * pull_target);
+        pull_staging = new int16_t[STAGING_FRAMES * 2];
+        pull_staged = 0;
+        pull_wake = plat_sem_new();
+        pull_running = true;
+        pull_thread = sthread_create(audio_pull_thread, this);
+    }
+    if (!start())
+    {
+        // the workers are already running; the caller never destroys
+        // an audio it failed to init
+        destroy();
         return false;
     }
-    client_rate = device.sampleRate;
-    resamp_original = (client_rate / system_rate);
-    resample = resampler_sinc_init(resamp_original);
-    size_t sampsize = mal_device_get_buffer_size_in_bytes(&device);
-    _fifo = fifo_new(sampsize); //number of bytes
-    output_float = new float[sampsize * 2]; //spare space for resampler
-    input_float = new float[FRAME_COUNT * 4];
-    if (mal_device_start(&device) != MAL_SUCCESS)return false;
-    frame_limit_last_time = microseconds_now();
-    frame_limit_minimum_time = (retro_time_t)roundf(1000000.0f / (av.timing.fps));
     return true;
 }
 void Audio::destroy()
 {
     {
-        mal_device_stop(&device);
-        mal_context_uninit(&context);
-        fifo_free(_fifo);
-        slock_free(lockz);
-        scond_free(condz);
+        stop();
+        if (pull_thread)
+        {
+            pull_running = false;
+            plat_sem_post(pull_wake);
+            sthread_join(pull_thread);
+            pull_thread = NULL;
+            plat_sem_free(pull_wake);
+            pull_wake = NULL;
+            delete[] pull_staging;
+            pull_staging = NULL;
+        }
+        if (dsp_thread)
+        {
+            dsp_running = false;
+            ring_wake_reader(dsp_ring);
+            sthread_join(dsp_thread);
+            dsp_thread = NULL;
+            ring_free(dsp_ring);
+            dsp_ring = NULL;
+            delete[] dsp_buffer;
+        }
+        if (use_device)
+            mal_context_uninit(&context);
+        wav_sink_close(wav);
+        wav = NULL;
+        ring_free(_ring);
         delete[] input_float;
         delete[] output_float;
-        resampler_sinc_free(resample);
+        delete[] staging;
+        resampler_free(resample);
+        // the workers are joined; get_stats() reads what they left
+        slock_free(stats_lock);
+        stats_lock = NULL;
     }
 }
 void Audio::reset()
 {
 }
 
-void Audio::mix(const int16_t* samples, size_t size)
+bool Audio::start()
+{
+    if (use_device)
+    {
+        if (mal_device_start(&device) != MAL_SUCCESS)
+            return false;
+    }
+    else
+    {
+        clock_running = true;
+        clock_thread = sthread_create(audio_clock_thread, this);
+        if (!clock_thread)
+        {
+            clock_running = false;
+            return false;
+        }
+    }
+    if (pull_set_state)
+        pull_set_state(true);
+    started = true;
+    // prime the ring before the first callback asks
+    if (pull_thread && !pull_signalled.exchange(true))
+        plat_sem_post(pull_wake);
+    return true;
+}
+
+void Audio::stop()
+{
+    if (!started.exchange(false))
+        return;
+    if (pull_set_state)
+        pull_set_state(false);
+    if (use_device)
+        mal_device_stop(&device);
+    else
+    {
+        clock_running = false;
+        sthread_join(clock_thread);
+        clock_thread = NULL;
+    }
+}
+
+// The null sink: reads the ring in device-sized periods on the wall clock,
+// so audio sync paces the core as a real device would. mini_al's null
+// backend can't stand in for this; its timer runs at half rate on stereo.
+#define CLOCK_PERIOD 256
+void Audio::clock_loop()
+{
+    float buffer[CLOCK_PERIOD * 2];
+    long long start = microseconds_now();
+    long long frames = 0;
+    while (clock_running.load())
+    {
+        fill_buffer((uint8_t*)buffer, sizeof(buffer));
+        frames += CLOCK_PERIOD;
+        long long due = start + frames * 1000000 / client_rate;
+        long long now = microseconds_now();
+        if (due > now)
+            plat_sleep_us(due - now);
+        else if (now - due > 100000)
+        {
+            // descheduled for a while: carry on from here instead of bursting
+            start = now;
+            frames = 0;
+        }
+    }
+}
+
+// frames waiting for the device, counting what the DSP worker still holds
+size_t Audio::buffered()
+{
+    size_t frames = ring_read_avail(_ring);
+    if (dsp_ring)
+        frames += ring_read_avail(dsp_ring);
+    return frames;
+}
+
+// Cores with a retro_audio_callback are run from here rather than once per
+// video frame: the device callback signals whenever the ring drops below
+// pull_target and the core is asked for audio until it is back above.
+void Audio::pull_loop()
+{
+    while (pull_running.load())
+    {
+        plat_sem_wait(pull_wake, 100000);
+        pull_signalled = false;
+        while (pull_running.load() && started.load() && buffered() < pull_low)
+        {
+            pull_callback();
+            // nothing more from the core until the device asks again
+            if (!pull_staged)
+                break;
+            flush_staged(pull_staging, pull_staged);
+        }
+    }
+}
+
+// With a pull worker the core's audio callback is the only source: what
+// it sends lands in the worker's buffer, and samples from anywhere else
+// (retro_run on the emulation thread) are dropped rather than fed to the
+// ring and resampler from a second thread.
+void Audio::push(const int16_t* samples, size_t frames)
+{
+    if (pull_thread)
+    {
+        if (sthread_isself(pull_thread))
+            stage(pull_staging, pull_staged, samples, frames);
+        return;
+    }
+    stage(staging, staged, samples, frames);
+}
+
+void Audio::push_sample(int16_t left, int16_t right)
+{
+    if (pull_thread)
+    {
+        int16_t frame[2] = { left, right };
+        push(frame, 1);
+        return;
+    }
+    staging[staged * 2] = left;
+    staging[staged * 2 + 1] = right;
+    if (++staged == STAGING_FRAMES)
+        flush_staged(staging, staged);
+}
+
+void Audio::stage(int16_t* buffer, size_t& count, const int16_t* samples, size_t frames)
+{
+    while (frames)
+    {
+        size_t amt = STAGING_FRAMES - count;
+        if (amt > frames) amt = frames;
+        memcpy(buffer + count * 2, samples, amt * 2 * sizeof(int16_t));
+        count += amt;
+        samples += amt * 2;
+        frames -= amt;
+        if (count == STAGING_FRAMES)
+            flush_staged(buffer, count);
+    }
+}
+
+// once per frame from the emulation thread; the pull worker flushes its own
+void Audio::flush()
+{
+    if (pull_thread)
+        return;
+    flush_staged(staging, staged);
+}
+
+void Audio::flush_staged(int16_t* buffer, size_t& count)
+{
+    if (count)
+    {
+        if (dsp_thread)
+            queue(buffer, count);
+        else
+            mix(buffer, count);
+    }
+    count = 0;
+}
+
+// emulation thread side of the DSP worker: a copy into the queue, waiting
+// only when the worker has fallen a whole queue behind
+void Audio::queue(const int16_t* samples, size_t frames)
 {
-    struct resampler_data src_data = { 0 };
     size_t written = 0;
-    uint32_t in_len = size * sizeof(int16_t);
-    double maxdelta = 0.005;
-    auto bufferlevel = [this]() {return double((_fifo->size - (int)fifo_write_avail(this->_fifo)) / this->_fifo->size); };
-    int newInputFrequency = ((1.0 - maxdelta) + 2.0 * (double)bufferlevel() * maxdelta) * system_rate;
-    float drc_ratio = (float)client_rate / (float)newInputFrequency;
-    mal_pcm_s16_to_f32(input_float, samples, in_len, mal_dither_mode_triangle);
-    src_data.input_frames = size;
-    src_data.ratio = drc_ratio;
-    src_data.data_in = input_float;
-    src_data.data_out = output_float;
-    resampler_sinc_process(resample, &src_data);
-    int out_len = src_data.output_frames * 2 * sizeof(float);
-    while (written < out_len)
-    {
-        slock_lock(lockz);
-        size_t avail = fifo_write_avail(_fifo);
-        if (avail)
+    while (written < frames)
+    {
+        size_t amt = ring_write(dsp_ring, samples + written * 2, frames - written);
+        written += amt;
+        if (!amt && nonblocking)
+            break;
+        if (!amt)
         {
-            size_t write_amt = out_len - written > avail ? avail : out_len - written;
-            fifo_write(_fifo, (const char*)output_float + written, write_amt);
-            written += write_amt;
-            slock_unlock(lockz);
+            long long start = microseconds_now();
+            bool woke = ring_wait_writable(dsp_ring, frames - written, 100000);
+            slock_lock(stats_lock);
+            stats.queue_blocked_us += microseconds_now() - start;
+            slock_unlock(stats_lock);
+            if (!woke)
+                break;
         }
+    }
+}
+
+void Audio::dsp_loop()
+{
+    while (dsp_running.load())
+    {
+        size_t got = ring_read(dsp_ring, dsp_buffer, MIX_CHUNK);
+        if (got)
+            mix(dsp_buffer, got);
         else
+            ring_wait_readable(dsp_ring, 1, 100000);
+    }
+}
+
+void Audio::mix(const int16_t* samples, size_t size)
+{
+    while (size > MIX_CHUNK)
+    {
+        mix(samples, MIX_CHUNK);
+        samples += MIX_CHUNK * 2;
+        size -= MIX_CHUNK;
+    }
+
+    struct resampler_data src_data = { 0 };
+    size_t written = 0;
+
+    // steer the ring towards half full: a fuller ring asks the resampler
+    // for fewer output frames, an emptier one for more
+    double fill = (double)ring_read_avail(_ring) / (double)_ring->capacity;
+    double drc_ratio = 1.0;
+    if (!passthrough)
+    {
+        double error = fill - 0.5;
+        double maxdelta = drc_max_delta;
+        drc_integral += drc_ki * error;
+        if (drc_integral > maxdelta) drc_integral = maxdelta;
+        if (drc_integral < -maxdelta) drc_integral = -maxdelta;
+        double adjust = 1.0 + 2.0 * maxdelta * error + drc_integral;
+        // the integral rides on the proportional term; together they still
+        // stay within maxdelta
+        if (adjust > 1.0 + maxdelta) adjust = 1.0 + maxdelta;
+        if (adjust < 1.0 - maxdelta) adjust = 1.0 - maxdelta;
+        drc_ratio = (double)client_rate / (adjust * system_rate);
+    }
+
+    slock_lock(stats_lock);
+    stats.fill = fill;
+    if (fill < stats.fill_min) stats.fill_min = fill;
+    if (fill > stats.fill_max) stats.fill_max = fill;
+    stats.ratio = drc_ratio;
+    stats.mixes++;
+    slock_unlock(stats_lock);
+
+    audio_s16_to_f32(input_float, samples, size * 2);
+    const float* out = input_float;
+    size_t out_frames = size;
+    if (!passthrough)
+    {
+        src_data.input_frames = size;
+        src_data.ratio = drc_ratio;
+        src_data.data_in = input_float;
+        src_data.data_out = output_float;
+        resampler_process(resample, &src_data);
+        out = output_float;
+        out_frames = src_data.output_frames;
+    }
+    if (wav)
+        wav_sink_write(wav, out, out_frames);
+    while (written < out_frames)
+    {
+        size_t amt = ring_write(_ring, out + written * 2, out_frames - written);
+        written += amt;
+        // audio sync: wait for the callback to drain; a stalled device
+        // drops the rest of the chunk instead of hanging the core. When
+        // something else paces the frames, DRC keeps the ring off full
+        // and anything over is dropped.
+        if (!amt && nonblocking)
+            break;
+        if (!amt)
         {
-            scond_wait(condz, lockz);
-            slock_unlock(lockz);
-            continue;
+            long long start = microseconds_now();
+            bool woke = ring_wait_writable(_ring, out_frames - written, 100000);
+            slock_lock(stats_lock);
+            stats.blocked_us += microseconds_now() - start;
+            slock_unlock(stats_lock);
+            if (!woke)
+                break;
         }
     }
 }
 
 mal_uint32 Audio::fill_buffer(uint8_t* out, mal_uint32 count) {
-    slock_lock(lockz);
-    size_t amount = fifo_read_avail(_fifo);
-    amount = count > amount ? amount : count;
-    fifo_read(_fifo, out, amount);
-    memset(out + amount, 0, count - amount);
-    scond_signal(condz);
-    slock_unlock(lockz);
+    size_t frame_size = _ring->frame_size;
+    size_t amount = ring_read(_ring, (float*)out, count / frame_size) * frame_size;
+    if (amount < count)
+    {
+        memset(out + amount, 0, count - amount);
+        underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (pull_thread && ring_read_avail(_ring) < pull_low && !pull_signalled.exchange(true))
+        plat_sem_post(pull_wake);
     return count;
 }
 
+audio_stats Audio::get_stats()
+{
+    if (stats_lock) slock_lock(stats_lock);
+    audio_stats s = stats;
+    if (stats_lock) slock_unlock(stats_lock);
+    s.underruns = underruns.load(std::memory_order_relaxed);
+    s.wav_dropped = wav ? wav_sink_dropped(wav) : 0;
+    if (!s.mixes)
+        s.fill_min = s.fill_max = 0.0;
+    return s;
+}
+
+void Audio::reset_stats()
+{
+    memset(&stats, 0, sizeof(stats));
+    stats.fill_min = 1.0;
+    underruns.store(0, std::memory_order_relaxed);
+}
+
@@ -2,85 +2,125 @@
 #define AUDIO_H
 
 #include <list>
-#include "../stdafx.h"
+#include "platform.h"
 #include "../3rdparty/mini_al.h"
 #include "../3rdparty/libretro.h"
 #include "../3rdparty/rthreads.h"
 #include "../3rdparty/resampler.h"
+#include "ring.h"
+#include "wav_sink.h"
+#include <vector>
+
+// mini_al backend names ("wasapi", "pulseaudio", ...) in a comma separated
+// list; false on an unknown name
+bool audio_parse_backends(const char* list, std::vector<mal_backend>* out);
+const char* audio_backend_name(mal_backend backend);
 
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-   struct fifo_buffer
+   struct audio_stats
    {
-      uint8_t *buffer;
-      size_t size;
-      size_t first;
-      size_t end;
+       double fill;            // ring fill fraction seen by the last mix
+       double fill_min;
+       double fill_max;
+       double ratio;           // resampler ratio chosen by the last mix
+       unsigned underruns;     // device callbacks that ran out of frames
+       long long blocked_us;   // time mix spent waiting for ring space
+       long long queue_blocked_us; // emulation thread waiting on the DSP queue
+       size_t wav_dropped;     // frames the WAV writer couldn't keep up with
+       unsigned mixes;
    };
 
-   typedef struct fifo_buffer fifo_buffer_t;
-
-   fifo_buffer_t *fifo_new(size_t size);
-
-   static __forceinline void fifo_clear(fifo_buffer_t *buffer)
-   {
-      buffer->first = 0;
-      buffer->end = 0;
-   }
-
-   void fifo_write(fifo_buffer_t *buffer, const void *in_buf, size_t size);
-
-   void fifo_read(fifo_buffer_t *buffer, void *in_buf, size_t size);
-
-   static __forceinline void fifo_free(fifo_buffer_t *buffer)
-   {
-      if (!buffer)
-         return;
-
-      free(buffer->buffer);
-      free(buffer);
-   }
-
-   static __forceinline size_t fifo_read_avail(fifo_buffer_t *buffer)
-   {
-      return (buffer->end + ((buffer->end < buffer->first) ? buffer->size : 0)) - buffer->first;
-   }
-
-   static __forceinline size_t fifo_write_avail(fifo_buffer_t *buffer)
-   {
-      return (buffer->size - 1) - ((buffer->end + ((buffer->end < buffer->first) ? buffer->size : 0)) - buffer->first);
-   }
-
-   long long microseconds_now();
-   long long milliseconds_now();
+   // s16 -> f32 at 1/32768, bit-identical to mal_pcm_s16_to_f32; the
+   // plain name picks the widest kernel the CPU runs
+   void audio_s16_to_f32(float* out, const int16_t* in, size_t samples);
+   void audio_s16_to_f32_sse2(float* out, const int16_t* in, size_t samples);
+   void audio_s16_to_f32_avx2(float* out, const int16_t* in, size_t samples);
 
    class Audio
    {
 
    public:
+       // tuning, read by init()/mix()
+       unsigned latency_frames; // device buffer and ring size
+       double drc_max_delta;    // largest rate adjustment, P and I together
+       double drc_ki;           // integral gain per mix call, 0 = P only
+       resampler_engine resampler;
+       resampler_quality quality; // sinc only
+       bool threaded_dsp;       // convert/resample on a worker, not in retro_run
+       bool nonblocking;        // drop rather than wait on a full ring (not audio sync)
+       // retro_audio_callback of cores that produce audio on demand
+       void (*pull_callback)(void);
+       void (*pull_set_state)(bool enabled);
+       double pull_target;      // ring fill the pull worker tops up to
+       std::vector<mal_backend> backends; // tried in order, empty = platform default
+       bool null_clock;         // no device: a thread consumes at null_rate
+       unsigned null_rate;
+       TCHAR wav_path[MAX_PATH]; // also write the device stream here if set
+
        mal_context context;
        mal_device device;
+       bool use_device;        // else the clocked null sink
+       sthread_t* clock_thread;
+       std::atomic<bool> clock_running;
+       std::atomic<bool> started;
+       wav_sink* wav;
        unsigned client_rate;
-       fifo_buffer* _fifo;
+       audio_ring* _ring;
        float fps;
        double system_fps;
        double skew;
        double system_rate;
        double resamp_original;
-       void* resample;
+       void* resample;         // NULL when passthrough
+       bool passthrough;       // device runs at the core's rate
        float *input_float;
        float *output_float;
-       slock_t *lockz;
-       scond_t *condz;
-
+       size_t output_frames;
+       int16_t *staging;       // interleaved stereo, filled during retro_run
+       size_t staged;
+       double drc_integral;
+       audio_stats stats;      // mix() writes them on whichever thread mixes
+       slock_t* stats_lock;
+       std::atomic<unsigned> underruns;
+       // DSP worker: raw core frames in, device ring out
+       audio_ring* dsp_ring;
+       int16_t* dsp_buffer;
+       sthread_t* dsp_thread;
+       std::atomic<bool> dsp_running;
+       // pull worker, woken from the device callback
+       sthread_t* pull_thread;
+       plat_sem* pull_wake;
+       int16_t* pull_staging;  // the worker's own; it alone stages and mixes
+       size_t pull_staged;
+       size_t pull_low;
+       std::atomic<bool> pull_running;
+       std::atomic<bool> pull_signalled;
+
+      Audio();
       bool init(double refreshra, retro_system_av_info av);
       void destroy();
       void reset();
+      bool start();
+      void stop();
+      size_t buffered();
       void mix(const int16_t* samples, size_t sample_count);
+      // ingest: stage what the core sends and mix it once per frame
+      void push(const int16_t* samples, size_t frames);
+      void push_sample(int16_t left, int16_t right);
+      void flush();
+      void stage(int16_t* buffer, size_t& count, const int16_t* samples, size_t frames);
+      void flush_staged(int16_t* buffer, size_t& count);
+      void queue(const int16_t* samples, size_t frames);
+      void dsp_loop();
+      void pull_loop();
+      void clock_loop();
       mal_uint32 fill_buffer(uint8_t* pSamples, mal_uint32 samplecount);
+      audio_stats get_stats();
+      void reset_stats();
       
    };
 
@@ -3,8 +3,9 @@
 #include "bind_list.h"
 
 #include <assert.h>
+#include <algorithm>
 
-#include <windows.h>
+#include "platform.h"
 
 #include "abstract_file.h"
 
@@ -27,6 +28,19 @@ class bind_list_i : public bind_list
 
 
 	std::vector< bind > list;
+	std::vector< bind_state > states; // one per list entry
+
+	// Which binds an event can touch, found by hashing what it came from:
+	// the device type, the device, the kind of control and the control.
+	// Rebuilt when the list changes, so process() only visits the binds
+	// each event is for.
+	struct dispatch_slot
+	{
+		uint64_t key; // 0 when empty
+		unsigned first, count; // into dispatch_binds
+	};
+	std::vector< dispatch_slot > dispatch; // open addressing, a power of two
+	std::vector< uint16_t > dispatch_binds; // bind indices grouped by key, in list order
 
 	/*CRITICAL_SECTION sync;
 
@@ -45,34 +59,120 @@ class bind_list_i : public bind_list
 
 	void press( unsigned which, int16_t value )
 	{
-		assert(which < list.size());
-		list[which].status = true;
-		list[which].value = value;
+		assert(which < states.size());
+		states[which].status = true;
+		states[which].value = value;
 	}
 
 	void release( unsigned which, int16_t value )
 	{
-		assert(which < list.size());
-		list[which].status = false;
-		if (list[which].retro_id < 16)
-		list[which].value = 0;
-		else list[which].value = value;
+		assert(which < states.size());
+		states[which].status = false;
+		if (states[which].retro_id < 16)
+		states[which].value = 0;
+		else states[which].value = value;
 	}
 
-public:
-	virtual bool getbutton(int which, int16_t & value, int & retro_id, bool & isanalog)
+	// after the list changes: one state per bind, values kept by index
+	void sync_states()
+	{
+		states.resize( list.size() );
+		for ( unsigned i = 0; i < list.size(); ++i )
+		{
+			const bind & b = list[ i ];
+			states[ i ].retro_id = (uint8_t)( b.retro_id < 255 ? b.retro_id : 255 );
+			states[ i ].analog = b.e.type == dinput::di_event::ev_xinput &&
+				b.e.xinput.type == dinput::di_event::xinput_axis && ( b.e.xinput.which == 1 || b.e.xinput.which == 3 );
+		}
+		build_dispatch();
+	}
+
+	static uint64_t event_key( const dinput::di_event & e )
+	{
+		uint64_t type, device, kind, which;
+		switch ( e.type )
+		{
+		case dinput::di_event::ev_key:
+			type = 1; device = 0; kind = 0; which = e.key.which;
+			break;
+		case dinput::di_event::ev_joy:
+			type = 2; device = e.joy.serial; kind = e.joy.type; which = e.joy.which;
+			break;
+		case dinput::di_event::ev_xinput:
+			type = 3; device = e.xinput.index; kind = e.xinput.type; which = e.xinput.which;
+			break;
+		default:
+			return 0; // matches nothing
+		}
+		return ( type << 62 ) | ( ( device & 0xfffffff ) << 34 ) | ( ( kind & 3 ) << 32 ) | ( which & 0xffffffff );
+	}
+
+	static unsigned slot_hash( uint64_t key, unsigned mask )
+	{
+		return (unsigned)( ( key * 0x9e3779b97f4a7c15ull ) >> 32 ) & mask;
+	}
+
+	void build_dispatch()
 	{
-		assert(which < list.size());
-		const bind & b = list[which];
-		value = b.value;
-		retro_id = b.retro_id;
-		isanalog = false;
-		if (b.e.joy.type == dinput::di_event::ev_xinput && 
-		b.e.xinput.type == dinput::di_event::xinput_axis && b.e.xinput.which == 1)
+		std::vector< std::pair< uint64_t, uint16_t > > keyed;
+		for ( unsigned i = 0; i < list.size() && i < 0x10000; ++i )
 		{
-			isanalog = true;
+			uint64_t key = event_key( list[ i ].e );
+			if ( key ) keyed.push_back( std::make_pair( key, (uint16_t)i ) );
 		}
-		return b.status;
+		std::stable_sort( keyed.begin(), keyed.end() );
+
+		unsigned size = 16;
+		while ( size < keyed.size() * 2 ) size <<= 1;
+		dispatch_slot empty = { 0, 0, 0 };
+		dispatch.assign( size, empty );
+		dispatch_binds.resize( keyed.size() );
+		for ( unsigned i = 0; i < keyed.size(); )
+		{
+			unsigned j = i;
+			for ( ; j < keyed.size() && keyed[ j ].first == keyed[ i ].first; ++j )
+				dispatch_binds[ j ] = keyed[ j ].second;
+			unsigned s = slot_hash( keyed[ i ].first, size - 1 );
+			while ( dispatch[ s ].key ) s = ( s + 1 ) & ( size - 1 );
+			dispatch[ s ].key = keyed[ i ].first;
+			dispatch[ s ].first = i;
+			dispatch[ s ].count = j - i;
+			i = j;
+		}
+	}
+
+	const uint16_t * find_binds( const dinput::di_event & e, unsigned & count )
+	{
+		count = 0;
+		uint64_t key = event_key( e );
+		if ( !key || dispatch.empty() ) return 0;
+		unsigned mask = dispatch.size() - 1;
+		for ( unsigned s = slot_hash( key, mask ); dispatch[ s ].key; s = ( s + 1 ) & mask )
+		{
+			if ( dispatch[ s ].key == key )
+			{
+				count = dispatch[ s ].count;
+				return &dispatch_binds[ dispatch[ s ].first ];
+			}
+		}
+		return 0;
+	}
+
+public:
+	virtual bool getbutton(int which, int16_t & value, int & retro_id, bool & isanalog)
+	{
+		assert(which < states.size());
+		const bind_state & s = states[which];
+		value = s.value;
+		retro_id = s.retro_id;
+		isanalog = s.analog;
+		return s.status;
+	}
+
+	virtual const bind_state * get_states( unsigned & count )
+	{
+		count = states.size();
+		return count ? &states[ 0 ] : 0;
 	}
 
 
@@ -116,12 +216,12 @@ public:
 			bind b = { 0 };
 			b.e = e;
 			b.action = action;
-			b.status = false;
-			b.value = 0;
 			b.retro_id = retro_id;
-			lstrcpy(b.description, description);
+			_tcscpy(b.description, description);
 			list.push_back( b );
-
+			bind_state s = { 0 };
+			states.push_back( s );
+			sync_states();
 
 
 		unlock();
@@ -146,7 +246,7 @@ public:
 			e = b.e;
 			action = b.action;
 			retro_id = b.retro_id;
-			lstrcpy(description, (TCHAR*)b.description);
+			_tcscpy(description, (TCHAR*)b.description);
 		unlock();
 	}
 
@@ -165,6 +265,8 @@ public:
 			}
 
 			list.erase( it );
+			states.erase( states.begin() + index );
+			sync_states();
 		unlock();
 	}
 
@@ -182,6 +284,8 @@ public:
 				}
 			}
 			list.clear();
+			states.clear();
+			sync_states();
 		unlock();
 	}
 
@@ -210,20 +314,21 @@ public:
 				b.e = e;
 				b.action = action;
 				b.retro_id = retro_id;
-				lstrcpy(b.description, description);
+				_tcscpy(b.description, description);
 			}
 			else
 			{
 				b.e = list2.at(i).e;
 				b.action = list2.at(i).action;
 				b.retro_id = list2.at(i).retro_id;
-				lstrcpy(b.description, list2.at(i).description);
+				_tcscpy(b.description, list2.at(i).description);
 			}
 			if (guids->get_guid(b.e.joy.serial, guid))
 				guids->add(guid);
 			list.push_back(b);
 		}
 		list2.clear();
+		sync_states();
 
 		unlock();
 	}
@@ -298,6 +403,7 @@ public:
 				err = 0;
 			}
 			while ( 0 );
+			sync_states();
 
 		unlock();
 
@@ -369,141 +475,64 @@ public:
 		return err;
 	}
 
-	virtual void process( std::vector< dinput::di_event > & events )
+	virtual void process( dinput::di_event_ring & events )
 	{
 		lock();
-			std::vector< dinput::di_event >::iterator it;
-			for ( it = events.begin(); it < events.end(); ++it )
+			dinput::di_event ev;
+			while ( events.pop( ev ) )
 			{
-				std::vector< bind >::iterator itb;
-				if ( it->type == dinput::di_event::ev_key ||
-					( it->type == dinput::di_event::ev_joy &&
-					  it->joy.type == dinput::di_event::joy_button ) ||
-					( it->type == dinput::di_event::ev_xinput &&
-					  it->xinput.type == dinput::di_event::xinput_button ) )
+				unsigned n;
+				const uint16_t * b = find_binds( ev, n );
+				unsigned i;
+				if ( ev.type == dinput::di_event::ev_key )
 				{
-					// two state
-					if ( it->type == dinput::di_event::ev_key )
+					for ( i = 0; i < n; ++i )
 					{
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_key &&
-								itb->e.key.which == it->key.which )
-							{
-								if ( it->key.type == dinput::di_event::key_down ) press( itb->action, 65535 );
-								else release( itb->action, 0 );
-							}
-						}
-					}
-					else
-					{
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( ( itb->e.type == dinput::di_event::ev_joy &&
-								itb->e.joy.serial == it->joy.serial &&
-								itb->e.joy.type == dinput::di_event::joy_button &&
-								itb->e.joy.which == it->joy.which ) ||
-								( itb->e.type == dinput::di_event::ev_xinput &&
-								itb->e.xinput.index == it->xinput.index &&
-								itb->e.xinput.type == dinput::di_event::xinput_button &&
-								itb->e.xinput.which == it->xinput.which ) )
-							{
-								if ( ( it->type == dinput::di_event::ev_joy && it->joy.button == dinput::di_event::button_down ) ||
-									( it->type == dinput::di_event::ev_xinput && it->xinput.button == dinput::di_event::button_down ) ) press( itb->action, 65535 );
-								else release( itb->action, 0 );
-							}
-						}
+						if ( ev.key.type == dinput::di_event::key_down ) press( list[ b[ i ] ].action, 65535 );
+						else release( list[ b[ i ] ].action, 0 );
 					}
 				}
-				else if ( it->type == dinput::di_event::ev_joy )
+				else if ( ( ev.type == dinput::di_event::ev_joy && ev.joy.type == dinput::di_event::joy_button ) ||
+					( ev.type == dinput::di_event::ev_xinput && ev.xinput.type == dinput::di_event::xinput_button ) )
 				{
-					// mutually exclusive in class set
-					if ( it->joy.type == dinput::di_event::joy_axis )
-					{
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_joy &&
-								itb->e.joy.serial == it->joy.serial &&
-								itb->e.joy.type == dinput::di_event::joy_axis &&
-								itb->e.joy.which == it->joy.which )
-							{
-								if ( it->joy.axis != itb->e.joy.axis && it->joy.axis != dinput::di_event::axis_center) release( itb->action, ( it->joy.axis == dinput::di_event::axis_negative ) ? ( ( it->joy.value ) ) : ( ( it->joy.value - 0 ) ) );
-							}
-						}
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_joy &&
-								itb->e.joy.serial == it->joy.serial &&
-								itb->e.joy.type == dinput::di_event::joy_axis &&
-								itb->e.joy.which == it->joy.which )
-							{
-								if ( it->joy.axis == itb->e.joy.axis && it->joy.axis != dinput::di_event::axis_center) press( itb->action, ( it->joy.axis == dinput::di_event::axis_negative ) ? ( (it->joy.value )) : ( ( it->joy.value - 0 ) ) );
-							}
-						}
-					}
-					else if ( it->joy.type == dinput::di_event::joy_pov )
+					// two state
+					bool down = ev.type == dinput::di_event::ev_joy ? ev.joy.button == dinput::di_event::button_down :
+						ev.xinput.button == dinput::di_event::button_down;
+					for ( i = 0; i < n; ++i )
 					{
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_joy &&
-								itb->e.joy.serial == it->joy.serial &&
-								itb->e.joy.type == dinput::di_event::joy_pov &&
-								itb->e.joy.which == it->joy.which )
-							{
-								if ( it->joy.pov_angle != itb->e.joy.pov_angle ) release( itb->action, 0 );
-							}
-						}
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_joy &&
-								itb->e.joy.serial == it->joy.serial &&
-								itb->e.joy.type == dinput::di_event::joy_pov &&
-								itb->e.joy.which == it->joy.which )
-							{
-								if ( it->joy.pov_angle == itb->e.joy.pov_angle ) press( itb->action, 65535 );
-							}
-						}
+						if ( down ) press( list[ b[ i ] ].action, 65535 );
+						else release( list[ b[ i ] ].action, 0 );
 					}
 				}
-				else if ( it->type == dinput::di_event::ev_xinput )
+				else if ( ev.type == dinput::di_event::ev_joy && ev.joy.type == dinput::di_event::joy_axis )
 				{
-					// mutually exclusive in class set
-					if ( it->xinput.type == dinput::di_event::xinput_axis )
-					{
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_xinput &&
-								itb->e.xinput.index == it->xinput.index &&
-								itb->e.xinput.type == dinput::di_event::xinput_axis &&
-								itb->e.xinput.which == it->xinput.which )
-							{
-								if (it->xinput.axis != itb->e.xinput.axis)release(itb->action, it->joy.value);
-							}
-						}
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_xinput &&
-								itb->e.xinput.index == it->xinput.index &&
-								itb->e.xinput.type == dinput::di_event::xinput_axis &&
-								itb->e.xinput.which == it->xinput.which )
-							{
-								if (it->xinput.axis == itb->e.xinput.axis) press(itb->action, it->joy.value);
-							}
-						}
-					}
-					else if ( it->xinput.type == dinput::di_event::xinput_trigger )
+					// mutually exclusive in class set: release the other direction first
+					if ( ev.joy.axis == dinput::di_event::axis_center ) continue;
+					for ( i = 0; i < n; ++i )
+						if ( list[ b[ i ] ].e.joy.axis != ev.joy.axis ) release( list[ b[ i ] ].action, ev.joy.value );
+					for ( i = 0; i < n; ++i )
+						if ( list[ b[ i ] ].e.joy.axis == ev.joy.axis ) press( list[ b[ i ] ].action, ev.joy.value );
+				}
+				else if ( ev.type == dinput::di_event::ev_joy && ev.joy.type == dinput::di_event::joy_pov )
+				{
+					for ( i = 0; i < n; ++i )
+						if ( list[ b[ i ] ].e.joy.pov_angle != ev.joy.pov_angle ) release( list[ b[ i ] ].action, 0 );
+					for ( i = 0; i < n; ++i )
+						if ( list[ b[ i ] ].e.joy.pov_angle == ev.joy.pov_angle ) press( list[ b[ i ] ].action, 65535 );
+				}
+				else if ( ev.type == dinput::di_event::ev_xinput && ev.xinput.type == dinput::di_event::xinput_axis )
+				{
+					for ( i = 0; i < n; ++i )
+						if ( list[ b[ i ] ].e.xinput.axis != ev.xinput.axis ) release( list[ b[ i ] ].action, ev.xinput.value );
+					for ( i = 0; i < n; ++i )
+						if ( list[ b[ i ] ].e.xinput.axis == ev.xinput.axis ) press( list[ b[ i ] ].action, ev.xinput.value );
+				}
+				else if ( ev.type == dinput::di_event::ev_xinput && ev.xinput.type == dinput::di_event::xinput_trigger )
+				{
+					for ( i = 0; i < n; ++i )
 					{
-						for ( itb = list.begin(); itb < list.end(); ++itb )
-						{
-							if ( itb->e.type == dinput::di_event::ev_xinput &&
-								itb->e.xinput.index == it->xinput.index &&
-								itb->e.xinput.type == dinput::di_event::xinput_trigger &&
-								itb->e.xinput.which == it->xinput.which )
-							{
-								if ( it->xinput.button == dinput::di_event::button_down ) press( itb->action, it->xinput.value * 257 );
-								else release( itb->action, it->xinput.value * 257 );
-							}
-						}
+						if ( ev.xinput.button == dinput::di_event::button_down ) press( list[ b[ i ] ].action, ev.xinput.value * 257 );
+						else release( list[ b[ i ] ].action, ev.xinput.value * 257 );
 					}
 				}
 			}
@@ -23,15 +23,23 @@ public:
 		bind_pad_0_right,
 	};
 
+	// configuration, only read when binds are edited or events matched
 	struct bind
 	{
 		unsigned         action;
 		dinput::di_event e;
-		bool           status;
-		int16_t         value;
 		TCHAR description[64];
 		unsigned retro_id;
-		bool isxinput_y;
+	};
+
+	// what the bind currently reads, kept apart from the config so a scan
+	// over every bind touches a few bytes each
+	struct bind_state
+	{
+		int16_t value;
+		uint8_t retro_id;
+		bool    status;
+		bool    analog; // an XInput stick Y axis: up is positive there, down in libretro
 	};
 
 	virtual ~bind_list() {}
@@ -47,6 +55,9 @@ public:
 
 	virtual bool getbutton(int which, int16_t & value,int & retro_id,bool & isanalog) = 0;
 
+	// the state of every bind, in list order
+	virtual const bind_state * get_states( unsigned & count ) = 0;
+
 	virtual void get( unsigned index, dinput::di_event &, unsigned & action , TCHAR * description, unsigned & retro_id) = 0;
 
 	virtual void remove( unsigned index ) = 0;
@@ -59,7 +70,8 @@ public:
 	virtual const char * save( Data_Writer & ) = 0;
 
 	// input handling
-	virtual void process( std::vector< dinput::di_event > & ) = 0;
+	// drains the events
+	virtual void process( dinput::di_event_ring & ) = 0;
 	
 	virtual unsigned read( ) = 0;
 
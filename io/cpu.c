@@ -0,0 +1,84 @@
+#include "cpu.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+static void cpuid(int leaf, int sub, int regs[4])
+{
+    __cpuidex(regs, leaf, sub);
+}
+static unsigned long long xgetbv0(void)
+{
+    return _xgetbv(0);
+}
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+static void cpuid(int leaf, int sub, int regs[4])
+{
+    unsigned a, b, c, d;
+    __cpuid_count(leaf, sub, a, b, c, d);
+    regs[0] = a; regs[1] = b; regs[2] = c; regs[3] = d;
+}
+static unsigned long long xgetbv0(void)
+{
+    unsigned lo, hi;
+    __asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((unsigned long long)hi << 32) | lo;
+}
+#else
+#define CPU_NO_CPUID
+#endif
+
+static unsigned probe(void)
+{
+#ifdef CPU_NO_CPUID
+    return 0;
+#else
+    int regs[4];
+    unsigned flags = 0;
+    int max_leaf;
+    unsigned long long xcr0 = 0;
+
+    cpuid(0, 0, regs);
+    max_leaf = regs[0];
+    if (max_leaf < 1)
+        return 0;
+
+    cpuid(1, 0, regs);
+    if (regs[3] & (1 << 26)) flags |= CPU_SSE2;
+    if (regs[2] & (1 << 9))  flags |= CPU_SSSE3;
+    if (regs[2] & (1 << 19)) flags |= CPU_SSE41;
+    // OSXSAVE, then check the OS enabled XMM/YMM (and ZMM) state
+    if (regs[2] & (1 << 27))
+        xcr0 = xgetbv0();
+    if ((xcr0 & 6) == 6)
+    {
+        if (regs[2] & (1 << 28)) flags |= CPU_AVX;
+        if (regs[2] & (1 << 12)) flags |= CPU_FMA3;
+    }
+    if (max_leaf >= 7 && (flags & CPU_AVX))
+    {
+        cpuid(7, 0, regs);
+        if (regs[1] & (1 << 5)) flags |= CPU_AVX2;
+        if ((xcr0 & 0xe6) == 0xe6)
+        {
+            if (regs[1] & (1 << 16)) flags |= CPU_AVX512F;
+            if (regs[1] & (1 << 30)) flags |= CPU_AVX512BW;
+        }
+    }
+    return flags;
+#endif
+}
+
+unsigned cpu_features(void)
+{
+    // benign race: every thread computes the same value
+    static volatile unsigned cached = 0;
+    static volatile int probed = 0;
+    if (!probed)
+    {
+        cached = probe();
+        probed = 1;
+    }
+    return cached;
+}
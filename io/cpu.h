@@ -0,0 +1,37 @@
+#ifndef _cpu_h_
+#define _cpu_h_
+
+// x86 feature bits, probed once, for picking SIMD kernels at runtime.
+// AVX and wider only count when the OS saves the larger register state.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum
+{
+    CPU_SSE2     = 1 << 0,
+    CPU_SSSE3    = 1 << 1,
+    CPU_SSE41    = 1 << 2,
+    CPU_AVX      = 1 << 3,
+    CPU_AVX2     = 1 << 4,
+    CPU_FMA3     = 1 << 5,
+    CPU_AVX512F  = 1 << 6,
+    CPU_AVX512BW = 1 << 7
+};
+
+unsigned cpu_features(void);
+
+// lets gcc/clang compile a kernel for a wider ISA than the rest of the
+// file; MSVC accepts the intrinsics without it
+#if defined(__GNUC__) || defined(__clang__)
+#define CPU_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CPU_TARGET(isa)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
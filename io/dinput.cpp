@@ -416,9 +416,8 @@ public:
         rbutton = mousie.rbutton;
     }
 
-    virtual std::vector< di_event > read()
+    virtual void read(di_event_ring & events)
     {
-        std::vector< di_event > events;
         di_event e;
 
         HRESULT hr;
@@ -451,7 +450,7 @@ public:
                     if (od.dwData & 0x80) e.key.type = di_event::key_down;
                     else e.key.type = di_event::key_up;
 
-                    events.push_back(e);
+                    events.push(e);
                 }
             }
         }
@@ -504,7 +503,7 @@ public:
                             //e.joy.value = 0;
                         }
 
-                        events.push_back(e);
+                        events.push(e);
                     }
                     else if (od.dwOfs >= DIJOFS_POV(0) && od.dwOfs <= DIJOFS_POV(3))
                     {
@@ -513,7 +512,7 @@ public:
                         e.joy.pov_angle = od.dwData;
                         if (e.joy.pov_angle != ~0) e.joy.pov_angle /= DI_DEGREES;
 
-                        events.push_back(e);
+                        events.push(e);
                     }
                     else if (od.dwOfs >= DIJOFS_BUTTON(0) && od.dwOfs <= DIJOFS_BUTTON(31))
                     {
@@ -523,7 +522,7 @@ public:
                         if (od.dwData & 0x80) e.joy.button = di_event::button_down;
                         else e.joy.button = di_event::button_up;
 
-                        events.push_back(e);
+                        events.push(e);
                     }
                 }
             }
@@ -545,7 +544,7 @@ public:
 #define XINPUT_PUSH_AXIS(n, stick, v) \
 				e.xinput.which = n; \
 				e.xinput.value = ((xinput_##stick##_stick_deadzone(state.Gamepad.##v))); \
-				if ( xinput_##stick##_stick_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.axis ) ) events.push_back( e )
+				if ( xinput_##stick##_stick_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.axis ) ) events.push( e )
 
                 XINPUT_PUSH_AXIS(0, left, sThumbLX);
                 XINPUT_PUSH_AXIS(1, left, sThumbLY);
@@ -559,7 +558,7 @@ public:
 #define XINPUT_PUSH_TRIGGER(n, v) \
 				e.xinput.which = n; \
 				e.xinput.value = xinput_trigger_deadzone( state.Gamepad.##v ); \
-				if ( xinput_trigger_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.button ) ) events.push_back( e )
+				if ( xinput_trigger_motion( xinput_last_state[ i ].Gamepad.##v, state.Gamepad.##v, &e.xinput.button ) ) events.push( e )
 
                 XINPUT_PUSH_TRIGGER(0, bLeftTrigger);
                 XINPUT_PUSH_TRIGGER(1, bRightTrigger);
@@ -577,15 +576,13 @@ public:
                         e.xinput.which = button;
                         if (state.Gamepad.wButtons & mask) e.xinput.button = di_event::button_down;
                         else e.xinput.button = di_event::button_up;
-                        events.push_back(e);
+                        events.push(e);
                     }
                 }
 
                 xinput_last_state[i] = state;
             }
         }
-
-        return events;
     }
 
     virtual void set_focus(bool is_focused)
@@ -3,7 +3,7 @@
 
 #include <vector>
 
-#include <tchar.h>
+#include "platform.h"
 
 class guid_container;
 
@@ -115,11 +115,47 @@ public:
         };
     };
 
+    // A poll's events, in a buffer the caller owns and keeps, so reading
+    // them allocates nothing. When it's full new events are dropped and
+    // counted.
+    struct di_event_ring
+    {
+        enum { capacity = 256 }; // a power of two
+        di_event events[capacity];
+        unsigned head, tail; // free running; tail - head are queued
+        unsigned dropped;
+
+        di_event_ring() : head(0), tail(0), dropped(0) {}
+
+        bool push(const di_event & e)
+        {
+            if (tail - head == capacity)
+            {
+                dropped++;
+                return false;
+            }
+            events[tail++ & (capacity - 1)] = e;
+            return true;
+        }
+
+        bool pop(di_event & e)
+        {
+            if (head == tail)
+                return false;
+            e = events[head++ & (capacity - 1)];
+            return true;
+        }
+
+        unsigned size() const { return tail - head; }
+        void clear() { head = tail; }
+    };
+
     virtual ~dinput() {}
 
     virtual const char* open(void * di8, void * hwnd, guid_container *) = 0;
 
-    virtual std::vector< di_event > read() = 0;
+    // appends the events since the last read
+    virtual void read(di_event_ring & events) = 0;
 
     virtual void readmouse(int16_t & x, int16_t & y, bool & lbutton, bool & rbutton) = 0;
     virtual void poll_mouse() = 0;
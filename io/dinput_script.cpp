@@ -0,0 +1,242 @@
+#include "dinput_script.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+// the script's own pad, past any serial guid_container hands out; event
+// keys in bind_list keep 28 bits of it
+#define SCRIPT_PAD_SERIAL 0xfffffff
+#define SCRIPT_PAD_BUTTONS 16
+
+// libretro joypad ids 0-15
+static const char *pad_names[SCRIPT_PAD_BUTTONS] = {
+    "b", "y", "select", "start", "up", "down", "left", "right",
+    "a", "x", "l", "r", "l2", "r2", "l3", "r3"
+};
+
+static dinput::di_event pad_event(unsigned button)
+{
+    dinput::di_event e = dinput::di_event();
+    e.type = dinput::di_event::ev_joy;
+    e.joy.serial = SCRIPT_PAD_SERIAL;
+    e.joy.type = dinput::di_event::joy_button;
+    e.joy.which = button;
+    return e;
+}
+
+// the control's event, pressed; pad is the pad button, or -1
+static bool parse_control(const char *s, dinput::di_event & e, int & pad)
+{
+    char *end;
+    pad = -1;
+    e = dinput::di_event();
+    if (!strncmp(s, "key:", 4))
+    {
+        e.type = dinput::di_event::ev_key;
+        e.key.type = dinput::di_event::key_down;
+        e.key.which = strtoul(s + 4, &end, 0);
+        return end != s + 4 && !*end;
+    }
+    if (!strncmp(s, "joy:", 4))
+    {
+        e.type = dinput::di_event::ev_joy;
+        e.joy.type = dinput::di_event::joy_button;
+        e.joy.button = dinput::di_event::button_down;
+        e.joy.serial = strtoul(s + 4, &end, 0);
+        if (end == s + 4 || *end != ':')
+            return false;
+        const char *which = end + 1;
+        e.joy.which = strtoul(which, &end, 0);
+        return end != which && !*end && e.joy.serial < SCRIPT_PAD_SERIAL;
+    }
+    for (unsigned i = 0; i < SCRIPT_PAD_BUTTONS; i++)
+        if (!strcmp(s, pad_names[i]))
+        {
+            e = pad_event(i);
+            e.joy.button = dinput::di_event::button_down;
+            pad = i;
+            return true;
+        }
+    return false;
+}
+
+static dinput::di_event released(dinput::di_event e)
+{
+    if (e.type == dinput::di_event::ev_key)
+        e.key.type = dinput::di_event::key_up;
+    else
+        e.joy.button = dinput::di_event::button_up;
+    return e;
+}
+
+class dinput_script_i : public dinput_script
+{
+    struct entry
+    {
+        unsigned frame;
+        di_event e;
+    };
+
+    static bool earlier(const entry & a, const entry & b)
+    {
+        return a.frame < b.frame;
+    }
+
+    std::vector< entry > entries; // by frame, in script order within one
+    unsigned next;
+    unsigned frame;
+    bool pad_used[SCRIPT_PAD_BUTTONS];
+    char error[80];
+
+    void add(unsigned frame, const di_event & e)
+    {
+        entry n = { frame, e };
+        entries.push_back(n);
+    }
+
+public:
+    dinput_script_i() : next(0), frame(0)
+    {
+        memset(&mousie, 0, sizeof(mousie));
+        memset(pad_used, 0, sizeof(pad_used));
+        error[0] = 0;
+    }
+
+    virtual const char* open(void * di8, void * hwnd, guid_container *)
+    {
+        return 0;
+    }
+
+    virtual const char* load(const TCHAR * path)
+    {
+        FILE *fp = _tfopen(path, _T("r"));
+        if (!fp)
+            return "Couldn't open the input script";
+        entries.clear();
+        next = 0;
+        memset(pad_used, 0, sizeof(pad_used));
+        const char *err = 0;
+        char line[256];
+        for (unsigned number = 1; !err && fgets(line, sizeof(line), fp); number++)
+        {
+            char *comment = strchr(line, '#');
+            if (comment)
+                *comment = 0;
+            if (!line[strspn(line, " \t\r\n")])
+                continue; // blank
+            char control[64], action[16];
+            unsigned at, frames = 1;
+            int fields = sscanf(line, "%u %63s %15s %u", &at, control, action, &frames);
+            di_event e;
+            int pad;
+            if (fields < 3)
+                err = "expected <frame> <control> down|up|tap";
+            else if (!parse_control(control, e, pad))
+                err = "unknown control";
+            else if (!frames)
+                err = "tap for no frames";
+            else if (!strcmp(action, "down") && fields == 3)
+                add(at, e);
+            else if (!strcmp(action, "up") && fields == 3)
+                add(at, released(e));
+            else if (!strcmp(action, "tap"))
+            {
+                add(at, e);
+                add(at + frames, released(e));
+            }
+            else
+                err = "expected down, up or tap";
+            if (err)
+            {
+                snprintf(error, sizeof(error), "Input script line %u: %s", number, err);
+                err = error;
+            }
+            else if (pad >= 0)
+                pad_used[pad] = true;
+        }
+        fclose(fp);
+        std::stable_sort(entries.begin(), entries.end(), earlier);
+        return err;
+    }
+
+    virtual void bind(bind_list * bl)
+    {
+        for (unsigned id = 0; id < SCRIPT_PAD_BUTTONS; id++)
+        {
+            if (!pad_used[id])
+                continue;
+            unsigned i, count = bl->get_count();
+            for (i = 0; i < count; i++)
+            {
+                di_event e;
+                unsigned action, retro_id;
+                TCHAR description[64];
+                bl->get(i, e, action, description, retro_id);
+                if (retro_id == id)
+                {
+                    bl->replace(i, pad_event(id), action, description, retro_id);
+                    break;
+                }
+            }
+            if (i == count)
+            {
+                // a core that set no descriptors still reads the pad
+                TCHAR description[64];
+                plat_from_utf8(pad_names[id], description, 64);
+                bl->add(pad_event(id), count, description, id);
+            }
+        }
+    }
+
+    virtual void set_frame(unsigned frame)
+    {
+        this->frame = frame;
+    }
+
+    virtual unsigned get_count()
+    {
+        return entries.size();
+    }
+
+    virtual unsigned get_played()
+    {
+        return next;
+    }
+
+    virtual void read(di_event_ring & events)
+    {
+        // a full ring keeps the rest for the next read rather than drop them
+        while (next < entries.size() && entries[next].frame <= frame &&
+            events.size() < di_event_ring::capacity)
+            events.push(entries[next++].e);
+    }
+
+    virtual void readmouse(int16_t & x, int16_t & y, bool & lbutton, bool & rbutton)
+    {
+        x = y = 0;
+        lbutton = rbutton = false;
+    }
+
+    virtual void poll_mouse()
+    {
+    }
+
+    virtual void set_focus(bool)
+    {
+    }
+
+    virtual void refocus(void * hwnd)
+    {
+    }
+
+    virtual const TCHAR * get_joystick_name(unsigned)
+    {
+        return _T("Script");
+    }
+};
+
+dinput_script * create_dinput_script()
+{
+    return new dinput_script_i;
+}
@@ -0,0 +1,46 @@
+#ifndef _dinput_script_h_
+#define _dinput_script_h_
+
+#include "dinput.h"
+#include "bind_list.h"
+
+// A dinput backend that plays input from a script instead of reading
+// devices, so headless runs can get past a title screen and play the
+// same way every time. The frontend tells it the frame about to run, and
+// the next read hands over every event scripted up to that frame; they
+// go through bind_list::process like any device's.
+//
+// A script is text, one change a line, blank lines and # comments ignored:
+//
+//   <frame> <control> down|up|tap [frames]
+//
+// where a control is one of
+//
+//   b y select start up down left right a x l r l2 r2 l3 r3
+//       a button of the script's own pad; bind() points the core's binds
+//       for these at it, so scripts don't depend on the input config
+//   key:<n>        a keyboard scan code (DIK_*), through the binds as
+//                  configured
+//   joy:<s>:<n>    button n of joystick s, likewise
+//
+// and tap presses for a frame, or the given number of them.
+
+class dinput_script : public dinput
+{
+public:
+    virtual const char* load(const TCHAR * path) = 0;
+
+    // rebinds the pad buttons the script uses; call once the core has
+    // set up its binds
+    virtual void bind(bind_list *) = 0;
+
+    virtual void set_frame(unsigned frame) = 0;
+
+    // events in the script, and how many have been read so far
+    virtual unsigned get_count() = 0;
+    virtual unsigned get_played() = 0;
+};
+
+dinput_script * create_dinput_script();
+
+#endif
@@ -0,0 +1,50 @@
+#include "frame_diff.h"
+#include "platform.h"
+#include <string.h>
+
+bool frame_shadow_same(frame_shadow *s, const void *data, unsigned width, unsigned height,
+    size_t pitch, unsigned bpp)
+{
+    size_t row = (size_t)width * bpp;
+    const uint8_t *src = (const uint8_t*)data;
+    unsigned y = 0;
+    if (s->valid && s->width == width && s->height == height && s->row == row)
+    {
+        while (y < height && !memcmp(s->buf + y * row, src + y * pitch, row))
+            y++;
+        if (y == height)
+            return true;
+    }
+    else
+    {
+        if (s->size < row * height)
+        {
+            plat_aligned_free(s->buf);
+            s->buf = (uint8_t*)plat_aligned_alloc(64, row * height);
+            s->size = s->buf ? row * height : 0;
+            if (!s->buf)
+            {
+                s->valid = false;
+                return false;
+            }
+        }
+        s->width = width;
+        s->height = height;
+        s->row = row;
+    }
+    for (; y < height; y++)
+        memcpy(s->buf + y * row, src + y * pitch, row);
+    s->valid = true;
+    return false;
+}
+
+void frame_shadow_invalidate(frame_shadow *s)
+{
+    s->valid = false;
+}
+
+void frame_shadow_free(frame_shadow *s)
+{
+    plat_aligned_free(s->buf);
+    memset(s, 0, sizeof(*s));
+}
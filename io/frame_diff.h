@@ -0,0 +1,30 @@
+#ifndef _frame_diff_h_
+#define _frame_diff_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Keeps a cached copy of the last software frame so one the core sent
+// again unchanged can skip its upload. Rows are compared in order and the
+// compare stops at the first that differs; from there on the rows are
+// copied instead, so a changed frame costs about one read and a partial
+// write on top of the upload it needs anyway.
+
+struct frame_shadow
+{
+    uint8_t *buf;
+    size_t size;
+    unsigned width, height;
+    size_t row; // bytes per row, packed
+    bool valid;
+};
+
+// true when the frame matches the previous one; otherwise the shadow now
+// holds this frame
+bool frame_shadow_same(frame_shadow *s, const void *data, unsigned width, unsigned height,
+    size_t pitch, unsigned bpp);
+// the next frame compares as changed, e.g. after one bypassed the shadow
+void frame_shadow_invalidate(frame_shadow *s);
+void frame_shadow_free(frame_shadow *s);
+
+#endif
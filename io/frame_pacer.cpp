@@ -0,0 +1,78 @@
+#include "frame_pacer.h"
+
+// spun on top of the measured oversleep
+#define PACER_SPIN_SLACK_US 100
+// oversleep estimate the first sleeps start from
+#define PACER_INITIAL_OVERSLEEP_US 1000
+
+static const char *pace_names[] = { "auto", "audio", "video", "timer", "free" };
+
+const char *pace_mode_name(pace_mode mode)
+{
+    return (unsigned)mode < sizeof(pace_names) / sizeof(pace_names[0]) ? pace_names[mode] : "?";
+}
+
+bool pace_parse_mode(const char *name, pace_mode *mode)
+{
+    for (unsigned i = 0; i < sizeof(pace_names) / sizeof(pace_names[0]); i++)
+        if (!strcmp(name, pace_names[i]))
+        {
+            *mode = (pace_mode)i;
+            return true;
+        }
+    return false;
+}
+
+void pacer_init(frame_pacer *p, double fps)
+{
+    p->period_us = fps > 0 ? 1000000.0 / fps : 1000000.0 / 60.0;
+    p->oversleep = PACER_INITIAL_OVERSLEEP_US;
+    p->frames = 0;
+    p->missed = 0;
+    pacer_reset(p);
+}
+
+void pacer_reset(frame_pacer *p)
+{
+    p->deadline = (double)microseconds_now();
+}
+
+long long pacer_wait(frame_pacer *p)
+{
+    p->frames++;
+    p->deadline += p->period_us;
+    long long deadline = (long long)p->deadline;
+    long long now = microseconds_now();
+    if (now >= deadline)
+    {
+        // a whole period behind: start over rather than run a burst of
+        // frames to catch up
+        if (now - deadline > (long long)p->period_us)
+            p->deadline = (double)now;
+        p->missed++;
+        return now - deadline;
+    }
+    return pacer_wait_until(p, deadline);
+}
+
+long long pacer_wait_until(frame_pacer *p, long long deadline)
+{
+    long long now = microseconds_now();
+    if (now >= deadline)
+        return now - deadline;
+    long long sleep = deadline - now - (long long)p->oversleep - PACER_SPIN_SLACK_US;
+    if (sleep > 0)
+    {
+        plat_sleep_us(sleep);
+        long long late = microseconds_now() - now - sleep;
+        if (late < 0)
+            late = 0;
+        // jumps up at once, creeps back down over a few seconds of frames
+        if (late > p->oversleep)
+            p->oversleep = (double)late;
+        else
+            p->oversleep += (late - p->oversleep) * 0.01;
+    }
+    while ((now = microseconds_now()) < deadline);
+    return now - deadline;
+}
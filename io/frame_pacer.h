@@ -0,0 +1,43 @@
+#ifndef _frame_pacer_h_
+#define _frame_pacer_h_
+
+#include "platform.h"
+
+// Decides what holds the run loop to the content's frame rate, and for
+// PACE_TIMER is that clock. The wait sleeps until shortly before the
+// deadline and spins the rest; the spin margin follows how late the OS
+// has actually been waking us, so it stays small where sleeps are precise
+// and grows where they are not.
+
+enum pace_mode
+{
+    PACE_AUTO,  // audio when there is a device, else video (free headless)
+    PACE_AUDIO, // mix blocks on the device ring
+    PACE_VIDEO, // SwapBuffers blocks on vblank
+    PACE_TIMER, // frame_pacer deadlines at the content's fps, no vsync
+    PACE_FREE   // as fast as it goes
+};
+
+const char *pace_mode_name(pace_mode mode);
+// false on an unknown name
+bool pace_parse_mode(const char *name, pace_mode *mode);
+
+struct frame_pacer
+{
+    double period_us;
+    double deadline;   // of the next frame, on microseconds_now()
+    double oversleep;  // decaying max of how late sleeps return
+    unsigned frames;
+    unsigned missed;   // deadlines already passed when asked to wait
+};
+
+void pacer_init(frame_pacer *p, double fps);
+// restarts the clock, e.g. after a pause, so no frames are made up
+void pacer_reset(frame_pacer *p);
+// waits for the next deadline; returns how far past it we woke, in us
+long long pacer_wait(frame_pacer *p);
+// the same sleep-then-spin wait for an arbitrary microseconds_now() time,
+// without touching the frame deadline
+long long pacer_wait_until(frame_pacer *p, long long deadline);
+
+#endif
@@ -2,8 +2,12 @@
 #include "../3rdparty/libretro.h"
 #include "glad.h"
 #include "gl_render.h"
+#include "pixconv.h"
+#include "frame_diff.h"
+#include "triple_buffer.h"
 #include <math.h>
 video g_video;
+video_present_stats g_present_stats;
 
 static const PIXELFORMATDESCRIPTOR pfd =
 {
@@ -34,6 +38,62 @@ static struct {
 static float g_scale = 2;
 static bool g_win = false;
 
+// Frames reach the texture through a small ring of pixel unpack buffers:
+// the core's frame is copied into buffer N and glTexSubImage2D sources
+// from it, so the driver's DMA runs while the next frame is emulated. A
+// fence after each draw keeps a buffer from being rewritten before the
+// GPU has read it. With GL 4.4 / ARB_buffer_storage the buffers stay
+// mapped for their whole life; otherwise each is mapped per frame.
+#define PBO_COUNT 3
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+static struct {
+    GLuint buf[PBO_COUNT];
+    GLsync fence[PBO_COUNT];
+    uint8_t *map[PBO_COUNT]; // persistent mappings
+    size_t size;
+    unsigned index;
+    bool persistent;
+    uint8_t *lent; // handed to the core as this frame's software framebuffer
+} g_pbo = { 0 };
+
+// software framebuffer for cores that read back what they draw, or when
+// there is no persistent PBO to lend
+static uint8_t *g_swfb = NULL;
+static size_t g_swfb_size = 0;
+
+// with g_video.convert every frame is widened to XRGB8888 on the CPU so
+// the driver only ever sees BGRA8; this holds it when there is no PBO
+static uint8_t *g_conv = NULL;
+static size_t g_conv_size = 0;
+
+// last frame the core sent, to spot one sent again unchanged
+static frame_shadow g_shadow = { 0 };
+
+// With g_video.threaded_present a render thread owns the GL context: it
+// uploads and presents while the emulation thread runs the next frame.
+// Frames cross over through a triple buffer; the core may draw straight
+// into its back slot. Cores that render with GL keep the single thread,
+// since their context has to be current where retro_run is called.
+static struct {
+    triple_buffer *tb;
+    sthread_t *thread;
+    std::atomic<bool> running;
+    plat_sem *ready; // the thread has the context and the texture
+    struct retro_game_geometry geom;
+    HWND hwnd;
+} g_present;
+
+// bytes per pixel of what glTexSubImage2D is given
+static GLuint upload_bpp()
+{
+    return g_video.convert ? sizeof(uint32_t) : g_video.bpp;
+}
+
 static const char *g_vshader_src =
 "#version 330\n"
 "in vec2 i_pos;\n"
@@ -156,6 +216,170 @@ void refresh_vertex_data() {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+static bool gl_has_extension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+        if (!strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name))
+            return true;
+    return false;
+}
+
+static void pbo_deinit()
+{
+    for (unsigned i = 0; i < PBO_COUNT; i++)
+    {
+        if (g_pbo.fence[i])
+            glDeleteSync(g_pbo.fence[i]);
+        if (g_pbo.map[i])
+        {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_pbo.buf[i]);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (g_pbo.buf[0])
+        glDeleteBuffers(PBO_COUNT, g_pbo.buf);
+    memset(&g_pbo, 0, sizeof(g_pbo));
+}
+
+static void pbo_init(size_t size)
+{
+    pbo_deinit();
+    if (g_video.disable_pbo)
+        return;
+    // glad stops at 4.3 and has released opengl32 by now, so ask WGL
+    PFNGLBUFFERSTORAGEPROC buffer_storage = NULL;
+    if (GLVersion.major > 4 || (GLVersion.major == 4 && GLVersion.minor >= 4) ||
+        gl_has_extension("GL_ARB_buffer_storage"))
+        buffer_storage = (PFNGLBUFFERSTORAGEPROC)wglGetProcAddress("glBufferStorage");
+
+    g_pbo.size = size;
+    glGenBuffers(PBO_COUNT, g_pbo.buf);
+    for (unsigned i = 0; i < PBO_COUNT; i++)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_pbo.buf[i]);
+        if (buffer_storage)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            buffer_storage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+            g_pbo.map[i] = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+            if (!g_pbo.map[i])
+            {
+                // direct uploads rather than a half-mapped ring
+                pbo_deinit();
+                return;
+            }
+        }
+        else
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    }
+    g_pbo.persistent = buffer_storage != NULL;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// waits until the GPU is done with the next buffer; only blocks when it
+// is a whole ring behind
+static void pbo_acquire()
+{
+    unsigned i = g_pbo.index;
+    if (g_pbo.fence[i])
+    {
+        glClientWaitSync(g_pbo.fence[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glDeleteSync(g_pbo.fence[i]);
+        g_pbo.fence[i] = 0;
+    }
+}
+
+// updates the texture from the next buffer, which must be bound, and
+// moves on to the one after
+static void pbo_submit(unsigned width, unsigned height, unsigned pitch)
+{
+    if (g_video.pitch != pitch) {
+        g_video.pitch = pitch;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, pitch / upload_bpp());
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+        g_video.pixtype, g_video.pixfmt, (const void*)0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    g_pbo.fence[g_pbo.index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    g_pbo.index = (g_pbo.index + 1) % PBO_COUNT;
+}
+
+// copies (or converts) the frame into the next buffer and starts the
+// texture upload from it; false leaves the upload to the caller
+static bool pbo_upload(const void *data, unsigned width, unsigned height, unsigned pitch)
+{
+    size_t row = (size_t)width * upload_bpp();
+    if (!g_pbo.buf[0] || row * height > g_pbo.size)
+        return false;
+
+    unsigned i = g_pbo.index;
+    pbo_acquire();
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_pbo.buf[i]);
+    uint8_t *dst = g_pbo.persistent ? g_pbo.map[i] :
+        (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, row * height,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (!dst)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return false;
+    }
+    const uint8_t *src = (const uint8_t*)data;
+    if (g_video.convert)
+        pixconv_frame(dst, row, src, pitch, width, height, g_video.rformat);
+    else if (pitch == row)
+        memcpy(dst, src, row * height);
+    else
+        for (unsigned y = 0; y < height; y++)
+            memcpy(dst + y * row, src + y * pitch, row);
+    if (!g_pbo.persistent)
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    // rows are packed tightly in the buffer
+    pbo_submit(width, height, (unsigned)row);
+    return true;
+}
+
+bool video_get_software_framebuffer(struct retro_framebuffer *fb) {
+    if (!g_video.bpp || fb->width > (unsigned)g_video.tex_w || fb->height > (unsigned)g_video.tex_h)
+        return false;
+    fb->pitch = fb->width * g_video.bpp;
+    fb->format = (enum retro_pixel_format)g_video.rformat;
+    if (g_present.thread) {
+        // the slot that will be published next
+        frame_slot *s = triple_buffer_back(g_present.tb, (size_t)g_video.tex_w * g_video.tex_h * g_video.bpp);
+        if (!s)
+            return false;
+        fb->data = s->data;
+        fb->memory_flags = RETRO_MEMORY_TYPE_CACHED;
+        return true;
+    }
+    // write-only cores draw straight into the next upload buffer; it is
+    // write-combined, so anything that reads back gets cached memory; a
+    // converting upload needs the core's pixels somewhere else first
+    if (g_pbo.persistent && !g_video.convert && !(fb->access_flags & RETRO_MEMORY_ACCESS_READ) &&
+        fb->pitch * fb->height <= g_pbo.size) {
+        pbo_acquire();
+        g_pbo.lent = g_pbo.map[g_pbo.index];
+        fb->data = g_pbo.lent;
+        fb->memory_flags = 0;
+        return true;
+    }
+    size_t size = (size_t)g_video.tex_w * g_video.tex_h * g_video.bpp;
+    if (g_swfb_size < size) {
+        plat_aligned_free(g_swfb);
+        g_swfb = (uint8_t*)plat_aligned_alloc(64, size);
+        g_swfb_size = g_swfb ? size : 0;
+        if (!g_swfb)
+            return false;
+    }
+    fb->data = g_swfb;
+    fb->memory_flags = RETRO_MEMORY_TYPE_CACHED;
+    return true;
+}
+
 void init_framebuffer(int width, int height)
 {
     if (g_video.fbo_id)
@@ -229,7 +453,7 @@ void create_window(int width, int height, HWND hwnd) {
     typedef bool (APIENTRY *PFNWGLSWAPINTERVALFARPROC)(int);
     PFNWGLSWAPINTERVALFARPROC wglSwapIntervalEXT = 0;
     wglSwapIntervalEXT = (PFNWGLSWAPINTERVALFARPROC)wglGetProcAddress("wglSwapIntervalEXT");
-    if (wglSwapIntervalEXT) wglSwapIntervalEXT(1);
+    if (wglSwapIntervalEXT) wglSwapIntervalEXT(g_video.disable_vsync ? 0 : 1);
     g_win = true;
     g_video.last_w = 0;
     g_video.last_h = 0;
@@ -285,7 +509,18 @@ BOOL CenterWindow(HWND hwndWindow)
 
 
 
-void video_configure(const struct retro_game_geometry *geom, HWND hwnd) {
+static uintptr_t core_get_current_framebuffer() {
+    return g_video.fbo_id;
+}
+
+bool video_set_hw_render(struct retro_hw_render_callback *hw) {
+    hw->get_current_framebuffer = core_get_current_framebuffer;
+    hw->get_proc_address = (retro_hw_get_proc_address_t)get_proc;
+    g_video.hw = *hw;
+    return true;
+}
+
+static void configure_gl(const struct retro_game_geometry *geom, HWND hwnd) {
     int nwidth = 0, nheight = 0;
 
     resize_to_aspect(geom->aspect_ratio, geom->base_width * 1, geom->base_height * 1, &nwidth, &nheight);
@@ -302,7 +537,7 @@ void video_configure(const struct retro_game_geometry *geom, HWND hwnd) {
     g_video.tex_id = 0;
 
     if (!g_video.pixfmt)
-        g_video.pixfmt = GL_UNSIGNED_SHORT_5_5_5_1;
+        video_set_pixel_format(RETRO_PIXEL_FORMAT_0RGB1555);
 
     int screenWidth = GetSystemMetrics(SM_CXSCREEN);
     int screenHeight = GetSystemMetrics(SM_CYSCREEN);
@@ -323,6 +558,7 @@ void video_configure(const struct retro_game_geometry *geom, HWND hwnd) {
     glBindTexture(GL_TEXTURE_2D, 0);
 
     init_framebuffer(geom->base_width, geom->base_height);
+    pbo_init((size_t)geom->max_width * geom->max_height * upload_bpp());
 
 
     g_video.tex_w = geom->max_width;
@@ -338,9 +574,10 @@ void video_configure(const struct retro_game_geometry *geom, HWND hwnd) {
 
 
 bool video_set_pixel_format(unsigned format) {
+    g_video.rformat = format;
     switch (format) {
     case RETRO_PIXEL_FORMAT_0RGB1555:
-        g_video.pixfmt = GL_UNSIGNED_SHORT_5_5_5_1;
+        g_video.pixfmt = GL_UNSIGNED_SHORT_1_5_5_5_REV;
         g_video.pixtype = GL_BGRA;
         g_video.bpp = sizeof(uint16_t);
         break;
@@ -357,14 +594,23 @@ bool video_set_pixel_format(unsigned format) {
     default:
         break;
     }
+    if (g_video.convert) {
+        g_video.pixfmt = GL_UNSIGNED_INT_8_8_8_8_REV;
+        g_video.pixtype = GL_BGRA;
+    }
 
     return true;
 }
 
 
-void video_refresh(const void *data, unsigned width, unsigned height, unsigned pitch) {
-    if (data == NULL) return;
-    if (g_video.base_w != width || g_video.base_h != height)
+static void present_frame(const void *data, unsigned width, unsigned height, unsigned pitch) {
+    if (data == NULL) {
+        // a dupe: present the texture again so the swap cadence holds
+        g_video.dupe_frames++;
+        width = g_video.base_w;
+        height = g_video.base_h;
+    }
+    else if (g_video.base_w != width || g_video.base_h != height)
     {
         g_video.base_h = height;
         g_video.base_w = width;
@@ -377,15 +623,52 @@ void video_refresh(const void *data, unsigned width, unsigned height, unsigned p
     resize_cb(width, height);
     glBindTexture(GL_TEXTURE_2D, g_video.tex_id);
 
-    if (pitch != g_video.pitch) {
-        g_video.pitch = pitch;
-        glPixelStorei(GL_UNPACK_ROW_LENGTH, g_video.pitch / g_video.bpp);
-    }
-
     if (data && data != RETRO_HW_FRAME_BUFFER_VALID) {
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
-            g_video.pixtype, g_video.pixfmt, data);
+        long long start = microseconds_now();
+        g_video.frames++;
+        if (g_pbo.lent && data == g_pbo.lent) {
+            // the core drew into the upload buffer itself; reading it back
+            // to compare would cost more than the upload
+            g_video.zero_copy_frames++;
+            g_video.bytes_uploaded += (size_t)width * height * upload_bpp();
+            frame_shadow_invalidate(&g_shadow);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_pbo.buf[g_pbo.index]);
+            pbo_submit(width, height, pitch);
+        }
+        else if (!g_video.disable_elision &&
+            frame_shadow_same(&g_shadow, data, width, height, pitch, g_video.bpp)) {
+            // the texture already holds it
+            g_video.identical_frames++;
+        }
+        else {
+            g_video.bytes_uploaded += (size_t)width * height * upload_bpp();
+            if (!pbo_upload(data, width, height, pitch)) {
+                if (g_video.convert) {
+                    size_t size = (size_t)g_video.tex_w * g_video.tex_h * sizeof(uint32_t);
+                    if (g_conv_size < size) {
+                        plat_aligned_free(g_conv);
+                        g_conv = (uint8_t*)plat_aligned_alloc(64, size);
+                        g_conv_size = g_conv ? size : 0;
+                    }
+                    if (g_conv) {
+                        pixconv_frame(g_conv, width * sizeof(uint32_t), data, pitch, width, height, g_video.rformat);
+                        data = g_conv;
+                        pitch = width * sizeof(uint32_t);
+                    }
+                }
+                if (pitch != g_video.pitch) {
+                    g_video.pitch = pitch;
+                    glPixelStorei(GL_UNPACK_ROW_LENGTH, g_video.pitch / upload_bpp());
+                }
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height,
+                    g_video.pixtype, g_video.pixfmt, data);
+            }
+        }
+        g_video.upload_us = microseconds_now() - start;
+        g_video.upload_total_us += g_video.upload_us;
+        g_video.uploads++;
     }
+    g_pbo.lent = NULL;
 
     glClear(GL_COLOR_BUFFER_BIT);
 
@@ -401,10 +684,134 @@ void video_refresh(const void *data, unsigned width, unsigned height, unsigned p
 
     glUseProgram(0);
 
+    long long swap = microseconds_now();
     SwapBuffers(g_video.hDC);
+    long long done = microseconds_now();
+    g_present_stats.swap_total_us.fetch_add(done - swap, std::memory_order_relaxed);
+    g_present_stats.present_done_us.store(done, std::memory_order_release);
+}
+
+static void deinit_gl();
+
+static void present_loop(void *data) {
+    configure_gl(&g_present.geom, g_present.hwnd);
+    plat_sem_post(g_present.ready);
+    while (g_present.running.load(std::memory_order_acquire)) {
+        if (!triple_buffer_wait(g_present.tb, 100000))
+            continue;
+        frame_slot *f = triple_buffer_take(g_present.tb);
+        if (!f)
+            continue;
+        long long start = microseconds_now();
+        g_present_stats.present_latency_total_us.fetch_add(start - f->published_us, std::memory_order_relaxed);
+        present_frame(f->dupe ? NULL : f->data, f->width, f->height, (unsigned)f->pitch);
+        g_present_stats.present_total_us.fetch_add(microseconds_now() - start, std::memory_order_relaxed);
+        g_present_stats.presented.fetch_add(1, std::memory_order_relaxed);
+    }
+    deinit_gl();
+}
+
+void video_configure(const struct retro_game_geometry *geom, void *window) {
+    if (!g_video.threaded_present || g_video.hw.context_type != RETRO_HW_CONTEXT_NONE) {
+        configure_gl(geom, (HWND)window);
+        return;
+    }
+    if (g_present.thread) {
+        // geometry changes restart the thread with a fresh context
+        video_deinit();
+    }
+    // what the emulation thread needs before the render thread has run
+    g_video.tex_w = geom->max_width;
+    g_video.tex_h = geom->max_height;
+    g_video.base_w = geom->base_width;
+    g_video.base_h = geom->base_height;
+    g_present.geom = *geom;
+    g_present.hwnd = (HWND)window;
+    g_present.tb = triple_buffer_new();
+    g_present.ready = plat_sem_new();
+    g_present.running.store(true);
+    g_present.thread = sthread_create(present_loop, NULL);
+    if (!g_present.thread) {
+        triple_buffer_free(g_present.tb);
+        plat_sem_free(g_present.ready);
+        g_present.tb = NULL;
+        g_present.ready = NULL;
+        configure_gl(geom, (HWND)window);
+        return;
+    }
+    plat_sem_wait(g_present.ready, 5000000);
+}
+
+void video_refresh(const void *data, unsigned width, unsigned height, unsigned pitch) {
+    if (!g_present.thread) {
+        present_frame(data, width, height, pitch);
+        return;
+    }
+    long long start = microseconds_now();
+    if (data == NULL) {
+        // an untaken frame is already what a dupe would show
+        if (!triple_buffer_pending(g_present.tb)) {
+            frame_slot *s = triple_buffer_back(g_present.tb, 0);
+            s->dupe = true;
+            triple_buffer_publish(g_present.tb);
+        }
+        return;
+    }
+    size_t row = (size_t)width * g_video.bpp;
+    frame_slot *s = triple_buffer_back(g_present.tb, row * height);
+    if (!s)
+        return;
+    if (data != s->data) {
+        const uint8_t *src = (const uint8_t*)data;
+        for (unsigned y = 0; y < height; y++)
+            memcpy(s->data + y * row, src + y * pitch, row);
+        pitch = (unsigned)row;
+    }
+    else
+        g_video.zero_copy_frames++;
+    s->width = width;
+    s->height = height;
+    s->pitch = pitch;
+    s->dupe = false;
+    triple_buffer_publish(g_present.tb);
+    g_video.handoff_total_us += microseconds_now() - start;
+    g_video.handoffs++;
+    g_video.frames_dropped = g_present.tb->dropped.load(std::memory_order_relaxed);
+}
+
+void video_begin_frame() {
+    if (g_present.thread)
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void video_deinit() {
+    if (g_present.thread) {
+        // the render thread tears GL down on its way out
+        g_present.running.store(false, std::memory_order_release);
+        triple_buffer_wake(g_present.tb);
+        sthread_join(g_present.thread);
+        g_present.thread = NULL;
+        triple_buffer_free(g_present.tb);
+        plat_sem_free(g_present.ready);
+        g_present.tb = NULL;
+        g_present.ready = NULL;
+        return;
+    }
+    deinit_gl();
+}
+
+static void deinit_gl() {
+    pbo_deinit();
+    plat_aligned_free(g_swfb);
+    g_swfb = NULL;
+    g_swfb_size = 0;
+    plat_aligned_free(g_conv);
+    g_conv = NULL;
+    g_conv_size = 0;
+    frame_shadow_free(&g_shadow);
     if (g_video.tex_id)
     {
         glDeleteTextures(1, &g_video.tex_id);
@@ -1,11 +1,19 @@
 #ifndef _gl_render_h_
 #define _gl_render_h_
+#include "platform.h"
+#ifdef _WIN32
 #include <d3d9.h>
+#endif
 #include "glad.h"
+#include <atomic>
 void video_deinit();
 bool video_set_pixel_format(unsigned format);
 void video_refresh(const void *data, unsigned width, unsigned height, unsigned pitch);
-void video_configure(const struct retro_game_geometry *geom, HWND hwnd);
+void video_configure(const struct retro_game_geometry *geom, void *hwnd);
+void video_begin_frame();
+bool video_set_hw_render(struct retro_hw_render_callback *hw);
+// RETRO_ENVIRONMENT_GET_CURRENT_SOFTWARE_FRAMEBUFFER
+bool video_get_software_framebuffer(struct retro_framebuffer *fb);
 
 typedef struct {
   GLuint tex_id;
@@ -29,12 +37,48 @@ typedef struct {
   GLuint pixfmt;
   GLuint pixtype;
   GLuint bpp;
+  unsigned rformat;          // retro_pixel_format the core renders in
+
+  bool disable_pbo;          // upload straight from the core's buffer
+  bool convert;              // widen every format to XRGB8888 before upload
+  bool disable_elision;      // upload frames even when they are unchanged
+  bool threaded_present;     // upload and present on a render thread
+  bool disable_vsync;        // swap interval 0; something else paces
+  bool null_vsync;           // headless: wait for a simulated vblank
+  long long upload_us;       // CPU time of the last frame's upload
+  long long upload_total_us;
+  unsigned uploads;
+  unsigned frames;           // software frames handed to video_refresh
+  unsigned zero_copy_frames; // of those, drawn where they're used, with no copy
+  unsigned identical_frames; // of those, the same as the last and not uploaded
+  unsigned dupe_frames;      // NULL frames, presented again
+  unsigned long long bytes_uploaded;
+
+  // threaded_present: emulation thread side
+  long long handoff_total_us; // copying frames into the triple buffer
+  unsigned handoffs;
+  unsigned frames_dropped;    // replaced before the render thread took them
+#ifdef _WIN32
   HDC   hDC;
   HGLRC hRC;
   HWND hwnd;
+#endif
   struct retro_hw_render_callback hw;
 
 }video;
 extern video g_video;
 
+// Written by whichever thread presents, the render thread under
+// threaded_present, and read by the emulation thread. The counters are
+// relaxed; present_done_us is stored with release, so a reader that
+// acquires it also sees the counters of that present.
+struct video_present_stats {
+  std::atomic<long long> present_total_us; // upload, draw and swap
+  std::atomic<long long> swap_total_us;    // of that, inside SwapBuffers
+  std::atomic<long long> present_latency_total_us; // published to picked up
+  std::atomic<unsigned> presented;
+  std::atomic<long long> present_done_us; // when the last present returned
+};
+extern video_present_stats g_present_stats;
+
 #endif
\ No newline at end of file
@@ -1,12 +1,12 @@
 #ifndef _guid_container_h_
 #define _guid_container_h_
 
-#include <windows.h>
+#include "platform.h"
 
 class guid_container
 {
 public:
-	~guid_container() {}
+	virtual ~guid_container() {}
 
 	virtual unsigned add( const GUID & ) = 0;
 
@@ -1,10 +1,14 @@
 #include "input.h"
+#include "input_sampler.h"
+#include "dinput_script.h"
+#include "../3rdparty/libretro.h"
+#include <stdlib.h>
 
 static const GUID g_signature = { 0x925c561e, 0xfdfe, 0x40b3, { 0x9a, 0xe9, 0xbf, 0x82, 0x85, 0x86, 0x4b, 0xb5 } };
 
 
 input* input::m_Instance = 0;
-input* input::CreateInstance(HINSTANCE hInstance, HWND hWnd)
+input* input::CreateInstance(void * hInstance, void * hWnd)
 {
     if (0 == m_Instance)
     {
@@ -22,6 +26,8 @@ input* input::GetSingleton()
 
 void input::close()
 {
+    stop_sampling();
+
     if (bl)
     {
         delete bl;
@@ -32,6 +38,7 @@ void input::close()
     {
         delete di;
         di = 0;
+        script = 0;
     }
 
     if (guids)
@@ -40,20 +47,31 @@ void input::close()
         guids = 0;
     }
 
+#ifdef _WIN32
     if (lpDI)
     {
         lpDI->Release();
         lpDI = 0;
     }
+#endif
 }
 
 input::input()
 {
+    memset(&table, 0, sizeof(table));
+    memset(&mouse, 0, sizeof(mouse));
+    memset(&polled, 0, sizeof(polled));
+    sampler = 0;
+    sample_hz = 0;
+    mouse_seen_x = mouse_seen_y = 0;
     list_count = 0;
     bits = 0;
+#ifdef _WIN32
     lpDI = 0;
+#endif
     guids = 0;
     di = 0;
+    script = 0;
     bl = 0;
 }
 
@@ -64,9 +82,10 @@ input::~input()
 
 
 
-const char* input::open(HINSTANCE hInstance, HWND hWnd)
+const char* input::open(void * hInstance, void * hWnd)
 {
-    if (DirectInput8Create(hInstance, DIRECTINPUT_VERSION,
+#ifdef _WIN32
+    if (DirectInput8Create((HINSTANCE)hInstance, DIRECTINPUT_VERSION,
 #ifdef UNICODE
         IID_IDirectInput8W
 #else
@@ -81,12 +100,44 @@ const char* input::open(HINSTANCE hInstance, HWND hWnd)
 
     const char * err = di->open(lpDI, hWnd, guids);
     if (err) return err;
+#else
+    // no device backend yet; binds still load/save so configs round trip
+    guids = create_guid_container();
+#endif
 
     bl = create_bind_list(guids);
 
     return 0;
 }
 
+const char* input::open_script(const TCHAR * path)
+{
+    dinput_script * s = create_dinput_script();
+    const char * err = s->load(path);
+    if (err)
+    {
+        delete s;
+        return err;
+    }
+    stop_sampling();
+    delete di;
+    di = script = s;
+    // open() may have failed before getting this far, e.g. with no window
+    if (!guids) guids = create_guid_container();
+    if (!bl) bl = create_bind_list(guids);
+    return 0;
+}
+
+void input::bind_script()
+{
+    if (script && bl) script->bind(bl);
+}
+
+void input::set_frame(unsigned frame)
+{
+    if (script) script->set_frame(frame);
+}
+
 const char* input::load(Data_Reader & in)
 {
     const char * err;
@@ -121,10 +172,90 @@ virtual void configure( void * hinstance, void * hwnd )
   else delete bl;
 }*/
 
+static int16_t clamp_motion(int32_t v)
+{
+    return v < -0x8000 ? -0x8000 : v > 0x7fff ? 0x7fff : (int16_t)v;
+}
+
 void input::poll()
 {
-    if (bl)bl->process(di->read());
+    if (sampler)
+    {
+        input_sampler_take(sampler, &polled);
+        table = polled.table;
+        mouse.x = clamp_motion(polled.mouse_x - mouse_seen_x);
+        mouse.y = clamp_motion(polled.mouse_y - mouse_seen_y);
+        mouse.left = polled.mouse_left;
+        mouse.right = polled.mouse_right;
+        mouse_seen_x = polled.mouse_x;
+        mouse_seen_y = polled.mouse_y;
+        return;
+    }
+    if (!di) return;
+    sample(&table, &mouse);
+}
+
+void input::sample(input_table *t, input_mouse *m)
+{
+    if (!di) return;
+    di->read(events);
+    if (bl)bl->process(events);
+    else events.clear();
+    input_table_build(t, bl);
     di->poll_mouse();
+    di->readmouse(m->x, m->y, m->left, m->right);
+}
+
+bool input::start_sampling(unsigned hz)
+{
+    stop_sampling();
+    if (!hz) return true;
+    mouse_seen_x = mouse_seen_y = 0;
+    sampler = input_sampler_new(this, hz);
+    sample_hz = sampler ? hz : 0;
+    return sampler != 0;
+}
+
+void input::stop_sampling()
+{
+    if (!sampler) return;
+    input_sampler_free(sampler);
+    sampler = 0;
+}
+
+int input_slot(unsigned device, unsigned index, unsigned id)
+{
+    if (device == RETRO_DEVICE_JOYPAD)
+        return id < INPUT_JOYPAD_IDS ? (int)id : -1;
+    if (device == RETRO_DEVICE_ANALOG && id <= RETRO_DEVICE_ID_ANALOG_Y)
+        // anything but the left stick reads the right one
+        return INPUT_SLOT_ANALOG + (index == RETRO_DEVICE_INDEX_ANALOG_LEFT ? 0 : 2) + id;
+    return -1;
+}
+
+void input_table_build(input_table *t, bind_list *bl)
+{
+    bool taken[INPUT_SLOTS] = { false };
+    memset(t->slot, 0, sizeof(t->slot));
+    unsigned count = 0;
+    const bind_list::bind_state *s = bl ? bl->get_states(count) : NULL;
+    for (unsigned i = 0; i < count; i++)
+    {
+        unsigned id = s[i].retro_id;
+        if (id < INPUT_JOYPAD_IDS && !taken[id])
+        {
+            t->slot[id] = abs(s[i].value);
+            taken[id] = true;
+        }
+        // retro ids 16-19 are the stick axes
+        unsigned axis = INPUT_SLOT_ANALOG + id - 16;
+        if (id >= 16 && axis < INPUT_SLOTS && !taken[axis])
+        {
+            int16_t value = s[i].value <= -0x8000 ? -0x7fff : s[i].value;
+            t->slot[axis] = s[i].analog ? -value : value;
+            taken[axis] = true;
+        }
+    }
 }
 
 bool input::getbutton(int which, int16_t & value, int & retro_id, bool & isanalog)
@@ -134,7 +265,10 @@ bool input::getbutton(int which, int16_t & value, int & retro_id, bool & isanalo
 
 void input::readmouse(int16_t & x, int16_t & y, bool &lbutton, bool &rbutton)
 {
-    di->readmouse(x, y, lbutton, rbutton);
+    x = mouse.x;
+    y = mouse.y;
+    lbutton = mouse.left;
+    rbutton = mouse.right;
 }
 
 unsigned input::read()
@@ -171,10 +305,10 @@ void input::set_paused(bool paused)
 
 void input::set_focus(bool is_focused)
 {
-    di->set_focus(is_focused);
+    if (di) di->set_focus(is_focused);
 }
 
 void input::refocus(void * hwnd)
 {
-    di->refocus(hwnd);
+    if (di) di->refocus(hwnd);
 }
\ No newline at end of file
@@ -1,10 +1,12 @@
 #ifndef _input_h_
 #define _input_h_
 
-#define DIRECTINPUT_VERSION 0x0800
+#include "platform.h"
 
-#include <windows.h>
+#ifdef _WIN32
+#define DIRECTINPUT_VERSION 0x0800
 #include <dinput.h>
+#endif
 
 #include "guid_container.h"
 #include "dinput.h"
@@ -14,6 +16,49 @@
 class Data_Reader;
 class Data_Writer;
 
+// What core_input_state answers for port 0, rebuilt from the binds on
+// every poll so a query is one load. Joypad ids map straight to slots;
+// the two analog sticks' X and Y follow. Where several binds share an
+// id the first in the list wins, as it always has.
+enum
+{
+  INPUT_JOYPAD_IDS = 32,
+  INPUT_SLOT_ANALOG = INPUT_JOYPAD_IDS, // left X, left Y, right X, right Y
+  INPUT_SLOTS = INPUT_SLOT_ANALOG + 4
+};
+
+struct input_table
+{
+  int16_t slot[INPUT_SLOTS];
+};
+
+struct input_mouse
+{
+  int16_t x, y; // motion since the last read
+  bool left, right;
+};
+
+// The devices as the input sampler last read them (see input_sampler.h).
+// Every slot carries the time it last changed, so a poll can tell how old
+// the press it sees is.
+struct input_snapshot
+{
+  input_table table;
+  long long changed_us[INPUT_SLOTS];
+  long long sampled_us; // when the devices were read
+  long long event_us;   // the newest slot or mouse button change
+  int32_t mouse_x, mouse_y; // motion summed over every read
+  bool mouse_left, mouse_right;
+  unsigned samples;
+};
+
+struct input_sampler;
+class dinput_script;
+
+// the slot for a query, or -1 for one no bind can answer
+int input_slot(unsigned device, unsigned index, unsigned id);
+void input_table_build(input_table *t, bind_list *bl);
+
 class input
 {
 
@@ -26,26 +71,48 @@ public:
   input();
   ~input();
   unsigned                bits;
+#ifdef _WIN32
   LPDIRECTINPUT8          lpDI;
+#endif
 
   guid_container        * guids;
   dinput                * di;
+  dinput_script         * script; // di, when input comes from a script
   bind_list             * bl;
-  HWND hwnd;
+  input_table             table;
+  input_mouse             mouse;
+  dinput::di_event_ring   events; // reused by every poll
+  input_sampler         * sampler; // NULL while poll reads the devices itself
+  unsigned                sample_hz; // its rate, to start it again after an edit
+  input_snapshot          polled;  // what the last poll took from the sampler
+  int32_t                 mouse_seen_x, mouse_seen_y;
+  void * hwnd;
   static	input* m_Instance;
 
 
 
 
-  static input* CreateInstance(HINSTANCE hInstance, HWND hWnd);
+  static input* CreateInstance(void * hInstance, void * hWnd);
   static	input* GetSingleton();
-  const char* open(HINSTANCE hInstance, HWND hWnd);
+  const char* open(void * hInstance, void * hWnd);
+  // plays a script (see dinput_script.h) in place of the devices
+  const char* open_script(const TCHAR * path);
+  // points the core's binds at the script's pad, once the core set them up
+  void bind_script();
+  // the frame about to run, for a script
+  void set_frame(unsigned frame);
   void close();
   // configuration
   const char* load(Data_Reader &);
   const char* save(Data_Writer &);
   // input_i_dinput
   void poll();
+  // one read of every device: the events through the binds into t
+  void sample(input_table *t, input_mouse *m);
+  // reads the devices hz times a second on a thread of their own, poll
+  // then only takes the latest; false if the thread can't start
+  bool start_sampling(unsigned hz);
+  void stop_sampling();
   bool getbutton(int which, int16_t & value, int & retro_id, bool & isanalog);
   void readmouse(int16_t & x, int16_t & y, bool &lbutton, bool &rbutton);
   unsigned read();
@@ -0,0 +1,130 @@
+#include "input_sampler.h"
+#include <string.h>
+
+// spins this long on a torn copy before assuming the writer lost the CPU
+// mid-write and letting it run
+#define SEQLOCK_SPINS 64
+
+void seqlock_init(input_seqlock *sl)
+{
+    sl->seq.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < INPUT_SNAPSHOT_WORDS; i++)
+        sl->words[i].store(0, std::memory_order_relaxed);
+}
+
+void seqlock_write(input_seqlock *sl, const input_snapshot *s)
+{
+    uint32_t w[INPUT_SNAPSHOT_WORDS];
+    w[INPUT_SNAPSHOT_WORDS - 1] = 0;
+    memcpy(w, s, sizeof(*s));
+    unsigned seq = sl->seq.load(std::memory_order_relaxed);
+    sl->seq.store(seq + 1, std::memory_order_relaxed);
+    // no word may land before the odd sequence is visible
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < INPUT_SNAPSHOT_WORDS; i++)
+        sl->words[i].store(w[i], std::memory_order_relaxed);
+    sl->seq.store(seq + 2, std::memory_order_release);
+}
+
+unsigned seqlock_read(input_seqlock *sl, input_snapshot *s)
+{
+    uint32_t w[INPUT_SNAPSHOT_WORDS];
+    for (unsigned torn = 0;; torn++)
+    {
+        unsigned seq = sl->seq.load(std::memory_order_acquire);
+        if (!(seq & 1))
+        {
+            for (size_t i = 0; i < INPUT_SNAPSHOT_WORDS; i++)
+                w[i] = sl->words[i].load(std::memory_order_relaxed);
+            // every word is read before the sequence is checked again
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (sl->seq.load(std::memory_order_relaxed) == seq)
+            {
+                memcpy(s, w, sizeof(*s));
+                return torn;
+            }
+        }
+        if (torn >= SEQLOCK_SPINS)
+            plat_yield();
+    }
+}
+
+static void sampler_read(input_sampler *s)
+{
+    input_snapshot *w = &s->work;
+    input_table t = w->table;
+    input_mouse m = { 0, 0, w->mouse_left, w->mouse_right };
+    long long now = microseconds_now();
+    s->in->sample(&t, &m);
+    for (unsigned i = 0; i < INPUT_SLOTS; i++)
+        if (t.slot[i] != w->table.slot[i])
+        {
+            w->changed_us[i] = now;
+            w->event_us = now;
+        }
+    if (m.left != w->mouse_left || m.right != w->mouse_right)
+        w->event_us = now;
+    w->table = t;
+    w->mouse_x += m.x;
+    w->mouse_y += m.y;
+    w->mouse_left = m.left;
+    w->mouse_right = m.right;
+    w->sampled_us = now;
+    w->samples++;
+    seqlock_write(&s->latest, w);
+}
+
+static void sampler_loop(void *data)
+{
+    input_sampler *s = (input_sampler*)data;
+    long long next = microseconds_now();
+    while (!s->quit.load())
+    {
+        sampler_read(s);
+        next += s->period_us;
+        long long now = microseconds_now();
+        if (now < next)
+            plat_sleep_us(next - now);
+        else
+        {
+            // fell behind; carry on from now rather than catch up in a burst
+            s->overruns++;
+            next = now;
+        }
+    }
+}
+
+input_sampler *input_sampler_new(input *in, unsigned hz)
+{
+    if (!hz)
+        return NULL;
+    input_sampler *s = new input_sampler();
+    s->in = in;
+    s->period_us = hz > 1000000 ? 1 : 1000000 / hz;
+    s->quit = false;
+    s->overruns = 0;
+    memset(&s->work, 0, sizeof(s->work));
+    seqlock_init(&s->latest);
+    sampler_read(s);
+    s->thread = sthread_create(sampler_loop, s);
+    if (!s->thread)
+    {
+        delete s;
+        return NULL;
+    }
+    return s;
+}
+
+void input_sampler_free(input_sampler *s)
+{
+    if (!s)
+        return;
+    s->quit = true;
+    sthread_join(s->thread);
+    delete s;
+}
+
+unsigned input_sampler_take(input_sampler *s, input_snapshot *out)
+{
+    return seqlock_read(&s->latest, out);
+}
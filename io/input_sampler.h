@@ -0,0 +1,51 @@
+#ifndef _input_sampler_h_
+#define _input_sampler_h_
+
+#include <atomic>
+#include "input.h"
+
+// Reads the input devices on a thread of their own, a thousand or more
+// times a second, instead of once a frame from retro_input_poll, so a
+// poll sees a press at most one sampling period old rather than up to a
+// frame. Each read is published whole under a sequence lock: the sampler
+// makes the sequence odd, writes, and makes it even again; a reader
+// copies and starts over if the sequence was odd or moved meanwhile.
+// Neither side waits on the other, and a poll costs one small copy.
+//
+// Mouse motion is summed over every read, so none is lost between polls;
+// the poll hands the core the difference from the totals it saw last.
+
+#define INPUT_SNAPSHOT_WORDS ((sizeof(input_snapshot) + 3) / 4)
+
+// the words are atomic only so that copying one mid-write is defined;
+// the sequence is what keeps a copy whole
+struct input_seqlock
+{
+    std::atomic<unsigned> seq;
+    std::atomic<uint32_t> words[INPUT_SNAPSHOT_WORDS];
+};
+
+void seqlock_init(input_seqlock *sl);
+// one writer only
+void seqlock_write(input_seqlock *sl, const input_snapshot *s);
+// returns the number of torn copies it had to retry
+unsigned seqlock_read(input_seqlock *sl, input_snapshot *s);
+
+struct input_sampler
+{
+    sthread_t *thread;
+    input *in;
+    long long period_us;
+    std::atomic<bool> quit;
+    std::atomic<unsigned> overruns; // reads that ran past the next one's time
+    input_snapshot work; // the sampler thread's own copy
+    input_seqlock latest;
+};
+
+// reads the devices once before it returns, so the first take is real
+input_sampler *input_sampler_new(input *in, unsigned hz);
+void input_sampler_free(input_sampler *s);
+// the latest read; returns the torn copies retried
+unsigned input_sampler_take(input_sampler *s, input_snapshot *out);
+
+#endif
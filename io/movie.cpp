@@ -0,0 +1,303 @@
+#include "movie.h"
+#include "state_io.h"
+#include <limits.h>
+#include <string.h>
+#include <algorithm>
+
+static const char movie_magic[4] = { 'E', 'W', 'M', 'V' };
+#define MOVIE_VERSION 1
+#define MOVIE_HEADER 32 // magic, version, frames, keyframes, interval, frame size (u32), index offset (u64)
+#define MOVIE_KEYFRAME_ENTRY 20 // frame (u32), offset, size (u64)
+
+static void put_count(std::vector<uint8_t> &out, unsigned v)
+{
+    while (v >= 0x80)
+    {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static bool get_count(const uint8_t **p, const uint8_t *end, unsigned *v)
+{
+    unsigned out = 0;
+    for (unsigned shift = 0; *p < end && shift < 32; shift += 7)
+    {
+        uint8_t c = *(*p)++;
+        out |= (unsigned)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+        {
+            *v = out;
+            return true;
+        }
+    }
+    return false;
+}
+
+template <class T> static void put(std::vector<uint8_t> &out, T v)
+{
+    const uint8_t *b = (const uint8_t*)&v;
+    out.insert(out.end(), b, b + sizeof(v));
+}
+
+template <class T> static T get(const uint8_t *p)
+{
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// plain fseek takes a long, which Windows keeps at 32 bits
+static bool movie_seek(FILE *fp, uint64_t offset)
+{
+#ifdef _MSC_VER
+    return !_fseeki64(fp, (__int64)offset, SEEK_SET);
+#else
+    return offset <= LONG_MAX && !fseek(fp, (long)offset, SEEK_SET);
+#endif
+}
+
+void movie_input_set(movie_input *m, const input_table *t, const input_mouse *mouse)
+{
+    m->table = *t;
+    m->mouse_x = mouse->x;
+    m->mouse_y = mouse->y;
+    m->mouse_buttons = (mouse->left ? 1 : 0) | (mouse->right ? 2 : 0);
+}
+
+static void movie_header(movie *m, uint8_t *out, uint64_t index)
+{
+    uint32_t v[5] = { MOVIE_VERSION, m->frames, (uint32_t)m->keyframes.size(), m->keyframe_interval,
+        (uint32_t)sizeof(movie_input) };
+    memcpy(out, movie_magic, 4);
+    memcpy(out + 4, v, sizeof(v));
+    memcpy(out + 24, &index, 8);
+}
+
+movie *movie_create(const TCHAR *path, unsigned keyframe_interval)
+{
+    movie *m = new movie();
+    m->recording = true;
+    m->frames = 0;
+    m->keyframe_interval = keyframe_interval;
+    m->cursor = 0;
+    _tcsncpy(m->target, path, MAX_PATH - 1);
+    m->target[MAX_PATH - 1] = 0;
+    _tcscpy(m->path, m->target);
+    _tcscat(m->path, _T(".tmp"));
+    m->file = _tfopen(m->path, _T("wb"));
+    // the real header goes in when recording stops
+    uint8_t header[MOVIE_HEADER] = { 0 };
+    if (!m->file || fwrite(header, 1, MOVIE_HEADER, m->file) != MOVIE_HEADER)
+    {
+        if (m->file)
+        {
+            fclose(m->file);
+            _tremove(m->path);
+        }
+        delete m;
+        return NULL;
+    }
+    m->written = MOVIE_HEADER;
+    return m;
+}
+
+bool movie_wants_keyframe(movie *m)
+{
+    if (m->keyframes.empty())
+        return true;
+    return m->keyframe_interval && !(m->frames % m->keyframe_interval) &&
+        m->keyframes.back().frame != m->frames;
+}
+
+bool movie_add_keyframe(movie *m, const void *state, size_t size)
+{
+    // zero runs rather than zlib: it's fast enough to do between frames
+    if (!state_encode(m->coded, (const uint8_t*)state, size, STATE_CODEC_ZERO_RUNS) ||
+        fwrite(&m->coded[0], 1, m->coded.size(), m->file) != m->coded.size())
+        return false;
+    movie_keyframe k = { m->frames, m->written, m->coded.size() };
+    m->keyframes.push_back(k);
+    m->written += m->coded.size();
+    return true;
+}
+
+void movie_add_input(movie *m, const movie_input *in)
+{
+    if (!m->runs.empty() && !memcmp(&m->runs.back().input, in, sizeof(*in)))
+        m->runs.back().count++;
+    else
+    {
+        movie_run r = { m->frames, 1, *in };
+        m->runs.push_back(r);
+    }
+    m->frames++;
+}
+
+static bool movie_finish(movie *m)
+{
+    std::vector<uint8_t> out;
+    for (size_t i = 0; i < m->runs.size(); i++)
+    {
+        put_count(out, m->runs[i].count);
+        const uint8_t *b = (const uint8_t*)&m->runs[i].input;
+        out.insert(out.end(), b, b + sizeof(movie_input));
+    }
+    uint64_t input_offset = m->written, input_size = out.size();
+    uint64_t index = input_offset + input_size;
+    put(out, input_offset);
+    put(out, input_size);
+    for (size_t i = 0; i < m->keyframes.size(); i++)
+    {
+        put(out, (uint32_t)m->keyframes[i].frame);
+        put(out, m->keyframes[i].offset);
+        put(out, m->keyframes[i].size);
+    }
+    uint8_t header[MOVIE_HEADER];
+    movie_header(m, header, index);
+    return fwrite(&out[0], 1, out.size(), m->file) == out.size() && movie_seek(m->file, 0) &&
+        fwrite(header, 1, MOVIE_HEADER, m->file) == MOVIE_HEADER && plat_file_sync(m->file);
+}
+
+movie *movie_open(const TCHAR *path)
+{
+    FILE *fp = _tfopen(path, _T("rb"));
+    if (!fp)
+        return NULL;
+    movie *m = new movie();
+    m->file = fp;
+    m->recording = false;
+    m->cursor = 0;
+    m->written = 0;
+    uint8_t header[MOVIE_HEADER];
+    std::vector<uint8_t> &in = m->coded;
+    bool ok = fread(header, 1, MOVIE_HEADER, fp) == MOVIE_HEADER && !memcmp(header, movie_magic, 4) &&
+        get<uint32_t>(header + 4) == MOVIE_VERSION && get<uint32_t>(header + 20) == sizeof(movie_input);
+    uint32_t keyframes = 0;
+    uint64_t index = 0, input_offset = 0, input_size = 0;
+    if (ok)
+    {
+        m->frames = get<uint32_t>(header + 8);
+        keyframes = get<uint32_t>(header + 12);
+        m->keyframe_interval = get<uint32_t>(header + 16);
+        index = get<uint64_t>(header + 24);
+        ok = keyframes && keyframes < (1u << 24);
+        if (ok)
+            in.resize(16 + (size_t)keyframes * MOVIE_KEYFRAME_ENTRY);
+        ok = ok && movie_seek(fp, index) && fread(&in[0], 1, in.size(), fp) == in.size();
+    }
+    if (ok)
+    {
+        input_offset = get<uint64_t>(&in[0]);
+        input_size = get<uint64_t>(&in[8]);
+        for (uint32_t i = 0; i < keyframes; i++)
+        {
+            const uint8_t *e = &in[16 + i * MOVIE_KEYFRAME_ENTRY];
+            movie_keyframe k = { get<uint32_t>(e), get<uint64_t>(e + 4), get<uint64_t>(e + 12) };
+            // in frame order, the first at frame 0
+            ok = ok && k.frame <= m->frames && (i ? k.frame > m->keyframes.back().frame : !k.frame);
+            m->keyframes.push_back(k);
+        }
+        // the input runs up to the index
+        ok = ok && input_offset + input_size == index && input_size < (1u << 30) && movie_seek(fp, input_offset);
+    }
+    if (ok)
+    {
+        in.resize((size_t)input_size);
+        ok = !input_size || fread(&in[0], 1, in.size(), fp) == in.size();
+    }
+    unsigned frame = 0;
+    const uint8_t *p = in.empty() ? NULL : &in[0], *end = p + in.size();
+    while (ok && p < end)
+    {
+        movie_run r;
+        r.first = frame;
+        ok = get_count(&p, end, &r.count) && r.count && r.count <= m->frames - frame &&
+            (size_t)(end - p) >= sizeof(movie_input);
+        if (ok)
+        {
+            memcpy(&r.input, p, sizeof(movie_input));
+            p += sizeof(movie_input);
+            frame += r.count;
+            m->runs.push_back(r);
+        }
+    }
+    if (!ok || frame != m->frames)
+    {
+        fclose(fp);
+        delete m;
+        return NULL;
+    }
+    return m;
+}
+
+static bool run_before(const movie_run &a, const movie_run &b)
+{
+    return a.first < b.first;
+}
+
+static bool keyframe_before(const movie_keyframe &a, const movie_keyframe &b)
+{
+    return a.frame < b.frame;
+}
+
+const movie_input *movie_input_at(movie *m, unsigned frame)
+{
+    if (frame >= m->frames)
+        return NULL;
+    // playing moves on a frame at a time, so the run is mostly where the
+    // last lookup was or the next one
+    for (unsigned i = m->cursor; i < m->cursor + 2 && i < m->runs.size(); i++)
+    {
+        const movie_run &r = m->runs[i];
+        if (frame >= r.first && frame - r.first < r.count)
+        {
+            m->cursor = i;
+            return &r.input;
+        }
+    }
+    movie_run key;
+    key.first = frame;
+    std::vector<movie_run>::iterator it = std::upper_bound(m->runs.begin(), m->runs.end(), key, run_before);
+    m->cursor = (unsigned)(it - m->runs.begin()) - 1;
+    return &m->runs[m->cursor].input;
+}
+
+const movie_keyframe *movie_keyframe_at(movie *m, unsigned frame)
+{
+    movie_keyframe key;
+    key.frame = frame;
+    std::vector<movie_keyframe>::iterator it = std::upper_bound(m->keyframes.begin(), m->keyframes.end(),
+        key, keyframe_before);
+    return it == m->keyframes.begin() ? NULL : &*(it - 1);
+}
+
+bool movie_read_keyframe(movie *m, const movie_keyframe *k, std::vector<uint8_t> &state)
+{
+    if (k->size > (size_t)-1 / 2)
+        return false;
+    m->coded.resize((size_t)k->size);
+    return k->size && movie_seek(m->file, k->offset) &&
+        fread(&m->coded[0], 1, m->coded.size(), m->file) == m->coded.size() &&
+        state_decode(state, &m->coded[0], m->coded.size());
+}
+
+bool movie_close(movie *m)
+{
+    if (!m)
+        return true;
+    bool ok = true;
+    if (m->recording)
+    {
+        ok = movie_finish(m);
+        fclose(m->file);
+        ok = ok && plat_file_replace(m->path, m->target);
+        if (!ok)
+            _tremove(m->path);
+    }
+    else
+        fclose(m->file);
+    delete m;
+    return ok;
+}
@@ -0,0 +1,81 @@
+#ifndef _movie_h_
+#define _movie_h_
+
+#include "platform.h"
+#include "input.h"
+#include <vector>
+
+// Input movies: what core_input_state answered for port 0 on every frame,
+// to be answered again bit for bit, with savestates to start from and to
+// seek by. A file is
+//
+//   header     "EWMV", version, frame and keyframe counts, keyframe
+//              interval, frame size, index offset
+//   keyframes  savestates in the state_io file format: the first as
+//              recording starts, then one every keyframe_interval frames
+//   input      runs of identical frames, each a LEB128 count and the frame
+//   index      the input's offset and size, then each keyframe's frame,
+//              offset and size
+//
+// Input rarely changes from one frame to the next, so an hour at 60 fps
+// takes a few hundred KB. Keyframes go to the file as they are taken;
+// the input and index are kept in memory and written when recording
+// stops, which then swaps the file in, as a savestate save does. Playing
+// reads the input in whole and a keyframe only when it's wanted.
+
+struct movie_input
+{
+    input_table table;
+    int16_t mouse_x, mouse_y;
+    int16_t mouse_buttons; // bit 0 left, bit 1 right
+};
+
+struct movie_run
+{
+    unsigned first; // frame
+    unsigned count;
+    movie_input input;
+};
+
+struct movie_keyframe
+{
+    unsigned frame;
+    uint64_t offset, size; // in the file
+};
+
+struct movie
+{
+    FILE *file;
+    bool recording;
+    TCHAR path[MAX_PATH + 8]; // written to while recording
+    TCHAR target[MAX_PATH];   // and swapped in here
+    unsigned frames;
+    unsigned keyframe_interval;
+    uint64_t written;
+    std::vector<movie_run> runs;
+    std::vector<movie_keyframe> keyframes;
+    std::vector<uint8_t> coded; // a keyframe as stored
+    unsigned cursor; // the run the last lookup landed in
+};
+
+void movie_input_set(movie_input *m, const input_table *t, const input_mouse *mouse);
+
+movie *movie_create(const TCHAR *path, unsigned keyframe_interval);
+// whether the frame about to be added is due a keyframe; frame 0 always is
+bool movie_wants_keyframe(movie *m);
+// a keyframe for the frame about to be added
+bool movie_add_keyframe(movie *m, const void *state, size_t size);
+void movie_add_input(movie *m, const movie_input *in);
+
+movie *movie_open(const TCHAR *path);
+// a frame's input, or NULL past the end
+const movie_input *movie_input_at(movie *m, unsigned frame);
+// the last keyframe at or before a frame
+const movie_keyframe *movie_keyframe_at(movie *m, unsigned frame);
+bool movie_read_keyframe(movie *m, const movie_keyframe *k, std::vector<uint8_t> &state);
+
+// finishes a recording; false if it couldn't be written, and then the
+// file it was to replace is left alone
+bool movie_close(movie *m);
+
+#endif
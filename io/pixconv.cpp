@@ -0,0 +1,209 @@
+#include "pixconv.h"
+#include "cpu.h"
+#include "../3rdparty/libretro.h"
+#include <immintrin.h>
+
+static inline uint32_t expand_1555(uint16_t p)
+{
+    uint32_t r = (p >> 10) & 0x1f, g = (p >> 5) & 0x1f, b = p & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (g << 3) | (g >> 2);
+    b = (b << 3) | (b >> 2);
+    return 0xff000000u | (r << 16) | (g << 8) | b;
+}
+
+static inline uint32_t expand_565(uint16_t p)
+{
+    uint32_t r = p >> 11, g = (p >> 5) & 0x3f, b = p & 0x1f;
+    r = (r << 3) | (r >> 2);
+    g = (g << 2) | (g >> 4);
+    b = (b << 3) | (b >> 2);
+    return 0xff000000u | (r << 16) | (g << 8) | b;
+}
+
+static void row_1555_c(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint16_t *in = (const uint16_t*)src;
+    for (unsigned x = 0; x < width; x++)
+        dst[x] = expand_1555(in[x]);
+}
+
+static void row_565_c(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint16_t *in = (const uint16_t*)src;
+    for (unsigned x = 0; x < width; x++)
+        dst[x] = expand_565(in[x]);
+}
+
+static void row_8888_c(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint32_t *in = (const uint32_t*)src;
+    for (unsigned x = 0; x < width; x++)
+        dst[x] = in[x] | 0xff000000u;
+}
+
+// The 16 bit kernels split each pixel into 8 bit channels held in 16 bit
+// lanes, pack them into B|G<<8 and R|0xff00, and interleave those two
+// vectors into 32 bit pixels.
+
+static inline void store_bgra_sse2(uint32_t *dst, __m128i r, __m128i g, __m128i b)
+{
+    __m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+    __m128i ra = _mm_or_si128(r, _mm_set1_epi16((short)0xff00));
+    _mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi16(bg, ra));
+    _mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi16(bg, ra));
+}
+
+static void row_1555_sse2(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint16_t *in = (const uint16_t*)src;
+    const __m128i mask = _mm_set1_epi16(0x1f);
+    unsigned x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i p = _mm_loadu_si128((const __m128i*)(in + x));
+        __m128i r = _mm_and_si128(_mm_srli_epi16(p, 10), mask);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), mask);
+        __m128i b = _mm_and_si128(p, mask);
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        store_bgra_sse2(dst + x, r, g, b);
+    }
+    row_1555_c(dst + x, in + x, width - x);
+}
+
+static void row_565_sse2(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint16_t *in = (const uint16_t*)src;
+    unsigned x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i p = _mm_loadu_si128((const __m128i*)(in + x));
+        __m128i r = _mm_srli_epi16(p, 11);
+        __m128i g = _mm_and_si128(_mm_srli_epi16(p, 5), _mm_set1_epi16(0x3f));
+        __m128i b = _mm_and_si128(p, _mm_set1_epi16(0x1f));
+        r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+        g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+        b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+        store_bgra_sse2(dst + x, r, g, b);
+    }
+    row_565_c(dst + x, in + x, width - x);
+}
+
+static void row_8888_sse2(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint32_t *in = (const uint32_t*)src;
+    const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+    unsigned x = 0;
+    for (; x + 4 <= width; x += 4)
+        _mm_storeu_si128((__m128i*)(dst + x),
+            _mm_or_si128(_mm_loadu_si128((const __m128i*)(in + x)), alpha));
+    row_8888_c(dst + x, in + x, width - x);
+}
+
+// unpack works within 128 bit lanes, so the halves are put back in pixel
+// order before storing
+CPU_TARGET("avx2")
+static inline void store_bgra_avx2(uint32_t *dst, __m256i r, __m256i g, __m256i b)
+{
+    __m256i bg = _mm256_or_si256(b, _mm256_slli_epi16(g, 8));
+    __m256i ra = _mm256_or_si256(r, _mm256_set1_epi16((short)0xff00));
+    __m256i lo = _mm256_unpacklo_epi16(bg, ra);
+    __m256i hi = _mm256_unpackhi_epi16(bg, ra);
+    _mm256_storeu_si256((__m256i*)dst, _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(dst + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+}
+
+CPU_TARGET("avx2")
+static void row_1555_avx2(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint16_t *in = (const uint16_t*)src;
+    const __m256i mask = _mm256_set1_epi16(0x1f);
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(in + x));
+        __m256i r = _mm256_and_si256(_mm256_srli_epi16(p, 10), mask);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi16(p, 5), mask);
+        __m256i b = _mm256_and_si256(p, mask);
+        r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+        g = _mm256_or_si256(_mm256_slli_epi16(g, 3), _mm256_srli_epi16(g, 2));
+        b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+        store_bgra_avx2(dst + x, r, g, b);
+    }
+    row_1555_sse2(dst + x, in + x, width - x);
+}
+
+CPU_TARGET("avx2")
+static void row_565_avx2(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint16_t *in = (const uint16_t*)src;
+    unsigned x = 0;
+    for (; x + 16 <= width; x += 16)
+    {
+        __m256i p = _mm256_loadu_si256((const __m256i*)(in + x));
+        __m256i r = _mm256_srli_epi16(p, 11);
+        __m256i g = _mm256_and_si256(_mm256_srli_epi16(p, 5), _mm256_set1_epi16(0x3f));
+        __m256i b = _mm256_and_si256(p, _mm256_set1_epi16(0x1f));
+        r = _mm256_or_si256(_mm256_slli_epi16(r, 3), _mm256_srli_epi16(r, 2));
+        g = _mm256_or_si256(_mm256_slli_epi16(g, 2), _mm256_srli_epi16(g, 4));
+        b = _mm256_or_si256(_mm256_slli_epi16(b, 3), _mm256_srli_epi16(b, 2));
+        store_bgra_avx2(dst + x, r, g, b);
+    }
+    row_565_sse2(dst + x, in + x, width - x);
+}
+
+CPU_TARGET("avx2")
+static void row_8888_avx2(uint32_t *dst, const void *src, unsigned width)
+{
+    const uint32_t *in = (const uint32_t*)src;
+    const __m256i alpha = _mm256_set1_epi32((int)0xff000000u);
+    unsigned x = 0;
+    for (; x + 8 <= width; x += 8)
+        _mm256_storeu_si256((__m256i*)(dst + x),
+            _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(in + x)), alpha));
+    row_8888_sse2(dst + x, in + x, width - x);
+}
+
+pixconv_row_fn pixconv_row(unsigned format, enum pixconv_simd simd)
+{
+    static const pixconv_row_fn rows[3][3] = {
+        { row_1555_c, row_1555_sse2, row_1555_avx2 },
+        { row_8888_c, row_8888_sse2, row_8888_avx2 },
+        { row_565_c, row_565_sse2, row_565_avx2 },
+    };
+    if (format > RETRO_PIXEL_FORMAT_RGB565 || simd > PIXCONV_SIMD_AVX2)
+        return NULL;
+    return rows[format][simd];
+}
+
+enum pixconv_simd pixconv_best_simd()
+{
+    return (cpu_features() & CPU_AVX2) ? PIXCONV_SIMD_AVX2 : PIXCONV_SIMD_SSE2;
+}
+
+const char *pixconv_simd_name(enum pixconv_simd simd)
+{
+    switch (simd)
+    {
+    case PIXCONV_SIMD_C: return "c";
+    case PIXCONV_SIMD_SSE2: return "sse2";
+    case PIXCONV_SIMD_AVX2: return "avx2";
+    }
+    return "?";
+}
+
+bool pixconv_frame(void *dst, size_t dst_pitch, const void *src, size_t src_pitch,
+    unsigned width, unsigned height, unsigned format)
+{
+    static int simd = -1;
+    if (simd < 0)
+        simd = pixconv_best_simd();
+    pixconv_row_fn row = pixconv_row(format, (enum pixconv_simd)simd);
+    if (!row)
+        return false;
+    for (unsigned y = 0; y < height; y++)
+        row((uint32_t*)((uint8_t*)dst + y * dst_pitch), (const uint8_t*)src + y * src_pitch, width);
+    return true;
+}
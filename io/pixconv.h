@@ -0,0 +1,31 @@
+#ifndef _pixconv_h_
+#define _pixconv_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Converts any libretro pixel format to XRGB8888 with the X byte set to
+// 0xff, which is BGRA8 in memory and the one format every driver uploads
+// without a swizzle. 5 and 6 bit channels are widened by replicating
+// their top bits, so 0 stays 0 and full scale becomes 0xff.
+
+enum pixconv_simd
+{
+    PIXCONV_SIMD_C,
+    PIXCONV_SIMD_SSE2,
+    PIXCONV_SIMD_AVX2
+};
+
+typedef void(*pixconv_row_fn)(uint32_t *dst, const void *src, unsigned width);
+
+// NULL for formats it doesn't know
+pixconv_row_fn pixconv_row(unsigned format, enum pixconv_simd simd);
+enum pixconv_simd pixconv_best_simd();
+const char *pixconv_simd_name(enum pixconv_simd simd);
+
+// converts a whole frame with the best kernel for this CPU; pitches are in
+// bytes and may carry padding
+bool pixconv_frame(void *dst, size_t dst_pitch, const void *src, size_t src_pitch,
+    unsigned width, unsigned height, unsigned format);
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef _platform_h_
+#define _platform_h_
+
+// Small platform layer shared by the frontend library: dynamic library
+// loading, the monotonic clock, path handling and threads. Backends live in
+// platform_win32.cpp and platform_posix.cpp; threads come from rthreads.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "../3rdparty/rthreads.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <tchar.h>
+#else
+#include <limits.h>
+
+typedef char TCHAR;
+#define _T(x) x
+#define _tcscpy strcpy
+#define _tcsncpy strncpy
+#define _tcscat strcat
+#define _tcslen strlen
+#define _tcscmp strcmp
+#define _tcsrchr strrchr
+#define _tfopen fopen
+#define _tremove remove
+#define _sntprintf snprintf
+
+#ifndef MAX_PATH
+#define MAX_PATH PATH_MAX
+#endif
+
+typedef struct _GUID
+{
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t  Data4[8];
+} GUID;
+
+inline bool operator==(const GUID & a, const GUID & b) { return !memcmp(&a, &b, sizeof(GUID)); }
+inline bool operator!=(const GUID & a, const GUID & b) { return !(a == b); }
+#endif
+
+#if !defined(_MSC_VER) && !defined(__forceinline)
+#define __forceinline inline __attribute__((always_inline))
+#endif
+
+// dynamic libraries
+typedef void* plat_dylib;
+plat_dylib plat_dylib_open(const TCHAR *path);
+void* plat_dylib_sym(plat_dylib lib, const char *name);
+void plat_dylib_close(plat_dylib lib);
+// full path of a loaded library; false if the backend can't tell
+bool plat_dylib_path(plat_dylib lib, TCHAR *path, size_t len);
+
+// monotonic clock
+long long microseconds_now();
+long long milliseconds_now();
+void plat_sleep_us(long long usec);
+// hands the rest of the time slice to another ready thread
+void plat_yield();
+
+// paths, edited in place in MAX_PATH sized buffers
+void plat_path_strip(TCHAR *path);
+void plat_path_remove_ext(TCHAR *path);
+void plat_path_append(TCHAR *path, const TCHAR *more);
+bool plat_getcwd(TCHAR *path, size_t len);
+long plat_file_size(const TCHAR *path);
+// flushes a written file through to the disk
+bool plat_file_sync(FILE *file);
+// moves from over to, replacing it in one step
+bool plat_file_replace(const TCHAR *from, const TCHAR *to);
+std::string plat_to_utf8(const TCHAR *str);
+void plat_from_utf8(const char *str, TCHAR *out, size_t len);
+
+// display
+double plat_refresh_rate();
+
+// memory; alignment is a power of two
+void* plat_aligned_alloc(size_t alignment, size_t size);
+void plat_aligned_free(void *ptr);
+
+// counting semaphore; post never blocks, so the audio callback may use it
+struct plat_sem;
+plat_sem* plat_sem_new();
+void plat_sem_free(plat_sem *sem);
+void plat_sem_post(plat_sem *sem);
+// false on timeout
+bool plat_sem_wait(plat_sem *sem, long long timeout_us);
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef _WIN32
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "platform.h"
+#include <dlfcn.h>
+#include <link.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <sys/stat.h>
+
+plat_dylib plat_dylib_open(const TCHAR *path)
+{
+    return dlopen(path, RTLD_NOW | RTLD_LOCAL);
+}
+
+void* plat_dylib_sym(plat_dylib lib, const char *name)
+{
+    return dlsym(lib, name);
+}
+
+void plat_dylib_close(plat_dylib lib)
+{
+    if (lib)dlclose(lib);
+}
+
+bool plat_dylib_path(plat_dylib lib, TCHAR *path, size_t len)
+{
+#ifdef RTLD_DI_LINKMAP
+    struct link_map *map = NULL;
+    if (dlinfo(lib, RTLD_DI_LINKMAP, &map) || !map || !map->l_name || !*map->l_name)
+        return false;
+    char full[PATH_MAX];
+    const char *name = realpath(map->l_name, full) ? full : map->l_name;
+    if (strlen(name) >= len)
+        return false;
+    strcpy(path, name);
+    return true;
+#else
+    return false;
+#endif
+}
+
+long long microseconds_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+long long milliseconds_now()
+{
+    return microseconds_now() / 1000;
+}
+
+void plat_sleep_us(long long usec)
+{
+    if (usec <= 0)return;
+    struct timespec ts;
+    ts.tv_sec = usec / 1000000;
+    ts.tv_nsec = (usec % 1000000) * 1000;
+    while (nanosleep(&ts, &ts) == -1)
+    {
+        if (errno != EINTR)
+            return;
+    }
+}
+
+void plat_yield()
+{
+    sched_yield();
+}
+
+void plat_path_strip(TCHAR *path)
+{
+    char *slash = strrchr(path, '/');
+    if (slash)memmove(path, slash + 1, strlen(slash + 1) + 1);
+}
+
+void plat_path_remove_ext(TCHAR *path)
+{
+    char *dot = strrchr(path, '.');
+    char *slash = strrchr(path, '/');
+    if (dot && (!slash || dot > slash))*dot = 0;
+}
+
+void plat_path_append(TCHAR *path, const TCHAR *more)
+{
+    size_t len = strlen(path);
+    if (len && path[len - 1] != '/' && len + 1 < MAX_PATH)
+        path[len++] = '/';
+    strncpy(path + len, more, MAX_PATH - len - 1);
+    path[MAX_PATH - 1] = 0;
+}
+
+bool plat_getcwd(TCHAR *path, size_t len)
+{
+    return getcwd(path, len) != NULL;
+}
+
+void* plat_aligned_alloc(size_t alignment, size_t size)
+{
+    void *ptr = NULL;
+    if (alignment < sizeof(void*))
+        alignment = sizeof(void*);
+    if (posix_memalign(&ptr, alignment, size))
+        return NULL;
+    return ptr;
+}
+
+void plat_aligned_free(void *ptr)
+{
+    free(ptr);
+}
+
+long plat_file_size(const TCHAR *path)
+{
+    struct stat st;
+    if (!path || stat(path, &st))
+        return -1;
+    return (long)st.st_size;
+}
+
+bool plat_file_sync(FILE *file)
+{
+    return !fflush(file) && !fsync(fileno(file));
+}
+
+bool plat_file_replace(const TCHAR *from, const TCHAR *to)
+{
+    return !rename(from, to);
+}
+
+std::string plat_to_utf8(const TCHAR *str)
+{
+    return std::string(str);
+}
+
+void plat_from_utf8(const char *str, TCHAR *out, size_t len)
+{
+    if (!len)return;
+    strncpy(out, str, len - 1);
+    out[len - 1] = 0;
+}
+
+double plat_refresh_rate()
+{
+    return 60.0;
+}
+
+struct plat_sem
+{
+    sem_t sem;
+};
+
+plat_sem* plat_sem_new()
+{
+    plat_sem *sem = new plat_sem;
+    if (sem_init(&sem->sem, 0, 0))
+    {
+        delete sem;
+        return NULL;
+    }
+    return sem;
+}
+
+void plat_sem_free(plat_sem *sem)
+{
+    if (!sem)return;
+    sem_destroy(&sem->sem);
+    delete sem;
+}
+
+void plat_sem_post(plat_sem *sem)
+{
+    sem_post(&sem->sem);
+}
+
+bool plat_sem_wait(plat_sem *sem, long long timeout_us)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    long long ns = ts.tv_nsec + (timeout_us % 1000000) * 1000;
+    ts.tv_sec += (time_t)(timeout_us / 1000000 + ns / 1000000000);
+    ts.tv_nsec = (long)(ns % 1000000000);
+    while (sem_timedwait(&sem->sem, &ts))
+    {
+        if (errno != EINTR)
+            return false;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,188 @@
+#ifdef _WIN32
+#include "platform.h"
+#include <Shlwapi.h>
+#include <malloc.h>
+#include <io.h>
+
+plat_dylib plat_dylib_open(const TCHAR *path)
+{
+    return (plat_dylib)LoadLibrary(path);
+}
+
+void* plat_dylib_sym(plat_dylib lib, const char *name)
+{
+    return (void*)GetProcAddress((HMODULE)lib, name);
+}
+
+void plat_dylib_close(plat_dylib lib)
+{
+    if (lib)FreeLibrary((HMODULE)lib);
+}
+
+bool plat_dylib_path(plat_dylib lib, TCHAR *path, size_t len)
+{
+    DWORD ret = GetModuleFileName((HMODULE)lib, path, (DWORD)len);
+    return ret && ret < len;
+}
+
+static double PerfFrequencyInverse = 0.;
+static void InitPerfFrequencyInverse()
+{
+    LARGE_INTEGER freq = {};
+    if (!::QueryPerformanceFrequency(&freq) || freq.QuadPart == 0)
+        return;
+    PerfFrequencyInverse = 1000000. / (double)freq.QuadPart;
+}
+
+long long milliseconds_now() {
+    return microseconds_now() / 1000;
+}
+
+long long microseconds_now() {
+    LARGE_INTEGER timeStamp = {};
+    if (!::QueryPerformanceCounter(&timeStamp))
+        return 0;
+    if (PerfFrequencyInverse == 0.)
+        InitPerfFrequencyInverse();
+    return (uint64_t)(PerfFrequencyInverse * timeStamp.QuadPart);
+}
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+void plat_sleep_us(long long usec)
+{
+    if (usec <= 0)return;
+    // Sleep() rounds to the scheduler tick, up to 15.6ms; a high
+    // resolution waitable timer (Windows 10 1803+) wakes within about
+    // half a millisecond. One per thread, kept for the thread's life.
+    static __declspec(thread) HANDLE timer = NULL;
+    static __declspec(thread) bool tried = false;
+    if (!tried)
+    {
+        tried = true;
+        timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    }
+    LARGE_INTEGER due;
+    due.QuadPart = -usec * 10; // relative, in 100ns
+    if (timer && SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE))
+        WaitForSingleObject(timer, INFINITE);
+    else
+        Sleep((DWORD)(usec / 1000));
+}
+
+void plat_yield()
+{
+    SwitchToThread();
+}
+
+void plat_path_strip(TCHAR *path)
+{
+    PathStripPath(path);
+}
+
+void plat_path_remove_ext(TCHAR *path)
+{
+    PathRemoveExtension(path);
+}
+
+void plat_path_append(TCHAR *path, const TCHAR *more)
+{
+    PathAppend(path, more);
+}
+
+bool plat_getcwd(TCHAR *path, size_t len)
+{
+    return GetCurrentDirectory((DWORD)len, path) != 0;
+}
+
+void* plat_aligned_alloc(size_t alignment, size_t size)
+{
+    return _aligned_malloc(size, alignment);
+}
+
+void plat_aligned_free(void *ptr)
+{
+    _aligned_free(ptr);
+}
+
+long plat_file_size(const TCHAR *path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA fileInfo;
+    if (NULL == path)
+        return -1;
+    if (!GetFileAttributesEx(path, GetFileExInfoStandard, (void*)&fileInfo))
+        return -1;
+    if (fileInfo.nFileSizeHigh)
+        return -1;
+    return (long)fileInfo.nFileSizeLow;
+}
+
+bool plat_file_sync(FILE *file)
+{
+    return !fflush(file) && !_commit(_fileno(file));
+}
+
+bool plat_file_replace(const TCHAR *from, const TCHAR *to)
+{
+    return MoveFileEx(from, to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
+}
+
+std::string plat_to_utf8(const TCHAR *str)
+{
+#ifdef UNICODE
+    int len = WideCharToMultiByte(CP_UTF8, 0, str, -1, NULL, 0, NULL, NULL);
+    if (len <= 1)
+        return std::string();
+    std::string utf8(len - 1, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, str, -1, &utf8[0], len, NULL, NULL);
+    return utf8;
+#else
+    return std::string(str);
+#endif
+}
+
+void plat_from_utf8(const char *str, TCHAR *out, size_t len)
+{
+    if (!len)return;
+#ifdef UNICODE
+    if (!MultiByteToWideChar(CP_UTF8, 0, str, -1, out, (int)len))
+        out[len - 1] = 0;
+#else
+    strncpy(out, str, len - 1);
+    out[len - 1] = 0;
+#endif
+}
+
+double plat_refresh_rate()
+{
+    DEVMODE lpDevMode;
+    memset(&lpDevMode, 0, sizeof(DEVMODE));
+    lpDevMode.dmSize = sizeof(DEVMODE);
+    if (EnumDisplaySettings(NULL, ENUM_CURRENT_SETTINGS, &lpDevMode) == 0)
+        return 60.0; // default value if cannot retrieve from user settings.
+    return lpDevMode.dmDisplayFrequency;
+}
+
+plat_sem* plat_sem_new()
+{
+    return (plat_sem*)CreateSemaphore(NULL, 0, MAXLONG, NULL);
+}
+
+void plat_sem_free(plat_sem *sem)
+{
+    if (sem)CloseHandle((HANDLE)sem);
+}
+
+void plat_sem_post(plat_sem *sem)
+{
+    ReleaseSemaphore((HANDLE)sem, 1, NULL);
+}
+
+bool plat_sem_wait(plat_sem *sem, long long timeout_us)
+{
+    return WaitForSingleObject((HANDLE)sem, (DWORD)((timeout_us + 999) / 1000)) == WAIT_OBJECT_0;
+}
+
+#endif
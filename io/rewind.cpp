@@ -0,0 +1,258 @@
+#include "rewind.h"
+#include "platform.h"
+#include <emmintrin.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// A delta is a list of (zero run, literal length, literal bytes) records,
+// lengths as LEB128. A literal runs until the next 16 bytes that match in
+// full, so short matches inside a changed area don't split it up.
+
+static inline unsigned first_set(unsigned mask)
+{
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return (unsigned)i;
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+static inline bool block_same(const uint8_t *a, const uint8_t *b)
+{
+    __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+    return _mm_movemask_epi8(eq) == 0xffff;
+}
+
+// the first byte from pos on where a and b differ
+static size_t find_change(const uint8_t *a, const uint8_t *b, size_t pos, size_t size)
+{
+    for (; pos + 16 <= size; pos += 16)
+    {
+        __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a + pos)),
+            _mm_loadu_si128((const __m128i*)(b + pos)));
+        unsigned mask = (unsigned)_mm_movemask_epi8(eq) ^ 0xffff;
+        if (mask)
+            return pos + first_set(mask);
+    }
+    while (pos < size && a[pos] == b[pos])
+        pos++;
+    return pos;
+}
+
+// where a changed area starting at pos ends
+static size_t find_match(const uint8_t *a, const uint8_t *b, size_t pos, size_t size)
+{
+    for (; pos + 16 <= size; pos += 16)
+        if (block_same(a + pos, b + pos))
+            return pos;
+    return size;
+}
+
+static void xor_bytes(uint8_t *dst, const uint8_t *a, const uint8_t *b, size_t size)
+{
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16)
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(_mm_loadu_si128((const __m128i*)(a + i)),
+            _mm_loadu_si128((const __m128i*)(b + i))));
+    for (; i < size; i++)
+        dst[i] = a[i] ^ b[i];
+}
+
+static uint8_t *put_length(uint8_t *p, size_t v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static bool get_length(const uint8_t **p, const uint8_t *end, size_t *v)
+{
+    size_t out = 0;
+    for (unsigned shift = 0; *p < end && shift < sizeof(size_t) * 8; shift += 7)
+    {
+        uint8_t c = *(*p)++;
+        out |= (size_t)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+        {
+            *v = out;
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t rewind_delta_bound(size_t size)
+{
+    // a record other than the first covers at least 17 bytes, and its two
+    // lengths take at most 10 bytes each
+    return size + (size / 16 + 1) * 2 * 10;
+}
+
+size_t rewind_delta_encode(uint8_t *dst, uint8_t *a, const uint8_t *b, size_t size)
+{
+    uint8_t *p = dst;
+    size_t pos = 0;
+    while (pos < size)
+    {
+        size_t start = find_change(a, b, pos, size);
+        if (start == size)
+            break;
+        size_t end = find_match(a, b, start, size);
+        p = put_length(p, start - pos);
+        p = put_length(p, end - start);
+        xor_bytes(p, a + start, b + start, end - start);
+        memcpy(a + start, b + start, end - start);
+        p += end - start;
+        pos = end;
+    }
+    return p - dst;
+}
+
+bool rewind_delta_apply(uint8_t *state, size_t size, const uint8_t *delta, size_t length)
+{
+    const uint8_t *p = delta, *end = delta + length;
+    size_t pos = 0;
+    while (p < end)
+    {
+        size_t zeros, literal;
+        if (!get_length(&p, end, &zeros) || !get_length(&p, end, &literal))
+            return false;
+        if (zeros > size - pos || literal > size - pos - zeros || literal > (size_t)(end - p))
+            return false;
+        pos += zeros;
+        xor_bytes(state + pos, state + pos, p, literal);
+        pos += literal;
+        p += literal;
+    }
+    return true;
+}
+
+bool rewind_init(rewind_buffer *rb, size_t state_size, size_t budget)
+{
+    memset(rb, 0, sizeof(*rb));
+    rb->last = (uint8_t*)plat_aligned_alloc(64, state_size);
+    rb->scratch = (uint8_t*)plat_aligned_alloc(64, rewind_delta_bound(state_size));
+    rb->ring = (uint8_t*)malloc(budget);
+    if (!rb->last || !rb->scratch || !rb->ring)
+    {
+        rewind_free(rb);
+        return false;
+    }
+    rb->state_size = state_size;
+    rb->capacity = budget;
+    rewind_clear(rb);
+    return true;
+}
+
+void rewind_free(rewind_buffer *rb)
+{
+    plat_aligned_free(rb->last);
+    plat_aligned_free(rb->scratch);
+    free(rb->ring);
+    free(rb->entries);
+    memset(rb, 0, sizeof(*rb));
+}
+
+void rewind_clear(rewind_buffer *rb)
+{
+    if (rb->last)
+        memset(rb->last, 0, rb->state_size);
+    rb->first = rb->count = 0;
+    rb->used = 0;
+    rb->dropped = false;
+}
+
+static void drop_oldest(rewind_buffer *rb)
+{
+    rb->used -= rb->entries[rb->first].length;
+    rb->first = (rb->first + 1) % rb->entry_cap;
+    rb->count--;
+    rb->dropped = true;
+}
+
+static rewind_entry *newest(rewind_buffer *rb)
+{
+    return &rb->entries[(rb->first + rb->count - 1) % rb->entry_cap];
+}
+
+// where in the ring length bytes can go once the oldest entries in the
+// way have been dropped
+static size_t make_room(rewind_buffer *rb, size_t length)
+{
+    while (rb->count)
+    {
+        size_t tail = rb->entries[rb->first].offset;
+        rewind_entry *n = newest(rb);
+        size_t head = n->offset + n->length;
+        if (n->offset >= tail)
+        {
+            // in one piece: free space at the end, then at the start
+            if (rb->capacity - head >= length)
+                return head;
+            if (tail >= length)
+                return 0;
+        }
+        else if (tail - head >= length)
+            return head;
+        drop_oldest(rb);
+    }
+    return 0;
+}
+
+bool rewind_push(rewind_buffer *rb, const void *state)
+{
+    if (rb->count == rb->entry_cap)
+    {
+        unsigned cap = rb->entry_cap ? rb->entry_cap * 2 : 64;
+        rewind_entry *e = (rewind_entry*)malloc(cap * sizeof(rewind_entry));
+        if (!e)
+            return false;
+        for (unsigned i = 0; i < rb->count; i++)
+            e[i] = rb->entries[(rb->first + i) % rb->entry_cap];
+        free(rb->entries);
+        rb->entries = e;
+        rb->entry_cap = cap;
+        rb->first = 0;
+    }
+    size_t length = rewind_delta_encode(rb->scratch, rb->last, (const uint8_t*)state, rb->state_size);
+    rb->raw_bytes += rb->state_size;
+    rb->coded_bytes += length;
+    if (length > rb->capacity)
+    {
+        // last already moved on; what's left can't lead back to it
+        rb->first = rb->count = 0;
+        rb->used = 0;
+        rb->dropped = true;
+        return false;
+    }
+    size_t offset = make_room(rb, length);
+    rb->count++;
+    rewind_entry *n = newest(rb);
+    n->offset = offset;
+    n->length = length;
+    rb->used += length;
+    memcpy(rb->ring + offset, rb->scratch, length);
+    return true;
+}
+
+const uint8_t *rewind_pop(rewind_buffer *rb)
+{
+    // the oldest entry of a fresh history leads back to zeros
+    if (!rb->count || (rb->count == 1 && !rb->dropped))
+        return NULL;
+    rewind_entry *n = newest(rb);
+    if (!rewind_delta_apply(rb->last, rb->state_size, rb->ring + n->offset, n->length))
+        return NULL;
+    rb->used -= n->length;
+    rb->count--;
+    return rb->last;
+}
@@ -0,0 +1,52 @@
+#ifndef _rewind_h_
+#define _rewind_h_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Savestate history for rewinding, held in a fixed byte budget. Each
+// captured state is kept as the XOR of it and the state before, with the
+// runs of zero bytes that leaves (most of the state, frame to frame)
+// coded as lengths. The newest state is kept whole; stepping back XORs the
+// newest delta into it, so a step costs one pass over one state however
+// long the history is. When the budget runs out the oldest deltas go.
+
+struct rewind_entry
+{
+    size_t offset; // into ring
+    size_t length;
+};
+
+struct rewind_buffer
+{
+    size_t state_size;
+    uint8_t *last;    // the newest state, whole
+    uint8_t *scratch; // the delta being coded
+    uint8_t *ring;
+    size_t capacity;
+    rewind_entry *entries; // oldest first, circular
+    unsigned entry_cap, first, count;
+    size_t used;  // bytes of ring the entries take
+    bool dropped; // the oldest entry is a delta from a real state that's gone,
+                  // not from the zeros history starts with
+    unsigned long long raw_bytes;   // states pushed, uncompressed
+    unsigned long long coded_bytes; // and as stored
+};
+
+// budget is the ring size in bytes, on top of two states of working space
+bool rewind_init(rewind_buffer *rb, size_t state_size, size_t budget);
+void rewind_free(rewind_buffer *rb);
+// forgets the history, e.g. after a savestate load or reset
+void rewind_clear(rewind_buffer *rb);
+bool rewind_push(rewind_buffer *rb, const void *state);
+// steps one capture back; the state to load, or NULL at the start of history
+const uint8_t *rewind_pop(rewind_buffer *rb);
+
+// the delta coder on its own: codes a ^ b into dst (up to
+// rewind_delta_bound bytes) and then copies b over a
+size_t rewind_delta_bound(size_t size);
+size_t rewind_delta_encode(uint8_t *dst, uint8_t *a, const uint8_t *b, size_t size);
+// XORs a coded delta into state; false when it's malformed
+bool rewind_delta_apply(uint8_t *state, size_t size, const uint8_t *delta, size_t length);
+
+#endif
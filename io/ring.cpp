@@ -0,0 +1,143 @@
+#include "ring.h"
+
+audio_ring *ring_new(size_t frames, size_t frame_size)
+{
+    size_t capacity = 1;
+    while (capacity < frames)
+        capacity <<= 1;
+
+    audio_ring *ring = new audio_ring();
+    ring->buffer = new char[capacity * frame_size]();
+    ring->capacity = capacity;
+    ring->mask = capacity - 1;
+    ring->frame_size = frame_size;
+    ring->space = plat_sem_new();
+    ring->data = plat_sem_new();
+    if (!ring->space || !ring->data)
+    {
+        ring_free(ring);
+        return NULL;
+    }
+    ring_clear(ring);
+    return ring;
+}
+
+void ring_free(audio_ring *ring)
+{
+    if (!ring)
+        return;
+    plat_sem_free(ring->space);
+    plat_sem_free(ring->data);
+    delete[] ring->buffer;
+    delete ring;
+}
+
+void ring_clear(audio_ring *ring)
+{
+    ring->write_pos.store(0);
+    ring->read_pos.store(0);
+    ring->read_cache = 0;
+    ring->write_cache = 0;
+    ring->writer_wants.store(0);
+    ring->reader_wants.store(0);
+}
+
+size_t ring_write(audio_ring *ring, const void *in, size_t frames)
+{
+    size_t w = ring->write_pos.load(std::memory_order_relaxed);
+    size_t space = ring->capacity - (w - ring->read_cache);
+    if (space < frames)
+    {
+        // only touch the consumer's line when the cached view runs short
+        ring->read_cache = ring->read_pos.load(std::memory_order_acquire);
+        space = ring->capacity - (w - ring->read_cache);
+    }
+    if (frames > space)
+        frames = space;
+    if (!frames)
+        return 0;
+
+    size_t index = w & ring->mask;
+    size_t first = frames < ring->capacity - index ? frames : ring->capacity - index;
+    size_t fs = ring->frame_size;
+    memcpy(ring->buffer + index * fs, in, first * fs);
+    memcpy(ring->buffer, (const char*)in + first * fs, (frames - first) * fs);
+    // seq_cst pairs with the store in ring_wait_readable, as below
+    w += frames;
+    ring->write_pos.store(w, std::memory_order_seq_cst);
+    size_t wants = ring->reader_wants.load(std::memory_order_seq_cst);
+    if (wants && w - ring->read_pos.load(std::memory_order_acquire) >= wants && ring->reader_wants.exchange(0))
+        plat_sem_post(ring->data);
+    return frames;
+}
+
+size_t ring_read(audio_ring *ring, void *out, size_t frames)
+{
+    size_t r = ring->read_pos.load(std::memory_order_relaxed);
+    size_t avail = ring->write_cache - r;
+    if (avail < frames)
+    {
+        ring->write_cache = ring->write_pos.load(std::memory_order_acquire);
+        avail = ring->write_cache - r;
+    }
+    if (frames > avail)
+        frames = avail;
+    if (!frames)
+        return 0;
+
+    size_t index = r & ring->mask;
+    size_t first = frames < ring->capacity - index ? frames : ring->capacity - index;
+    size_t fs = ring->frame_size;
+    memcpy(out, ring->buffer + index * fs, first * fs);
+    memcpy((char*)out + first * fs, ring->buffer, (frames - first) * fs);
+    // seq_cst pairs with the store in ring_wait_writable so a waiting
+    // producer either sees this space or gets the post
+    r += frames;
+    ring->read_pos.store(r, std::memory_order_seq_cst);
+    size_t wants = ring->writer_wants.load(std::memory_order_seq_cst);
+    if (wants && ring->capacity - (ring->write_cache - r) >= wants && ring->writer_wants.exchange(0))
+        plat_sem_post(ring->space);
+    return frames;
+}
+
+bool ring_wait_writable(audio_ring *ring, size_t frames, long long timeout_us)
+{
+    if (frames > ring->capacity)
+        frames = ring->capacity;
+    if (!frames)
+        frames = 1;
+    ring->writer_wants.store(frames, std::memory_order_seq_cst);
+    size_t w = ring->write_pos.load(std::memory_order_relaxed);
+    if (ring->capacity - (w - ring->read_pos.load(std::memory_order_seq_cst)) >= frames)
+    {
+        ring->writer_wants.store(0, std::memory_order_relaxed);
+        return true;
+    }
+    bool woke = plat_sem_wait(ring->space, timeout_us);
+    ring->writer_wants.store(0, std::memory_order_relaxed);
+    return woke;
+}
+
+bool ring_wait_readable(audio_ring *ring, size_t frames, long long timeout_us)
+{
+    if (frames > ring->capacity)
+        frames = ring->capacity;
+    if (!frames)
+        frames = 1;
+    ring->reader_wants.store(frames, std::memory_order_seq_cst);
+    size_t r = ring->read_pos.load(std::memory_order_relaxed);
+    if (ring->write_pos.load(std::memory_order_seq_cst) - r >= frames)
+    {
+        ring->reader_wants.store(0, std::memory_order_relaxed);
+        return true;
+    }
+    bool woke = plat_sem_wait(ring->data, timeout_us);
+    ring->reader_wants.store(0, std::memory_order_relaxed);
+    return woke && ring->write_pos.load(std::memory_order_acquire) - r >= frames;
+}
+
+void ring_wake_reader(audio_ring *ring)
+{
+    ring->reader_wants.store(0, std::memory_order_relaxed);
+    plat_sem_post(ring->data);
+}
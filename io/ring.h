@@ -0,0 +1,70 @@
+#ifndef _ring_h_
+#define _ring_h_
+
+#include <atomic>
+#include "platform.h"
+
+// Single producer / single consumer ring of fixed-size frames (interleaved
+// float for the device ring, raw int16 for the DSP queue). Neither side
+// takes a lock. Capacity is a power of two so positions run freely and are
+// masked on access. The only waits are ring_wait_writable() and
+// ring_wait_readable(), for a side that has nothing better to do; the
+// other side wakes it with a semaphore post, which never blocks, once the
+// requested amount is there.
+
+#define RING_CACHE_LINE 64
+
+struct audio_ring
+{
+    char *buffer;
+    size_t capacity; // frames
+    size_t mask;
+    size_t frame_size; // bytes
+    plat_sem *space;
+    plat_sem *data;
+    char pad0[RING_CACHE_LINE];
+
+    // producer side
+    std::atomic<size_t> write_pos;
+    size_t read_cache;
+    char pad1[RING_CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    // consumer side
+    std::atomic<size_t> read_pos;
+    size_t write_cache;
+    char pad2[RING_CACHE_LINE - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+
+    std::atomic<size_t> writer_wants; // frames, 0 when nobody waits
+    std::atomic<size_t> reader_wants;
+};
+
+// rounds frames up to a power of two; NULL if the semaphores can't be made
+audio_ring *ring_new(size_t frames, size_t frame_size);
+void ring_free(audio_ring *ring);
+// only while neither side is running
+void ring_clear(audio_ring *ring);
+
+// returns frames actually written/read
+size_t ring_write(audio_ring *ring, const void *in, size_t frames);
+size_t ring_read(audio_ring *ring, void *out, size_t frames);
+
+// blocks the producer until 'frames' are free (clamped to capacity);
+// false on timeout
+bool ring_wait_writable(audio_ring *ring, size_t frames, long long timeout_us);
+// blocks the consumer until 'frames' are queued (clamped to capacity);
+// false on timeout or ring_wake_reader
+bool ring_wait_readable(audio_ring *ring, size_t frames, long long timeout_us);
+// ends a ring_wait_readable early, for shutting the consumer down
+void ring_wake_reader(audio_ring *ring);
+
+static __forceinline size_t ring_read_avail(audio_ring *ring)
+{
+    return ring->write_pos.load(std::memory_order_acquire) - ring->read_pos.load(std::memory_order_relaxed);
+}
+
+static __forceinline size_t ring_write_avail(audio_ring *ring)
+{
+    return ring->capacity - (ring->write_pos.load(std::memory_order_relaxed) - ring->read_pos.load(std::memory_order_acquire));
+}
+
+#endif
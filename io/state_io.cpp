@@ -0,0 +1,291 @@
+#include "state_io.h"
+#include "rewind.h"
+#include "blargg_config.h"
+#include <stdlib.h>
+#ifdef HAVE_ZLIB_H
+#include "zlib.h"
+#endif
+
+static const char state_magic[4] = { 'E', 'W', 'S', 'T' };
+#define STATE_HEADER 16 // magic, codec (u32), state size (u64)
+
+bool state_encode(std::vector<uint8_t> &file, const uint8_t *state, size_t size, state_codec codec)
+{
+    uint32_t c = codec;
+    uint64_t raw = size;
+    size_t bound = size;
+    if (codec == STATE_CODEC_ZERO_RUNS)
+        bound = rewind_delta_bound(size);
+#ifdef HAVE_ZLIB_H
+    if (codec == STATE_CODEC_ZLIB)
+        bound = compressBound((uLong)size);
+#else
+    if (codec == STATE_CODEC_ZLIB)
+        return false;
+#endif
+    file.resize(STATE_HEADER + bound);
+    memcpy(&file[0], state_magic, 4);
+    memcpy(&file[4], &c, 4);
+    memcpy(&file[8], &raw, 8);
+    uint8_t *out = &file[STATE_HEADER];
+    switch (codec)
+    {
+    case STATE_CODEC_RAW:
+        memcpy(out, state, size);
+        break;
+    case STATE_CODEC_ZERO_RUNS:
+    {
+        // a delta from all zeros leaves only the zero runs to code
+        uint8_t *zeros = (uint8_t*)calloc(size ? size : 1, 1);
+        if (!zeros)
+            return false;
+        bound = rewind_delta_encode(out, zeros, state, size);
+        free(zeros);
+        break;
+    }
+#ifdef HAVE_ZLIB_H
+    case STATE_CODEC_ZLIB:
+    {
+        uLongf len = (uLongf)bound;
+        if (compress2(out, &len, state, (uLong)size, Z_BEST_SPEED) != Z_OK)
+            return false;
+        bound = len;
+        break;
+    }
+#endif
+    default:
+        return false;
+    }
+    file.resize(STATE_HEADER + bound);
+    return true;
+}
+
+bool state_decode(std::vector<uint8_t> &state, const uint8_t *file, size_t size)
+{
+    if (size < STATE_HEADER || memcmp(file, state_magic, 4))
+    {
+        state.assign(file, file + size);
+        return true;
+    }
+    uint32_t codec;
+    uint64_t raw;
+    memcpy(&codec, file + 4, 4);
+    memcpy(&raw, file + 8, 8);
+    const uint8_t *in = file + STATE_HEADER;
+    size_t len = size - STATE_HEADER;
+    if (raw > (size_t)-1 / 2)
+        return false;
+    switch (codec)
+    {
+    case STATE_CODEC_RAW:
+        if (len != raw)
+            return false;
+        state.assign(in, in + len);
+        return true;
+    case STATE_CODEC_ZERO_RUNS:
+        state.assign((size_t)raw, 0);
+        return rewind_delta_apply(state.empty() ? NULL : &state[0], (size_t)raw, in, len);
+#ifdef HAVE_ZLIB_H
+    case STATE_CODEC_ZLIB:
+    {
+        state.resize((size_t)raw);
+        uLongf out = (uLongf)raw;
+        return raw && uncompress(&state[0], &out, in, (uLong)len) == Z_OK && out == raw;
+    }
+#endif
+    }
+    return false;
+}
+
+// writes beside the target and swaps it in once the data is on the disk
+static bool state_write(state_io *io, state_job *job, std::vector<uint8_t> &file)
+{
+    if (!state_encode(file, job->data.empty() ? NULL : &job->data[0], job->data.size(), io->codec))
+        return false;
+    TCHAR temp[MAX_PATH + 8];
+    _tcscpy(temp, job->path);
+    _tcscat(temp, _T(".tmp"));
+    FILE *fp = _tfopen(temp, _T("wb"));
+    if (!fp)
+        return false;
+    bool ok = fwrite(&file[0], 1, file.size(), fp) == file.size() && plat_file_sync(fp);
+    fclose(fp);
+    ok = ok && plat_file_replace(temp, job->path);
+    if (!ok)
+        _tremove(temp);
+    job->file_bytes = file.size();
+    return ok;
+}
+
+static bool state_read(state_job *job, std::vector<uint8_t> &file)
+{
+    long size = plat_file_size(job->path);
+    FILE *fp = size > 0 ? _tfopen(job->path, _T("rb")) : NULL;
+    if (!fp)
+        return false;
+    file.resize(size);
+    bool ok = fread(&file[0], 1, size, fp) == (size_t)size;
+    fclose(fp);
+    job->file_bytes = size;
+    return ok && state_decode(job->data, &file[0], size);
+}
+
+static void state_worker(void *data)
+{
+    state_io *io = (state_io*)data;
+    std::vector<uint8_t> file; // compressed bytes, reused
+    slock_lock(io->lock);
+    for (;;)
+    {
+        while (io->queue.empty() && !io->quit)
+            scond_wait(io->cond, io->lock);
+        if (io->queue.empty())
+            break;
+        state_job *job = io->queue.front();
+        io->queue.pop_front();
+        io->busy = true;
+        slock_unlock(io->lock);
+
+        long long start = microseconds_now();
+        job->ok = job->save ? state_write(io, job, file) : state_read(job, file);
+        job->worker_us = microseconds_now() - start;
+
+        slock_lock(io->lock);
+        io->busy = false;
+        io->stats.worker_us += job->worker_us;
+        if (!job->ok)
+            io->stats.failures++;
+        else
+        {
+            io->stats.raw_bytes += job->data.size();
+            io->stats.file_bytes += job->file_bytes;
+            job->save ? io->stats.saves++ : io->stats.loads++;
+        }
+        if (job->save || !job->ok)
+            io->pool.push_back(job);
+        else
+            io->loaded.push_back(job);
+        scond_broadcast(io->cond);
+    }
+    slock_unlock(io->lock);
+}
+
+state_io *state_io_new()
+{
+    state_io *io = new state_io();
+    io->lock = slock_new();
+    io->cond = scond_new();
+    io->busy = false;
+    io->quit = false;
+#ifdef HAVE_ZLIB_H
+    io->codec = STATE_CODEC_ZLIB;
+#else
+    io->codec = STATE_CODEC_ZERO_RUNS;
+#endif
+    memset(&io->stats, 0, sizeof(io->stats));
+    io->thread = io->lock && io->cond ? sthread_create(state_worker, io) : NULL;
+    if (!io->thread)
+    {
+        state_io_free(io);
+        return NULL;
+    }
+    return io;
+}
+
+void state_io_free(state_io *io)
+{
+    if (!io)
+        return;
+    if (io->thread)
+    {
+        slock_lock(io->lock);
+        io->quit = true;
+        scond_broadcast(io->cond);
+        slock_unlock(io->lock);
+        sthread_join(io->thread);
+    }
+    for (size_t i = 0; i < io->pool.size(); i++)
+        delete io->pool[i];
+    for (size_t i = 0; i < io->loaded.size(); i++)
+        delete io->loaded[i];
+    if (io->cond)
+        scond_free(io->cond);
+    if (io->lock)
+        slock_free(io->lock);
+    delete io;
+}
+
+state_job *state_io_job(state_io *io)
+{
+    state_job *job = NULL;
+    slock_lock(io->lock);
+    if (!io->pool.empty())
+    {
+        job = io->pool.back();
+        io->pool.pop_back();
+    }
+    slock_unlock(io->lock);
+    if (!job)
+        job = new state_job();
+    job->ok = false;
+    job->file_bytes = 0;
+    job->worker_us = 0;
+    return job;
+}
+
+static void state_io_queue(state_io *io, state_job *job, bool save, const TCHAR *path)
+{
+    job->save = save;
+    _tcsncpy(job->path, path, MAX_PATH - 1);
+    job->path[MAX_PATH - 1] = 0;
+    slock_lock(io->lock);
+    io->queue.push_back(job);
+    scond_broadcast(io->cond);
+    slock_unlock(io->lock);
+}
+
+void state_io_save(state_io *io, state_job *job, const TCHAR *path)
+{
+    state_io_queue(io, job, true, path);
+}
+
+void state_io_load(state_io *io, const TCHAR *path)
+{
+    state_io_queue(io, state_io_job(io), false, path);
+}
+
+state_job *state_io_take(state_io *io)
+{
+    state_job *job = NULL;
+    slock_lock(io->lock);
+    if (!io->loaded.empty())
+    {
+        job = io->loaded.front();
+        io->loaded.pop_front();
+    }
+    slock_unlock(io->lock);
+    return job;
+}
+
+void state_io_release(state_io *io, state_job *job)
+{
+    slock_lock(io->lock);
+    io->pool.push_back(job);
+    slock_unlock(io->lock);
+}
+
+void state_io_flush(state_io *io)
+{
+    slock_lock(io->lock);
+    while (!io->queue.empty() || io->busy)
+        scond_wait(io->cond, io->lock);
+    slock_unlock(io->lock);
+}
+
+state_io_stats state_io_get_stats(state_io *io)
+{
+    slock_lock(io->lock);
+    state_io_stats stats = io->stats;
+    slock_unlock(io->lock);
+    return stats;
+}
@@ -0,0 +1,76 @@
+#ifndef _state_io_h_
+#define _state_io_h_
+
+#include "platform.h"
+#include <deque>
+#include <vector>
+
+// Savestate files, read and written on a worker thread so the emulation
+// thread only serializes and unserializes. A save hands the worker a
+// snapshot, which it compresses and writes to a temporary file that then
+// replaces the old one, so a crash mid-write never leaves half a state. A
+// load is read and decompressed ahead and picked up by the emulation
+// thread at its next frame. Snapshot buffers are pooled and keep their
+// size, so a save allocates nothing once the first has run.
+//
+// Files start with a small header naming the codec: zlib when the build
+// has it (HAVE_ZLIB_H), otherwise the zero run coding rewind uses. Files
+// without the header are read as a raw state, as older builds wrote them.
+
+enum state_codec
+{
+    STATE_CODEC_RAW,
+    STATE_CODEC_ZERO_RUNS,
+    STATE_CODEC_ZLIB
+};
+
+struct state_job
+{
+    bool save;
+    bool ok;
+    TCHAR path[MAX_PATH];
+    std::vector<uint8_t> data; // the state, uncompressed
+    size_t file_bytes;
+    long long worker_us;
+};
+
+struct state_io_stats
+{
+    unsigned saves, loads, failures;
+    unsigned long long raw_bytes, file_bytes;
+    long long worker_us;
+};
+
+struct state_io
+{
+    sthread_t *thread;
+    slock_t *lock;
+    scond_t *cond; // work queued, or the queue drained
+    std::deque<state_job*> queue;  // to the worker
+    std::deque<state_job*> loaded; // back to the emulation thread
+    std::vector<state_job*> pool;
+    bool busy;
+    bool quit;
+    state_codec codec;
+    state_io_stats stats;
+};
+
+state_io *state_io_new();
+// finishes the saves still queued first
+void state_io_free(state_io *io);
+// a pooled job for a snapshot; its data keeps the last size it had
+state_job *state_io_job(state_io *io);
+void state_io_save(state_io *io, state_job *job, const TCHAR *path);
+void state_io_load(state_io *io, const TCHAR *path);
+// a finished load, or NULL; hand it back with state_io_release
+state_job *state_io_take(state_io *io);
+void state_io_release(state_io *io, state_job *job);
+// waits until the worker has nothing left to do
+void state_io_flush(state_io *io);
+state_io_stats state_io_get_stats(state_io *io);
+
+// the file format on its own
+bool state_encode(std::vector<uint8_t> &file, const uint8_t *state, size_t size, state_codec codec);
+bool state_decode(std::vector<uint8_t> &state, const uint8_t *file, size_t size);
+
+#endif
@@ -0,0 +1,75 @@
+#include "triple_buffer.h"
+
+triple_buffer *triple_buffer_new()
+{
+    triple_buffer *tb = new triple_buffer();
+    memset(tb->slot, 0, sizeof(tb->slot));
+    tb->back = 0;
+    tb->middle.store(1);
+    tb->front = 2;
+    tb->fresh = plat_sem_new();
+    tb->dropped.store(0);
+    return tb;
+}
+
+void triple_buffer_free(triple_buffer *tb)
+{
+    if (!tb)
+        return;
+    for (unsigned i = 0; i < 3; i++)
+        plat_aligned_free(tb->slot[i].data);
+    plat_sem_free(tb->fresh);
+    delete tb;
+}
+
+frame_slot *triple_buffer_back(triple_buffer *tb, size_t size)
+{
+    frame_slot *s = &tb->slot[tb->back];
+    if (s->size < size)
+    {
+        plat_aligned_free(s->data);
+        s->data = (uint8_t*)plat_aligned_alloc(64, size);
+        s->size = s->data ? size : 0;
+        if (!s->data)
+            return NULL;
+    }
+    return s;
+}
+
+void triple_buffer_publish(triple_buffer *tb)
+{
+    tb->slot[tb->back].published_us = microseconds_now();
+    // acq_rel: the slot's contents go out with it, and the slot coming
+    // back is one the consumer has finished with
+    unsigned old = tb->middle.exchange(tb->back | TRIPLE_FRESH, std::memory_order_acq_rel);
+    if (old & TRIPLE_FRESH)
+        tb->dropped.fetch_add(1, std::memory_order_relaxed);
+    tb->back = old & ~TRIPLE_FRESH;
+    plat_sem_post(tb->fresh);
+}
+
+bool triple_buffer_pending(triple_buffer *tb)
+{
+    return (tb->middle.load(std::memory_order_acquire) & TRIPLE_FRESH) != 0;
+}
+
+frame_slot *triple_buffer_take(triple_buffer *tb)
+{
+    if (!(tb->middle.load(std::memory_order_relaxed) & TRIPLE_FRESH))
+        return NULL;
+    unsigned old = tb->middle.exchange(tb->front, std::memory_order_acq_rel);
+    tb->front = old & ~TRIPLE_FRESH;
+    return &tb->slot[tb->front];
+}
+
+bool triple_buffer_wait(triple_buffer *tb, long long timeout_us)
+{
+    // posts from frames that were replaced before being taken leave the
+    // count high; those wakeups just find nothing to take
+    return plat_sem_wait(tb->fresh, timeout_us);
+}
+
+void triple_buffer_wake(triple_buffer *tb)
+{
+    plat_sem_post(tb->fresh);
+}
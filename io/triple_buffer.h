@@ -0,0 +1,53 @@
+#ifndef _triple_buffer_h_
+#define _triple_buffer_h_
+
+#include <atomic>
+#include "platform.h"
+
+// Hands video frames from the emulation thread to the render thread
+// without a lock. Of the three slots the producer owns one (back), the
+// consumer owns one (front) and the third sits in between. Publishing
+// swaps back with the middle slot, taking swaps the middle slot with
+// front, each with a single atomic exchange. Neither side ever waits for
+// the other: a frame published before the last one was taken replaces it
+// and counts as dropped.
+
+#define TRIPLE_FRESH 4 // set in 'middle' until the consumer takes it
+
+struct frame_slot
+{
+    uint8_t *data; // 64 byte aligned
+    size_t size;
+    unsigned width, height;
+    size_t pitch;
+    bool dupe; // show the previous frame again
+    long long published_us;
+};
+
+struct triple_buffer
+{
+    frame_slot slot[3];
+    std::atomic<unsigned> middle; // slot index | TRIPLE_FRESH
+    unsigned back;
+    unsigned front;
+    plat_sem *fresh;
+    std::atomic<unsigned> dropped;
+};
+
+triple_buffer *triple_buffer_new();
+void triple_buffer_free(triple_buffer *tb);
+
+// the producer's slot, grown to hold at least 'size' bytes; NULL if that fails
+frame_slot *triple_buffer_back(triple_buffer *tb, size_t size);
+void triple_buffer_publish(triple_buffer *tb);
+// true while a published frame hasn't been taken yet
+bool triple_buffer_pending(triple_buffer *tb);
+
+// the newest published frame, or NULL if none arrived since the last take
+frame_slot *triple_buffer_take(triple_buffer *tb);
+// blocks the consumer until something was published; false on timeout
+bool triple_buffer_wait(triple_buffer *tb, long long timeout_us);
+// ends a triple_buffer_wait early, for shutting the consumer down
+void triple_buffer_wake(triple_buffer *tb);
+
+#endif
@@ -0,0 +1,135 @@
+#include "../3rdparty/libretro.h"
+#include "glad.h"
+#include "gl_render.h"
+#include "platform.h"
+#include "pixconv.h"
+#include "frame_diff.h"
+video g_video;
+video_present_stats g_present_stats;
+static uint8_t *g_swfb = NULL;
+static size_t g_swfb_size = 0;
+static uint8_t *g_conv = NULL;
+static size_t g_conv_size = 0;
+static frame_shadow g_shadow = { 0 };
+
+// Null video sink used by the headless runner in place of gl.cpp.
+// Frames are accepted and dropped; no window, DC or GL context is touched.
+// With g_video.convert they are still widened to XRGB8888 first, and
+// unchanged frames are still spotted, so the runner measures what the
+// present path costs on the CPU. With g_video.null_vsync each frame
+// waits for a simulated vblank on a fixed 60 Hz grid, the way the
+// clocked null audio sink stands in for a device.
+
+#define NULL_VSYNC_HZ 60.0
+
+void video_configure(const struct retro_game_geometry *geom, void *hwnd) {
+    g_video.tex_w = geom->max_width;
+    g_video.tex_h = geom->max_height;
+    g_video.base_w = geom->base_width;
+    g_video.base_h = geom->base_height;
+    g_video.aspect = geom->aspect_ratio;
+    g_video.pitch = geom->base_width * g_video.bpp;
+}
+
+bool video_set_pixel_format(unsigned format) {
+    g_video.rformat = format;
+    switch (format) {
+    case RETRO_PIXEL_FORMAT_0RGB1555:
+    case RETRO_PIXEL_FORMAT_RGB565:
+        g_video.bpp = sizeof(uint16_t);
+        break;
+    case RETRO_PIXEL_FORMAT_XRGB8888:
+        g_video.bpp = sizeof(uint32_t);
+        break;
+    default:
+        break;
+    }
+    return true;
+}
+
+static void null_present() {
+    if (g_video.null_vsync) {
+        static long long epoch = 0;
+        long long now = microseconds_now();
+        if (!epoch)
+            epoch = now;
+        double period = 1000000.0 / NULL_VSYNC_HZ;
+        long long vblank = epoch + (long long)(((long long)((now - epoch) / period) + 1) * period);
+        plat_sleep_us(vblank - now);
+    }
+    g_present_stats.present_done_us.store(microseconds_now(), std::memory_order_release);
+}
+
+static void accept_frame(const void *data, unsigned width, unsigned height, unsigned pitch) {
+    if (data == NULL) {
+        g_video.dupe_frames++;
+        return;
+    }
+    g_video.frames++;
+    // our framebuffer only saves a copy if nothing below takes one
+    if (data == g_swfb && g_video.disable_elision && !g_video.convert)
+        g_video.zero_copy_frames++;
+    if (!g_video.disable_elision &&
+        frame_shadow_same(&g_shadow, data, width, height, pitch, g_video.bpp)) {
+        g_video.identical_frames++;
+        return;
+    }
+    g_video.bytes_uploaded += (size_t)width * height * (g_video.convert ? sizeof(uint32_t) : g_video.bpp);
+    if (g_video.convert) {
+        long long start = microseconds_now();
+        size_t size = (size_t)g_video.tex_w * g_video.tex_h * sizeof(uint32_t);
+        if (g_conv_size < size) {
+            plat_aligned_free(g_conv);
+            g_conv = (uint8_t*)plat_aligned_alloc(64, size);
+            g_conv_size = g_conv ? size : 0;
+        }
+        if (g_conv && width <= (unsigned)g_video.tex_w && height <= (unsigned)g_video.tex_h)
+            pixconv_frame(g_conv, width * sizeof(uint32_t), data, pitch, width, height, g_video.rformat);
+        g_video.upload_us = microseconds_now() - start;
+        g_video.upload_total_us += g_video.upload_us;
+        g_video.uploads++;
+    }
+    g_video.base_w = width;
+    g_video.base_h = height;
+    g_video.pitch = pitch;
+}
+
+void video_refresh(const void *data, unsigned width, unsigned height, unsigned pitch) {
+    accept_frame(data, width, height, pitch);
+    null_present();
+}
+
+void video_begin_frame() {
+}
+
+bool video_set_hw_render(struct retro_hw_render_callback *hw) {
+    return false;
+}
+
+bool video_get_software_framebuffer(struct retro_framebuffer *fb) {
+    if (!g_video.bpp || fb->width > (unsigned)g_video.tex_w || fb->height > (unsigned)g_video.tex_h)
+        return false;
+    size_t size = (size_t)g_video.tex_w * g_video.tex_h * g_video.bpp;
+    if (g_swfb_size < size) {
+        plat_aligned_free(g_swfb);
+        g_swfb = (uint8_t*)plat_aligned_alloc(64, size);
+        g_swfb_size = g_swfb ? size : 0;
+        if (!g_swfb)
+            return false;
+    }
+    fb->data = g_swfb;
+    fb->pitch = fb->width * g_video.bpp;
+    fb->format = (enum retro_pixel_format)g_video.rformat;
+    fb->memory_flags = RETRO_MEMORY_TYPE_CACHED;
+    return true;
+}
+
+void video_deinit() {
+    plat_aligned_free(g_swfb);
+    g_swfb = NULL;
+    g_swfb_size = 0;
+    plat_aligned_free(g_conv);
+    g_conv = NULL;
+    g_conv_size = 0;
+    frame_shadow_free(&g_shadow);
+}
@@ -0,0 +1,123 @@
+#include "wav_sink.h"
+#include "ring.h"
+
+#define WAV_HEADER_SIZE 44
+#define WAV_FORMAT_IEEE_FLOAT 3
+#define WAV_WRITE_FRAMES 4096
+
+struct wav_sink
+{
+    FILE *file;
+    audio_ring *ring;
+    sthread_t *thread;
+    std::atomic<bool> running;
+    unsigned rate;
+    unsigned channels;
+    size_t data_bytes;
+    std::atomic<size_t> dropped;
+    float *buffer;
+};
+
+static void put_le(uint8_t *p, uint32_t v, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+        p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static void wav_header(uint8_t *h, unsigned rate, unsigned channels, size_t data_bytes)
+{
+    unsigned block = channels * sizeof(float);
+    memcpy(h, "RIFF", 4);
+    put_le(h + 4, (uint32_t)(data_bytes + WAV_HEADER_SIZE - 8), 4);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put_le(h + 16, 16, 4);
+    put_le(h + 20, WAV_FORMAT_IEEE_FLOAT, 2);
+    put_le(h + 22, channels, 2);
+    put_le(h + 24, rate, 4);
+    put_le(h + 28, rate * block, 4);
+    put_le(h + 32, block, 2);
+    put_le(h + 34, 32, 2);
+    memcpy(h + 36, "data", 4);
+    put_le(h + 40, (uint32_t)data_bytes, 4);
+}
+
+static void wav_sink_drain(wav_sink *sink)
+{
+    size_t got;
+    while ((got = ring_read(sink->ring, sink->buffer, WAV_WRITE_FRAMES)))
+        sink->data_bytes += fwrite(sink->buffer, sink->ring->frame_size, got, sink->file) * sink->ring->frame_size;
+}
+
+static void wav_sink_thread(void *data)
+{
+    wav_sink *sink = (wav_sink*)data;
+    while (sink->running.load())
+    {
+        ring_wait_readable(sink->ring, WAV_WRITE_FRAMES, 50000);
+        wav_sink_drain(sink);
+    }
+}
+
+wav_sink *wav_sink_open(const TCHAR *path, unsigned rate, unsigned channels)
+{
+    FILE *file = _tfopen(path, _T("wb"));
+    if (!file)
+        return NULL;
+    uint8_t header[WAV_HEADER_SIZE];
+    wav_header(header, rate, channels, 0);
+    fwrite(header, 1, sizeof(header), file);
+
+    wav_sink *sink = new wav_sink();
+    sink->file = file;
+    sink->rate = rate;
+    sink->channels = channels;
+    sink->data_bytes = 0;
+    sink->dropped = 0;
+    // a second of slack for the disk
+    sink->ring = ring_new(rate, channels * sizeof(float));
+    sink->buffer = new float[WAV_WRITE_FRAMES * channels];
+    sink->running = true;
+    sink->thread = sink->ring ? sthread_create(wav_sink_thread, sink) : NULL;
+    if (!sink->thread)
+    {
+        ring_free(sink->ring);
+        delete[] sink->buffer;
+        delete sink;
+        fclose(file);
+        _tremove(path);
+        return NULL;
+    }
+    return sink;
+}
+
+void wav_sink_write(wav_sink *sink, const float *frames, size_t count)
+{
+    size_t written = ring_write(sink->ring, frames, count);
+    if (written < count)
+        sink->dropped.fetch_add(count - written, std::memory_order_relaxed);
+}
+
+size_t wav_sink_dropped(wav_sink *sink)
+{
+    return sink->dropped.load(std::memory_order_relaxed);
+}
+
+void wav_sink_close(wav_sink *sink)
+{
+    if (!sink)
+        return;
+    sink->running = false;
+    ring_wake_reader(sink->ring);
+    sthread_join(sink->thread);
+    wav_sink_drain(sink);
+
+    uint8_t header[WAV_HEADER_SIZE];
+    wav_header(header, sink->rate, sink->channels, sink->data_bytes);
+    fseek(sink->file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), sink->file);
+    fclose(sink->file);
+
+    ring_free(sink->ring);
+    delete[] sink->buffer;
+    delete sink;
+}
@@ -0,0 +1,19 @@
+#ifndef _wav_sink_h_
+#define _wav_sink_h_
+
+#include "platform.h"
+
+// Tees the post-resampler stream to a 32-bit float WAV. The audio path only
+// copies into a ring; a writer thread does the file IO, so a slow disk
+// drops audio from the file rather than stalling the device or the core.
+
+struct wav_sink;
+
+wav_sink *wav_sink_open(const TCHAR *path, unsigned rate, unsigned channels);
+// never blocks; frames that don't fit are dropped and counted
+void wav_sink_write(wav_sink *sink, const float *frames, size_t count);
+// drains, fixes up the header sizes and closes the file
+void wav_sink_close(wav_sink *sink);
+size_t wav_sink_dropped(wav_sink *sink);
+
+#endif